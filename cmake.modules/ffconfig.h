@@ -0,0 +1,29 @@
+/* standard headers */
+#define HAVE_MALLOC_H 1
+#define HAVE_NUMA_H
+#define HAVE_STDINT_H
+#define HAVE_PTHREAD_H
+#define HAVE_OMP_H
+
+/* Compiler type */
+#define CMAKE_COMPILER_IS_GNUCC
+#define HAS_GCC                   /* Alias */
+#define CMAKE_COMPILER_IS_GNUCXX 
+/* #undef HAS_GXX */
+/* #undef HAS_CLANGXX */
+#define HAS_MSVC
+/* #undef HAS_MSVC10 */
+
+/* cxx11*/
+#define HAS_CXX11_AUTO
+#define HAS_CXX11_NULLPTR
+#define HAS_CXX11_LAMBDA
+#define HAS_CXX11_STATIC_ASSERT
+#define HAS_CXX11_RVALUE_REFERENCES
+#define HAS_CXX11_DECLTYPE
+#define HAS_CXX11_CSTDINT_H
+#define HAS_CXX11_LONG_LONG
+#define HAS_CXX11_VARIADIC_TEMPLATES
+#define HAS_CXX11_CONSTEXPR
+#define HAS_CXX11_SIZEOF_MEMBER
+#define HAS_CXX11_FUNC
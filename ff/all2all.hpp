@@ -32,14 +32,84 @@
  ****************************************************************************
  */
 
+#include <vector>
 #include <ff/node.hpp>
 #include <ff/multinode.hpp>
+#include <ff/mapping_utils.hpp>
 
 namespace ff {
 
 // forward declarations
 static ff_node* ispipe_getlast(ff_node*);
-    
+
+/*
+ * Load balancer used by the nodes of the first set of a NUMA-aware all-to-all 
+ * (see ff_a2a::numa_mapping). 
+ * With on-demand scheduling the nodes of the second set running on the same
+ * NUMA node are tried first. Round-robin scheduling is not modified, otherwise
+ * the remote nodes would receive messages only when all the local queues are full.
+ * The messages sent to nodes running on a different NUMA node are counted.
+ */
+class numa_lb: public ff_loadbalancer {
+public:
+    numa_lb(int max_num_workers):ff_loadbalancer(max_num_workers) {}
+
+    // local[i] is true if the i-th output channel goes to a node on the same NUMA node,
+    // the local nodes are preferred only if ondemand is true
+    void set_locality(const std::vector<bool>& local, bool ondemand) {
+        islocal = local;
+        prefer_local = ondemand;
+        lids.clear(); rids.clear();
+        for(size_t i=0;i<local.size();++i) 
+            if (local[i]) lids.push_back(i); else rids.push_back(i);
+    }
+
+    size_t get_local_messages()  const { return localmsg;  }
+    size_t get_remote_messages() const { return remotemsg; }
+
+protected:
+    inline size_t selectworker() {
+        const size_t n = lids.size()+rids.size();
+        if (!prefer_local || n != getnworkers()) return last = ff_loadbalancer::selectworker();
+        const size_t a = attempt++ % n;
+        if (a < lids.size()) last = lids[(startl + a) % lids.size()];
+        else                 last = rids[(startr + a - lids.size()) % rids.size()];
+        return last;
+    }
+
+    inline void count(size_t id) {
+        if (id < islocal.size() && !islocal[id]) ++remotemsg;
+        else ++localmsg;
+    }
+
+public:
+    inline bool schedule_task(void * task, 
+                              unsigned long retry=((unsigned long)-1), 
+                              unsigned long ticks=TICKS2WAIT) {
+        // each new task starts from the next local (and remote) node 
+        attempt = 0;
+        if (lids.size()) startl = (startl+1) % lids.size();
+        if (rids.size()) startr = (startr+1) % rids.size();
+        bool r = ff_loadbalancer::schedule_task(task, retry, ticks);
+        if (r) count(last);
+        return r;
+    }
+    inline bool ff_send_out_to(void *task, int id,  
+                               unsigned long retry=((unsigned long)-1),
+                               unsigned long ticks=(TICKS2WAIT)) {
+        bool r = ff_loadbalancer::ff_send_out_to(task, id, retry, ticks);
+        if (r) count(id);
+        return r;
+    }
+
+protected:
+    std::vector<bool>   islocal;
+    std::vector<size_t> lids, rids;
+    bool   prefer_local=false;
+    size_t attempt=0, startl=0, startr=0, last=0;
+    size_t localmsg=0, remotemsg=0;
+};
+
 class ff_a2a: public ff_node {
     friend class ff_farm;
     friend class ff_pipeline;    
@@ -231,6 +301,9 @@ protected:
         }
 
      
+        // NOTE: the load balancers have to be replaced before initializing the blocking stuff
+        if (numa_aware) numa_placement();
+     
         // blocking stuff --------------------------------------------
         pthread_mutex_t   *m        = NULL;
         pthread_cond_t    *c        = NULL;
@@ -249,6 +322,63 @@ protected:
 
     void *svc(void*) { return FF_EOS; }
 
+    static void numa_setaffinity(ff_node* n, int cpu) {
+        n->setAffinity(cpu);
+        ff_monode* mo = dynamic_cast<ff_monode*>(n);
+        if (mo && mo->getlb() && mo->getlb()->get_filter()) 
+            mo->getlb()->get_filter()->setAffinity(cpu);
+        ff_minode* mi = dynamic_cast<ff_minode*>(n);
+        if (mi && mi->getgt() && mi->getgt()->get_filter()) 
+            mi->getgt()->get_filter()->setAffinity(cpu);
+    }
+
+    /*
+     * Block-distributes the nodes of both sets among the NUMA nodes, pins
+     * each node to a core of its NUMA node and installs the numa_lb in the 
+     * nodes of the first set. Pipelines are not pinned.
+     */
+    void numa_placement() {
+#if !defined(NO_DEFAULT_MAPPING)
+        if (!default_mapping) return;
+        std::vector<std::vector<int> > topo, nodes;
+        ff_numaTopology(topo);
+        for(size_t i=0;i<topo.size();++i) {
+            std::vector<int> cpus;
+            for(size_t j=0;j<topo[i].size();++j)
+                if (threadMapper::instance()->checkCPUId(topo[i][j])) cpus.push_back(topo[i][j]);
+            if (cpus.size()) nodes.push_back(cpus);  // memory-only nodes are skipped
+        }
+        if (nodes.size()==0) return;
+        
+        const size_t N = nodes.size();
+        const size_t nworkers1 = workers1.size();
+        const size_t nworkers2 = workers2.size();
+        std::vector<size_t> next(N,0), numa1(nworkers1), numa2(nworkers2);
+        for(size_t i=0;i<nworkers1;++i) {
+            numa1[i] = (i*N)/nworkers1;
+            if (workers1[i]->isPipe()) continue;
+            numa_setaffinity(workers1[i], nodes[numa1[i]][next[numa1[i]]++ % nodes[numa1[i]].size()]);
+        }
+        for(size_t j=0;j<nworkers2;++j) {
+            numa2[j] = (j*N)/nworkers2;
+            if (workers2[j]->isPipe()) continue;
+            numa_setaffinity(workers2[j], nodes[numa2[j]][next[numa2[j]]++ % nodes[numa2[j]].size()]);
+        }
+        for(size_t i=0;i<nworkers1;++i) {
+            ff_monode* mo = dynamic_cast<ff_monode*>(workers1[i]);
+            if (!mo || !mo->myownlb) continue;  // user-defined load balancer, not replaced
+            std::vector<bool> local(nworkers2);
+            for(size_t j=0;j<nworkers2;++j) local[j] = (numa1[i] == numa2[j]);
+            numa_lb* lb = new numa_lb(DEF_MAX_NUM_WORKERS);
+            lb->set_locality(local, mo->ondemand_buffer()>0);
+            if (mo->getlb()->get_filter()) lb->set_filter(mo->getlb()->get_filter());
+            // the barrier has already been set by cardinality
+            if (mo->get_barrier()) lb->set_barrier(mo->get_barrier());
+            mo->setlb(lb, true);
+            numalbs.push_back(lb);
+        }
+#endif
+    }
     
 public:
     enum { DEF_IN_BUFF_ENTRIES=DEFAULT_BUFFER_CAPACITY,
@@ -361,6 +491,37 @@ public:
         initial_barrier=false;
     }
 
+    /**
+     * \brief NUMA-aware placement and routing (must be called before running the a2a)
+     *
+     * The nodes of the first and of the second set are block-distributed among
+     * the NUMA nodes and pinned to the cores of their NUMA node, so that the i-th
+     * group of first-set nodes (the producers) and the i-th group of second-set
+     * nodes (the consumers of the corresponding partitions) share the same NUMA node.
+     * When a first-set node uses on-demand scheduling (see add_firstset) the
+     * second-set nodes on the same NUMA node are preferred. Round-robin scheduling
+     * and explicit routing (ff_send_out_to) are not modified.
+     * The number of messages crossing NUMA nodes is given by \p get_numa_remote_messages.
+     */
+    void numa_mapping(bool onoff=true) {
+        numa_aware = onoff;
+    }
+    
+    /**
+     * \brief Number of messages sent by the first set to second-set nodes running
+     * on a different NUMA node (valid only if \p numa_mapping has been set).
+     */
+    size_t get_numa_remote_messages() const {
+        size_t r=0;
+        for(size_t i=0;i<numalbs.size();++i) r += numalbs[i]->get_remote_messages();
+        return r;
+    }
+    size_t get_numa_local_messages() const {
+        size_t r=0;
+        for(size_t i=0;i<numalbs.size();++i) r += numalbs[i]->get_local_messages();
+        return r;
+    }
+
     int cardinality() const { 
         int card=0;
         for(size_t i=0;i<workers1.size();++i) card += workers1[i]->cardinality();
@@ -638,6 +799,9 @@ public:
         for(size_t i=0;i<workers1.size();++i) workers1[i]->ffStats(out);
         out << "--- R-Workers:\n";
         for(size_t i=0;i<workers2.size();++i) workers2[i]->ffStats(out);
+        if (numa_aware) 
+            out << "--- NUMA: local messages " << get_numa_local_messages()
+                << ", remote messages " << get_numa_remote_messages() << "\n";
     }
 #else
     void ffStats(std::ostream & out) { 
@@ -724,6 +888,8 @@ protected:
     bool prepared, fixedsize,reduce_channels;
     int in_buffer_entries, out_buffer_entries;
     int ondemand_chunk=0;
+    bool numa_aware=false;
+    svector<numa_lb*>  numalbs;
     svector<ff_node*>  workers1;  // first set, nodes must be multi-output
     svector<ff_node*>  workers2;  // second set, nodes must be multi-input
     svector<ff_node*>  outputNodes;
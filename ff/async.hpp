@@ -0,0 +1,367 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \link
+ * \file async.hpp
+ * \ingroup building_blocks
+ *
+ * \brief Farm accelerator returning a future for each offloaded task
+ *
+ * @detail Each task offloaded with async completes its own future as soon as
+ * its result is ready, independently of the other tasks (no head-of-line
+ * blocking). The future is completed by the worker (or by the collector if
+ * requested), the shared states of the futures are recycled by a pool.
+ *
+ */
+
+#ifndef FF_ASYNC_HPP
+#define FF_ASYNC_HPP
+
+/* ***************************************************************************
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <ff/node.hpp>
+#include <ff/farm.hpp>
+#include <ff/spin-lock.hpp>
+
+namespace ff {
+
+// n. of shared states pre-allocated by the pool of an ff_async_farm
+#if !defined(DEF_ASYNC_POOL)
+#define DEF_ASYNC_POOL   256
+#endif
+// n. of attempts before a waiting thread goes to sleep
+#if !defined(DEF_ASYNC_SPIN)
+#define DEF_ASYNC_SPIN   1024
+#endif
+
+class ff_async_pool;
+
+/**
+ * \internal
+ * \brief Shared state of a future, it is also the message offloaded to the farm.
+ *
+ * It is referenced by the future and by the farm (until the completion).
+ */
+struct ff_async_state {
+    enum { PENDING=0, CONTINUATION=1, READY=2 };
+
+    inline void complete(void* r);
+    inline void release();
+
+    std::atomic<int>           status{PENDING};
+    std::atomic<int>           refs{0};
+    std::atomic<int>           waiters{0};
+    std::atomic<size_t>        counter{0};   // used by ff_when_all
+    void                      *task   = nullptr;
+    void                      *result = nullptr;
+    std::function<void(void*)> cont;
+    std::mutex                 m;
+    std::condition_variable    cv;
+    ff_async_pool             *pool   = nullptr;
+};
+
+/*!
+ * \brief Pool of shared states, get and put can be called by any thread.
+ */
+class ff_async_pool {
+public:
+    ff_async_pool(size_t n=DEF_ASYNC_POOL) {
+        init_unlocked(lock);
+        for(size_t i=0;i<n;++i) free.push_back(create());
+    }
+    ~ff_async_pool() {
+        for(auto s: free) delete s;
+    }
+
+    ff_async_state* get() {
+        ff_async_state *s = nullptr;
+        spin_lock(lock);
+        if (!free.empty()) {
+            s = free.back();
+            free.pop_back();
+        }
+        spin_unlock(lock);
+        if (!s) s = create();
+        s->status.store(ff_async_state::PENDING, std::memory_order_relaxed);
+        s->counter.store(0, std::memory_order_relaxed);
+        s->refs.store(2, std::memory_order_relaxed);   // the future and the farm
+        s->task = s->result = nullptr;
+        return s;
+    }
+    void put(ff_async_state* s) {
+        s->cont = nullptr;
+        spin_lock(lock);
+        free.push_back(s);
+        spin_unlock(lock);
+    }
+
+    /// n. of shared states allocated so far
+    size_t get_num_allocated() const { return allocated.load(std::memory_order_relaxed); }
+
+protected:
+    ff_async_state* create() {
+        ff_async_state *s = new ff_async_state;
+        s->pool = this;
+        allocated.fetch_add(1, std::memory_order_relaxed);
+        return s;
+    }
+
+    lock_t                        lock;
+    std::vector<ff_async_state*>  free;
+    std::atomic<size_t>           allocated{0};
+};
+
+inline void ff_async_state::complete(void* r) {
+    result = r;
+    // seq_cst: the status must be visible before reading waiters (see wait)
+    const int prev = status.exchange(READY);
+    if (prev == CONTINUATION) {
+        // then may be chaining another continuation
+        std::function<void(void*)> c;
+        {
+            std::lock_guard<std::mutex> lk(m);
+            c = std::move(cont);
+        }
+        c(r);
+    }
+    if (waiters.load() > 0) {
+        std::lock_guard<std::mutex> lk(m);
+        cv.notify_all();
+    }
+    release();
+}
+inline void ff_async_state::release() {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) pool->put(this);
+}
+
+/*!
+ *  \class ff_future
+ *  \ingroup building_blocks
+ *
+ *  \brief Result of a task offloaded with ff_async_farm::async.
+ *
+ *  The future can be moved, not copied.
+ */
+class ff_future {
+public:
+    ff_future() {}
+    explicit ff_future(ff_async_state* s): s(s) {}
+    ff_future(ff_future&& f): s(f.s) { f.s = nullptr; }
+    ff_future& operator=(ff_future&& f) {
+        if (this != &f) {
+            if (s) s->release();
+            s = f.s; f.s = nullptr;
+        }
+        return *this;
+    }
+    ff_future(const ff_future&) = delete;
+    ff_future& operator=(const ff_future&) = delete;
+    ~ff_future() { if (s) s->release(); }
+
+    bool valid() const { return s != nullptr; }
+    bool ready() const {
+        return !s || s->status.load(std::memory_order_acquire) == ff_async_state::READY;
+    }
+
+    /**
+     * \brief Waits for the completion of the task and returns its result
+     * (the value returned by the worker's svc, or the last element it has
+     * sent out, nullptr if none).
+     */
+    void* wait() {
+        if (!s) return nullptr;
+        for(int i=0; i<DEF_ASYNC_SPIN; ++i)
+            if (ready()) return s->result;
+        // seq_cst: see ff_async_state::complete
+        s->waiters.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lk(s->m);
+            s->cv.wait(lk, [this] { return s->status.load() == ff_async_state::READY; });
+        }
+        s->waiters.fetch_sub(1);
+        return s->result;
+    }
+    void* get() { return wait(); }
+
+    /**
+     * \brief \p f(result) is called when the task completes: by the thread
+     * completing the future, or immediately by the caller if the future is
+     * already completed. Several continuations can be set (also by
+     * ff_when_all), they are chained in the order they have been set.
+     */
+    template<typename F>
+    void then(F&& f) {
+        if (!s) { f(nullptr); return; }
+        std::unique_lock<std::mutex> lk(s->m);
+        const int st = s->status.load();
+        if (st == ff_async_state::READY) {
+            lk.unlock();
+            f(s->result);
+            return;
+        }
+        if (s->cont) {
+            std::function<void(void*)> prev = std::move(s->cont);
+            s->cont = [prev, f](void* r) mutable { prev(r); f(r); };
+        } else s->cont = std::forward<F>(f);
+        if (st == ff_async_state::PENDING) {
+            int expected = ff_async_state::PENDING;
+            if (!s->status.compare_exchange_strong(expected, ff_async_state::CONTINUATION)) {
+                // completed in the meantime, complete has not seen the continuation
+                std::function<void(void*)> c = std::move(s->cont);
+                lk.unlock();
+                c(s->result);
+            }
+        }
+    }
+
+protected:
+    friend inline ff_future ff_when_all(std::vector<ff_future>& F);
+    ff_async_state *s = nullptr;
+};
+
+/*!
+ * \brief Returns a future completed when all the futures in \p F are completed
+ * (its result is nullptr). It adds a continuation to the futures in \p F,
+ * the ones already set are kept.
+ */
+inline ff_future ff_when_all(std::vector<ff_future>& F) {
+    ff_async_pool *pool = nullptr;
+    for(auto& f: F) if (f.s) { pool = f.s->pool; break; }
+    if (!pool) return ff_future();
+    ff_async_state *all = pool->get();
+    all->counter.store(F.size() + 1);
+    auto done = [all](void*) {
+        if (all->counter.fetch_sub(1) == 1) all->complete(nullptr);
+    };
+    for(auto& f: F) f.then(done);
+    done(nullptr);   // all the continuations have been set
+    return ff_future(all);
+}
+
+/**
+ * \internal
+ * \brief Wrapper of a worker of the ff_async_farm, it unpacks the shared state.
+ */
+class async_worker: public ff_node {
+public:
+    async_worker(ff_node* node, bool complete, bool cleanup):
+        node(node), complete(complete), cleanup(cleanup) {
+        node->registerCallback(send_out_cb, this);
+    }
+    ~async_worker() { if (cleanup) delete node; }
+
+    void *svc(void *task) {
+        ff_async_state *s = reinterpret_cast<ff_async_state*>(task);
+        out = nullptr;
+        void *r = node->svc(s->task);
+        if (r == GO_ON || r == EOS) r = out;
+        if (complete) {
+            s->complete(r);
+            return GO_ON;
+        }
+        s->result = r;
+        return s;
+    }
+    int  svc_init() { return node->svc_init(); }
+    void svc_end()  { node->svc_end(); }
+
+protected:
+    static bool send_out_cb(void *task, int, unsigned long, unsigned long, void *obj) {
+        reinterpret_cast<async_worker*>(obj)->out = task;
+        return true;
+    }
+
+    ff_node    *node;
+    const bool  complete, cleanup;
+    void       *out = nullptr;
+};
+
+/**
+ * \internal
+ * \brief Collector of the ff_async_farm, it completes the futures.
+ */
+struct async_collector: ff_node {
+    void *svc(void *task) {
+        ff_async_state *s = reinterpret_cast<ff_async_state*>(task);
+        s->complete(s->result);
+        return GO_ON;
+    }
+};
+
+/*!
+ *  \class ff_async_farm
+ *  \ingroup building_blocks
+ *
+ *  \brief Farm accelerator whose tasks are offloaded with async, which
+ *  returns a future of the result.
+ *
+ *  The result of a task is the value returned by the worker's svc (or the
+ *  last element it has sent out). The futures are completed by the workers
+ *  or, if \p use_collector is true, by the collector (a single thread, so the
+ *  continuations are serialized). Independent tasks complete out of order.
+ *
+ *  The farm is started with run (or run_then_freeze) and terminated by
+ *  offloading the EOS and waiting for it. All the futures must be destroyed
+ *  before the farm.
+ *
+ *  This class is defined in \ref async.hpp
+ */
+class ff_async_farm: public ff_farm {
+public:
+    ff_async_farm(const std::vector<ff_node*>& W, bool use_collector=false, bool cleanup=false,
+                  size_t pool_size=DEF_ASYNC_POOL):
+        ff_farm(true), pool(pool_size) {
+        std::vector<ff_node*> w;
+        for(auto n: W) w.push_back(new async_worker(n, !use_collector, cleanup));
+        add_workers(w);
+        cleanup_workers();
+        if (use_collector) add_collector(new async_collector, true);
+        else remove_collector();
+        // a long task does not delay the ones queued after it
+        set_scheduling_ondemand();
+    }
+
+    /**
+     * \brief Offloads \p task, it returns the future of its result.
+     */
+    ff_future async(void* task) {
+        ff_async_state *s = pool.get();
+        s->task = task;
+        if (!offload(s)) {
+            s->complete(nullptr);
+            error("ASYNC, offload failed\n");
+        }
+        return ff_future(s);
+    }
+
+    /// n. of shared states allocated (it does not grow in steady state)
+    size_t get_num_states() const { return pool.get_num_allocated(); }
+
+protected:
+    ff_async_pool pool;
+};
+
+} // namespace ff
+
+#endif /* FF_ASYNC_HPP */
@@ -30,9 +30,23 @@
  */
 
 #include <stdlib.h>
+#include <climits>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
 #include <ff/platforms/platform.h>
 #include <ff/utils.hpp>
 #include <ff/config.hpp>
+#include <ff/mapping_utils.hpp>
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#else
+#include <mutex>
+#include <condition_variable>
+#endif
 
 // 
 // Inside FastFlow barriers are used only for:
@@ -231,6 +245,300 @@ struct barHelper<true> {
 template<bool whichone>
 struct barrierSelector: public barHelper<whichone> {};
 
+// fan-in of the internal nodes of the treeBarrier
+#if !defined(DEF_BARRIER_FANIN)
+#define DEF_BARRIER_FANIN  4
+#endif
+
+/**
+ * \internal
+ * \brief Maps the ids passed to doBarrier into the ranks 0..n-1.
+ *
+ * As for the spinBarrier, the ids have only to be smaller than the
+ * maximum number of threads. A thread gets its rank in the first barrier
+ * after a reset, trying first the rank it had before, so that with stable
+ * ids the cost is one uncontended CAS for each reset.
+ */
+class barrierRanks {
+    struct alignas(CACHE_LINE_SIZE) owner_t { std::atomic<size_t> gen{0}; };
+    struct id_t { size_t gen = 0; size_t rank = (size_t)-1; };
+public:
+    barrierRanks(const size_t maxNThreads): ids(maxNThreads), owners(maxNThreads) {}
+
+    // it must be called when no thread is in the barrier
+    inline void reset(size_t init) {
+        n = init;
+        gen.fetch_add(1, std::memory_order_release);
+    }
+    inline size_t get(size_t tid) {
+        assert(tid<ids.size());
+        const size_t g = gen.load(std::memory_order_acquire);
+        id_t& me = ids[tid];
+        if (me.gen == g) return me.rank;
+        size_t r = (me.rank < n) ? me.rank : tid % n;
+        for(size_t i=0; ; ++i, r = (r+1) % n) {
+            if (i == n) {
+                error("FATAL ERROR: barrier: more threads than expected!\n");
+                abort();
+            }
+            size_t o = owners[r].gen.load(std::memory_order_relaxed);
+            if (o != g && owners[r].gen.compare_exchange_strong(o, g)) break;
+        }
+        me.gen = g; me.rank = r;
+        return r;
+    }
+private:
+    size_t                n = 1;
+    std::atomic<size_t>   gen{0};
+    std::vector<id_t>     ids;
+    std::vector<owner_t>  owners;
+};
+
+/**
+ *  \class disseminationBarrier
+ *  \ingroup building_blocks
+ *
+ *  \brief Non-blocking dissemination barrier
+ *
+ *  In the round k the thread of rank r signals the thread of rank
+ *  (r+2^k) mod n and waits for the signal of the thread of rank
+ *  (r-2^k) mod n, after log2(n) rounds all threads have arrived. Each
+ *  thread spins only on its own flags (one cache line for each rank and
+ *  round), no location is written by more than one thread in a round.
+ *  The flags are counters, so they have not to be reset between barriers.
+ *
+ */
+class disseminationBarrier: public ffBarrier {
+    struct alignas(CACHE_LINE_SIZE) flag_t {
+        std::atomic<unsigned long> signals{0};
+        unsigned long              seen = 0;   // used only by the owner
+    };
+    static inline size_t nrounds(size_t n) {
+        size_t k=0;
+        while((size_t(1)<<k) < n) ++k;
+        return k;
+    }
+public:
+    disseminationBarrier(const size_t _maxNThreads=MAX_NUM_THREADS):
+        maxNThreads(_maxNThreads), maxRounds(nrounds(_maxNThreads)?nrounds(_maxNThreads):1),
+        _barrier(0), ranks(_maxNThreads), flags(_maxNThreads*maxRounds) {}
+
+    /**
+     *  The results are undefined if barrierSetup() is called while
+     *  any thread is blocked on the barrier.
+     */
+    inline int barrierSetup(size_t init) {
+        assert(init>0 && init<=maxNThreads);
+        ranks.reset(init);
+        _barrier = init;
+        return 0;
+    }
+    inline void doBarrier(size_t tid) {
+        const size_t n = _barrier;
+        const size_t r = ranks.get(tid);
+        for(size_t k=0, d=1; d<n; ++k, d<<=1) {
+            flags[((r+d)%n)*maxRounds + k].signals.fetch_add(1, std::memory_order_release);
+            flag_t& f = flags[r*maxRounds + k];
+            while(f.signals.load(std::memory_order_acquire) == f.seen) PAUSE();
+            ++f.seen;
+        }
+    }
+private:
+    const size_t          maxNThreads, maxRounds;
+    size_t                _barrier;
+    barrierRanks          ranks;
+    std::vector<flag_t>   flags;
+};
+
+/**
+ * \internal
+ * \brief Number of ranks grouped together at the leaves of the treeBarrier,
+ * the number of cores of a NUMA node (threads are mapped on cores in order).
+ */
+static inline size_t ff_barrier_group() {
+    static const size_t g = []() {
+        std::vector<std::vector<int> > nodes;
+        ff_numaTopology(nodes);
+        size_t m = 0;
+        for(auto& c: nodes) m = (std::max)(m, c.size());
+        return m ? m : size_t(1);
+    }();
+    return g;
+}
+
+/**
+ *  \class treeBarrier
+ *  \ingroup building_blocks
+ *
+ *  \brief Non-blocking combining tree barrier
+ *
+ *  The threads arrive at the leaves of a tree of counters with fan-in
+ *  \p fanin, the last one arriving at a node goes up to the parent, the
+ *  last one arriving at the root releases all the threads advancing the
+ *  epoch they are spinning on. The counters are in different cache lines
+ *  and each one is shared by at most \p fanin threads.
+ *
+ *  The leaves group consecutive ranks belonging to the same block of
+ *  \p group ranks (by default the number of cores of a NUMA node), so that
+ *  only the top of the tree is shared among NUMA nodes.
+ *
+ */
+class treeBarrier: public ffBarrier {
+    struct alignas(CACHE_LINE_SIZE) node_t {
+        std::atomic<long> count{0};
+        long              expected = 0;
+        long              parent   = -1;
+    };
+    struct alignas(CACHE_LINE_SIZE) epoch_t { std::atomic<unsigned long> e{0}; };
+public:
+    treeBarrier(const size_t _maxNThreads=MAX_NUM_THREADS,
+                const size_t fanin=DEF_BARRIER_FANIN, const size_t group=0):
+        maxNThreads(_maxNThreads), fanin(fanin>1?fanin:2), group(group?group:ff_barrier_group()),
+        _barrier(0), ranks(_maxNThreads), nodes(2*_maxNThreads), leaves(_maxNThreads) {}
+
+    /**
+     *  The results are undefined if barrierSetup() is called while
+     *  any thread is blocked on the barrier.
+     */
+    inline int barrierSetup(size_t init) {
+        assert(init>0 && init<=maxNThreads);
+        ranks.reset(init);
+        if (init == _barrier) return 0;
+        // level by level, consecutive elements of the same block are grouped
+        // in nodes of at most fanin elements, when each block has only one
+        // node left the blocks are merged
+        std::vector<size_t> blk(init), elem(init), nblk, nelem;
+        for(size_t r=0;r<init;++r) { blk[r] = r / group; elem[r] = r; }
+        size_t nnodes = 0;
+        bool leaf = true;
+        do {
+            nblk.clear(); nelem.clear();
+            for(size_t i=0, j; i<elem.size(); i=j) {
+                for(j=i; j<elem.size() && j-i<fanin && blk[j]==blk[i]; ++j) {
+                    if (leaf) leaves[elem[j]] = nnodes;
+                    else nodes[elem[j]].parent = nnodes;
+                }
+                nodes[nnodes].expected = j-i;
+                nodes[nnodes].parent   = -1;
+                nblk.push_back(blk[i]);
+                nelem.push_back(nnodes++);
+            }
+            bool merge = true;
+            for(size_t i=1;i<nblk.size();++i) if (nblk[i]==nblk[i-1]) { merge=false; break; }
+            if (merge) std::fill(nblk.begin(), nblk.end(), 0);
+            blk.swap(nblk); elem.swap(nelem);
+            leaf = false;
+        } while(elem.size()>1);
+        _barrier = init;
+        return 0;
+    }
+    inline void doBarrier(size_t tid) {
+        const size_t r = ranks.get(tid);
+        // the epoch cannot advance before this thread arrives
+        const unsigned long e = epoch.e.load(std::memory_order_acquire);
+        long i = leaves[r];
+        while(nodes[i].count.fetch_add(1, std::memory_order_acq_rel)+1 == nodes[i].expected) {
+            nodes[i].count.store(0, std::memory_order_relaxed);
+            if ((i = nodes[i].parent) < 0) {
+                epoch.e.store(e+1, std::memory_order_release);
+                return;
+            }
+        }
+        // spin-wait
+        while(epoch.e.load(std::memory_order_acquire) == e) PAUSE();
+    }
+private:
+    const size_t          maxNThreads, fanin, group;
+    size_t                _barrier;
+    barrierRanks          ranks;
+    epoch_t               epoch;
+    std::vector<node_t>   nodes;
+    std::vector<size_t>   leaves;
+};
+
+
+// n. of attempts before a thread waiting on an ff_epoch goes to sleep
+#if !defined(DEF_EPOCH_SPIN)
+#define DEF_EPOCH_SPIN  64
+#endif
+
+// spinning is useless (and harmful) with only one hardware thread
+static inline int ff_epoch_spin() {
+    static const int n = (std::thread::hardware_concurrency() > 1) ? DEF_EPOCH_SPIN : 0;
+    return n;
+}
+
+/*
+ * Sleeps while *w == val, wakes up all the threads sleeping on w.
+ * On Linux they are futex operations, elsewhere there is one mutex and one
+ * condition variable shared by all the words.
+ */
+#if defined(__linux__)
+static inline void ff_word_wait(std::atomic<int>* w, int val) {
+    syscall(SYS_futex, reinterpret_cast<int*>(w), FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+static inline void ff_word_wake(std::atomic<int>* w) {
+    syscall(SYS_futex, reinterpret_cast<int*>(w), FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+#else
+static inline std::mutex& ff_word_mutex() { static std::mutex m; return m; }
+static inline std::condition_variable& ff_word_cond() { static std::condition_variable c; return c; }
+static inline void ff_word_wait(std::atomic<int>* w, int val) {
+    std::unique_lock<std::mutex> lk(ff_word_mutex());
+    if (w->load() == val) ff_word_cond().wait(lk);
+}
+static inline void ff_word_wake(std::atomic<int>*) {
+    std::lock_guard<std::mutex> lk(ff_word_mutex());
+    ff_word_cond().notify_all();
+}
+#endif
+
+/**
+ *  \class ff_epoch
+ *  \ingroup building_blocks
+ *
+ *  \brief Activation barrier used to freeze and thaw threads
+ *
+ *  The threads wait for the next generation of the epoch (they spin for a
+ *  while, then they sleep on the generation counter), advancing the epoch
+ *  is one increment plus one wake-all. The threads of a skeleton share the
+ *  same epoch, so that they are all thawed by a single advance: between
+ *  hold and release the advances are deferred to the release.
+ *
+ */
+class ff_epoch {
+public:
+    inline int get() const { return gen.load(std::memory_order_acquire); }
+
+    /// waits until the generation is different from \p g
+    inline void wait(int g) {
+        for(int i=0, n=ff_epoch_spin(); i<n; ++i) {
+            if (gen.load(std::memory_order_acquire) != g) return;
+            PAUSE();
+        }
+        // seq_cst: waiters must be visible before reading gen (see advance)
+        waiters.fetch_add(1);
+        while(gen.load() == g) ff_word_wait(&gen, g);
+        waiters.fetch_sub(1);
+    }
+
+    inline void advance() {
+        if (holds.load() > 0) return;  // the release will advance
+        gen.fetch_add(1);
+        if (waiters.load() > 0) ff_word_wake(&gen);
+    }
+
+    inline void hold() { holds.fetch_add(1); }
+    inline void release() {
+        if (holds.fetch_sub(1) == 1) advance();
+    }
+
+private:
+    std::atomic<int> gen{0};
+    std::atomic<int> waiters{0};
+    std::atomic<int> holds{0};
+};
+
 } // namespace ff
 
 #endif /* FF_BARRIER_HPP */
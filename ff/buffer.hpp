@@ -233,7 +233,7 @@ public:
             WMB(); 
             //std::atomic_thread_fence(std::memory_order_release);
             buf[pwrite] = data;
-            pwrite += (pwrite+1 >=  size) ? (1-size): 1; // circular buffer
+            pwrite = pwrite + ((pwrite+1 >=  size) ? (1-size): 1); // circular buffer
             return true;
         }
         return false;
@@ -312,7 +312,7 @@ public:
      */
     inline bool  inc() {
         buf[pread]=NULL;
-        pread += (pread+1 >= size) ? (1-size): 1; // circular buffer       
+        pread = pread + ((pread+1 >= size) ? (1-size): 1); // circular buffer       
         return true;
     }           
 
@@ -352,7 +352,7 @@ public:
             pwrite = longxCacheLine-1;
             pread  = longxCacheLine-1;
         } else {
-            pread=pwrite=0; 
+            pread=0; pwrite=0; 
         }
 #if defined(SWSR_MULTIPUSH)        
         mcnt   = 0;
@@ -487,7 +487,7 @@ public:
 
         if (empty()) return false;
         *data = buf[pread];
-        pread += (pread+1 >= size) ? (1-size): 1;
+        pread = pread + ((pread+1 >= size) ? (1-size): 1);
         return true;
     }    
     
@@ -495,7 +495,7 @@ public:
      * TODO
      */
     inline void reset() { 
-        pread=pwrite=0; 
+        pread=0; pwrite=0; 
         if (size<=512) for(unsigned long i=0;i<size;++i) buf[i]=0;
         else memset(buf,0,size*sizeof(void*));
     }
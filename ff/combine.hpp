@@ -41,6 +41,7 @@
 // and some helper functions, e.g., combine_nodes, combine_farms, etc.
 
 
+#include <tuple>
 #include <ff/node.hpp>
 #include <ff/multinode.hpp>
 #include <ff/pipeline.hpp>
@@ -713,6 +714,136 @@ struct ff_comb_t: ff_comb {
 	ff_comb_t(ff_comb_t<TIN, S, T>* n1, ff_comb_t<T, W, TOUT>* n2):
 		ff_comb(n1,n2,false,false) {}	
 };
+
+/*!
+ *  \class ff_fused
+ *  \ingroup building_blocks
+ *
+ *  \brief Compile-time fusion of a chain of sequential typed stages.
+ *
+ *  The stages (ff_node_t) are executed by a single node without any queue
+ *  between them: the svc of each stage is called directly (no virtual call)
+ *  by the previous one. Both the values returned by the svc and the elements
+ *  sent with ff_send_out are passed to the next stage, GO_ON means that there
+ *  is nothing to pass. If one of the stages returns EOS, the following stages
+ *  receive the end-of-stream (eosnotify) and the fused node terminates.
+ *
+ *  The output/input types of consecutive stages must be the same.
+ *  The stages are not copied, they must outlive the fused node.
+ *
+ *  Use \ref ff_fuse to build it.
+ */
+template<typename... S>
+class ff_fused: public ff_node_t<typename std::tuple_element<0, std::tuple<S...> >::type::in_type,
+                                 typename std::tuple_element<sizeof...(S)-1, std::tuple<S...> >::type::out_type> {
+    static constexpr size_t N = sizeof...(S);
+    template<size_t I>
+    using stage_t = typename std::tuple_element<I, std::tuple<S...> >::type;
+
+    template<size_t I>
+    static constexpr bool valid_types() {
+        if constexpr (I+1 < N)
+            return std::is_same<typename stage_t<I>::out_type, typename stage_t<I+1>::in_type>::value && valid_types<I+1>();
+        else return true;
+    }
+    static_assert(N>0, "ff_fuse requires at least one stage");
+    static_assert(valid_types<0>(), "Input & output types of the fused stages don't match");
+
+public:
+    typedef typename stage_t<0>::in_type    IN_t;
+    typedef typename stage_t<N-1>::out_type OUT_t;
+
+    ff_fused(S&... stages): stages(&stages...) {}
+
+    int svc_init() {
+        eos_from = 0; pending = nullptr; flush = false;
+        return init<0>();
+    }
+
+    OUT_t* svc(IN_t* task) {
+        step<0>(task);
+        void *r = pending;
+        pending = nullptr;
+        if (eos_from) {
+            if (r) this->ff_send_out(r);
+            flush = true;
+            notify<1>();  // the stages after the terminated ones receive the EOS
+            flush = false;
+            return this->EOS;
+        }
+        return r ? reinterpret_cast<OUT_t*>(r) : this->GO_ON;
+    }
+
+    void eosnotify(ssize_t id=-1) {
+        flush = true;
+        std::get<0>(stages)->eosnotify(id);
+        notify<1>();
+        flush = false;
+    }
+
+    void svc_end() { end<0>(); }
+
+protected:
+    template<size_t I>
+    int init() {
+        if constexpr (I < N) {
+            std::get<I>(stages)->registerCallback(send_cb<I>, this);
+            if (std::get<I>(stages)->svc_init() < 0) return -1;
+            return init<I+1>();
+        } else return 0;
+    }
+    template<size_t I>
+    void end() {
+        if constexpr (I < N) {
+            std::get<I>(stages)->svc_end();
+            std::get<I>(stages)->registerCallback(nullptr, nullptr);
+            end<I+1>();
+        }
+    }
+    template<size_t I>
+    void notify() {
+        if constexpr (I < N) {
+            if (I >= eos_from) std::get<I>(stages)->eosnotify(-1);
+            notify<I+1>();
+        }
+    }
+
+    // it runs the stage I on the task t
+    template<size_t I>
+    inline void step(void* t) {
+        if (I < eos_from) return;   // the stage has terminated
+        typedef stage_t<I> T;
+        deliver<I>(std::get<I>(stages)->T::svc(reinterpret_cast<typename T::in_type*>(t)));
+    }
+
+    // it passes the output r of the stage I to the next one
+    template<size_t I>
+    inline void deliver(void* r) {
+        if (r == FF_GO_ON || r == FF_GO_OUT || r == FF_EOS_NOFREEZE) return;
+        if (r == nullptr || r == FF_EOS || r == FF_EOSW) {
+            if (I+1 > eos_from) eos_from = I+1;
+            return;
+        }
+        if constexpr (I+1 < N) step<I+1>(r);
+        else {
+            // the last output produced in the svc is returned, the others are sent out
+            if (flush) { this->ff_send_out(r); return; }
+            if (pending) this->ff_send_out(pending);
+            pending = r;
+        }
+    }
+
+    template<size_t I>
+    static bool send_cb(void* task, int, unsigned long, unsigned long, void* arg) {
+        reinterpret_cast<ff_fused*>(arg)->template deliver<I>(task);
+        return true;
+    }
+
+    std::tuple<S*...> stages;
+    size_t            eos_from = 0;   // the stages [0, eos_from) have terminated
+    void             *pending  = nullptr;
+    bool              flush    = false;
+};
     
 
 /* *************************************************************************** *
@@ -746,6 +877,16 @@ static inline std::unique_ptr<ff_node> unique_combine_nodes(T1& n1, T2& n2) {
     return comp;
 }
 
+/**
+ *  fuses a chain of typed sequential stages in a single node, e.g.
+ *      auto fused = ff_fuse(s1, s2, s3);
+ *      ff_Pipe<> pipe(source, fused, sink);
+ */
+template<typename... S>
+static inline ff_fused<S...> ff_fuse(S&... stages) {
+    return ff_fused<S...>(stages...);
+}
+
 /**
  *  combines two stages returning a pipeline:
  *   - node1 and node2 standard nodes (or ff_comb)   --> pipeline(node1, node2)
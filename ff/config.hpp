@@ -179,7 +179,9 @@
 // is not needed. Usually it is useful for debugging purposes.
 // #define FF_INITIAL_BARRIER
 
-// Which barrier implementation to use
+// Which barrier implementation to use: spinBarrier (central counter),
+// treeBarrier or disseminationBarrier (for many threads), Barrier (blocking).
+// The non-blocking one is also used by the ParallelFor* with spinbarrier.
 #if !defined(BARRIER_T)
 #define BARRIER_T             spinBarrier
 #endif
@@ -134,7 +134,7 @@ public:
     dynqueue(int cachesize=DEFAULT_CACHE_SIZE, bool fillcache=false):cache(cachesize) {
         Node * n = (Node *)::malloc(sizeof(Node));
         n->data = NULL; n->next = NULL;
-        head=tail=n;
+        head=n; tail=n;
         cache.init();
         if (fillcache) {
             for(int i=0;i<cachesize;++i) {
@@ -0,0 +1,396 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \link
+ * \file executor.hpp
+ * \ingroup building_blocks
+ *
+ * \brief M:N executor, it runs the nodes of a graph on a fixed pool of threads
+ *
+ * @detail The graph is built with the usual API (pipeline, farm, ...). Instead of
+ * spawning one thread per node, the executor schedules the nodes as tasks on a
+ * pool of worker threads. A node is runnable when one of its input channels is
+ * not empty and it has space in the output channels. A worker thread runs the
+ * node's svc for a bounded batch of input elements, then it yields.
+ *
+ */
+
+#ifndef FF_EXECUTOR_HPP
+#define FF_EXECUTOR_HPP
+
+/* ***************************************************************************
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <ff/node.hpp>
+#include <ff/ubuffer.hpp>
+#include <ff/pipeline.hpp>
+#include <ff/farm.hpp>
+
+namespace ff {
+
+// max number of input elements processed by a node each time it is scheduled
+#if !defined(DEF_EXECUTOR_BATCH)
+#define DEF_EXECUTOR_BATCH      64
+#endif
+// number of elements in a channel above which the producer is not scheduled
+#if !defined(DEF_EXECUTOR_CHANNEL)
+#define DEF_EXECUTOR_CHANNEL    512
+#endif
+
+/*!
+ *  \class ff_executor
+ *  \ingroup building_blocks
+ *
+ *  \brief Runs a graph of nodes on a fixed number of threads (M:N scheduling).
+ *
+ *  Supported building blocks: sequential nodes (also multi-input and multi-output
+ *  ones), pipelines and farms (with or without emitter/collector). Ordered farms,
+ *  all-to-all, combined nodes and feedback channels are not supported.
+ *
+ *  The channels are unbounded: the \p capacity is a soft bound used to decide
+ *  whether a producer is runnable, so a node emitting many elements in a single
+ *  svc call (e.g. a source running its whole loop in one call) does not block.
+ *  A node returning GO_ON for the svc(NULL) call is a source that is called
+ *  again until it returns EOS.
+ *
+ *  A node terminating before its producers (e.g. returning EOS from svc) does
+ *  not receive more elements: ff_send_out returns false (the sender keeps the
+ *  ownership of the element) and the elements returned by svc are dropped and
+ *  counted (see get_num_dropped).
+ *
+ *  NOTE: the svc methods of a node are always executed in mutual exclusion but
+ *        possibly by different threads. get_channel_id and get_num_outchannels
+ *        of multi-input/multi-output nodes cannot be used.
+ *
+ *  This class is defined in \ref executor.hpp
+ */
+class ff_executor {
+protected:
+    struct unit_t;
+    struct channel_t {
+        channel_t(unit_t* p, unit_t* c): q(DEF_EXECUTOR_CHANNEL), producer(p), consumer(c) { q.init(); }
+        uSWSR_Ptr_Buffer   q;
+        std::atomic<long>  size{0};
+        unit_t            *producer, *consumer;
+    };
+    struct unit_t {
+        unit_t(ff_executor* ex, ff_node* node): ex(ex), node(node) {}
+        ff_executor*             ex;
+        ff_node*                 node;
+        std::vector<channel_t*>  in, out;
+        size_t                   nextin=0, nextout=0, neos=0;
+        bool                     initialized=false;
+        std::atomic<bool>        done{false};
+        std::atomic<bool>        scheduled{false};
+    };
+    // default emitter and collector of a farm
+    struct passthrough: ff_node {
+        void *svc(void *t) { return t; }
+    };
+    struct worker_t: ff_node {
+        worker_t(ff_executor* ex): ex(ex) {}
+        void *svc(void *) { ex->worker_loop(); return EOS; }
+        ff_executor *ex;
+    };
+
+public:
+    ff_executor(size_t nthreads=ff_numCores(), size_t batch=DEF_EXECUTOR_BATCH,
+                long capacity=DEF_EXECUTOR_CHANNEL):
+        nthreads(nthreads?nthreads:1), batch(batch?batch:1), capacity(capacity>0?capacity:1) {}
+
+    ~ff_executor() { clear(); }
+
+    /**
+     * \brief Runs the graph \p g and waits for its termination.
+     *
+     * \return 0 if successful, -1 otherwise.
+     */
+    int run_and_wait_end(ff_node& g) {
+        clear();
+        build(&g, std::vector<unit_t*>());
+        if (!ok || units.empty()) {
+            clear();
+            return -1;
+        }
+        for(auto u: units) {
+            u->node->registerCallback(send_cb, u);
+        }
+        finished = false;
+        ndone    = 0;
+        ndropped = 0;
+        for(auto u: units)
+            if (u->in.empty()) schedule(u);
+        std::vector<worker_t*> W;
+        for(size_t i=0;i<nthreads;++i) {
+            worker_t *w = new worker_t(this);
+            if (w->run()<0) {
+                error("EXECUTOR, spawning worker thread\n");
+                delete w;
+                ok = false;
+                break;
+            }
+            W.push_back(w);
+        }
+        if (W.empty()) { clear(); return -1; }
+        for(auto w: W) {
+            w->wait();
+            delete w;
+        }
+        for(auto u: units) u->node->registerCallback(nullptr, nullptr);
+        if (ndropped.load())
+            error("EXECUTOR, %ld elements returned by svc have been dropped, their consumers had terminated\n",
+                  (long)ndropped.load());
+        bool r = ok;
+        clear();
+        return r ? 0 : -1;
+    }
+
+    size_t get_num_threads()     const { return nthreads; }
+    size_t get_num_nodes()       const { return nnodes; }       ///< nodes of the last graph
+    size_t get_num_activations() const { return nactivations; } ///< n. of times the nodes have been scheduled
+    /// elements returned by svc and dropped because their consumers had terminated (last graph)
+    size_t get_num_dropped()     const { return ndropped; }
+
+protected:
+    void clear() {
+        for(auto u: units) {
+            for(auto c: u->out) delete c;
+            delete u;
+        }
+        units.clear();
+        for(auto n: defaults) delete n;
+        defaults.clear();
+        readyq.clear();
+        ok = true;
+    }
+
+    unit_t* new_unit(ff_node* n, const std::vector<unit_t*>& prev) {
+        unit_t *u = new unit_t(this, n);
+        for(auto p: prev) {
+            channel_t *c = new channel_t(p, u);
+            p->out.push_back(c);
+            u->in.push_back(c);
+        }
+        units.push_back(u);
+        nnodes = units.size();
+        return u;
+    }
+
+    // it returns the nodes producing the output of the building block n
+    std::vector<unit_t*> build(ff_node* n, const std::vector<unit_t*>& prev) {
+        std::vector<unit_t*> outs;
+        if (n->isPipe()) {
+            outs = prev;
+            const svector<ff_node*>& S = reinterpret_cast<ff_pipeline*>(n)->getStages();
+            for(size_t i=0;i<S.size() && ok;++i) outs = build(S[i], outs);
+            return outs;
+        }
+        if (n->isFarm()) {
+            ff_farm *farm = reinterpret_cast<ff_farm*>(n);
+            if (farm->isOFarm()) {
+                error("EXECUTOR, ordered farms are not supported\n");
+                ok = false;
+                return outs;
+            }
+            ff_node *e = farm->getEmitter();
+            if (!e) { e = new passthrough; defaults.push_back(e); }
+            const std::vector<unit_t*> E(1, new_unit(e, prev));
+            const svector<ff_node*>& W = farm->getWorkers();
+            for(size_t i=0;i<W.size() && ok;++i) {
+                if (!W[i]->isPipe() && !W[i]->isFarm()) W[i]->set_id(i);
+                const std::vector<unit_t*> o = build(W[i], E);
+                outs.insert(outs.end(), o.begin(), o.end());
+            }
+            if (farm->hasCollector()) {
+                ff_node *c = farm->getCollector();
+                if (!c) { c = new passthrough; defaults.push_back(c); }
+                return std::vector<unit_t*>(1, new_unit(c, outs));
+            }
+            return outs;
+        }
+        if (n->isAll2All() || n->isComp()) {
+            error("EXECUTOR, all-to-all and combined nodes are not supported\n");
+            ok = false;
+            return outs;
+        }
+        outs.push_back(new_unit(n, prev));
+        return outs;
+    }
+
+    inline void schedule(unit_t* u) {
+        if (u->scheduled.exchange(true)) return;
+        std::lock_guard<std::mutex> lck(mtx);
+        readyq.push_back(u);
+        cond.notify_one();
+    }
+
+    inline bool has_space(unit_t* u) const {
+        if (u->out.empty()) return true;
+        for(auto c: u->out)
+            if (c->size.load() < capacity || c->consumer->done.load()) return true;
+        return false;
+    }
+    inline bool runnable(unit_t* u) const {
+        if (u->done || !has_space(u)) return false;
+        if (u->in.empty()) return true;
+        for(auto c: u->in)
+            if (c->size.load() > 0) return true;
+        return false;
+    }
+
+    inline bool pop(unit_t* u, void** task, ssize_t& chid) {
+        const size_t n = u->in.size();
+        for(size_t i=0;i<n;++i) {
+            const size_t k = (u->nextin + i) % n;
+            channel_t *c = u->in[k];
+            if (c->q.pop(task)) {
+                u->nextin = k+1;
+                chid = k;
+                // the producer may be waiting for space
+                if (c->size.fetch_sub(1) >= capacity) schedule(c->producer);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // it returns false if the consumer has already terminated (the task is not sent)
+    inline bool push(channel_t* c, void* task) {
+        if (c->consumer->done.load()) return false;
+        while(!c->q.push(task)) ff_relax(1);
+        c->size.fetch_add(1);
+        schedule(c->consumer);
+        return true;
+    }
+
+    // it returns false if the task cannot be delivered because the consumers terminated
+    bool send(unit_t* u, void* task, int id) {
+        if (task == FF_EOS || task == FF_EOSW) return true;  // EOS is sent when the node terminates
+        const size_t n = u->out.size();
+        if (n == 0) return true;                             // last node, the output is discarded
+        if (id >= 0) return push(u->out[id % n], task);
+        if (n == 1)  return push(u->out[0], task);
+        for(size_t i=0;i<n;++i) {
+            const size_t k = (u->nextout + i) % n;
+            if (u->out[k]->size.load(std::memory_order_relaxed) < capacity &&
+                !u->out[k]->consumer->done.load()) {
+                u->nextout = k+1;
+                if (push(u->out[k], task)) return true;
+            }
+        }
+        for(size_t i=0;i<n;++i)
+            if (push(u->out[u->nextout++ % n], task)) return true;
+        return false;
+    }
+    // ff_send_out returns false if the task has not been delivered, the node
+    // is still the owner of the task
+    static bool send_cb(void *task, int id, unsigned long, unsigned long, void *arg) {
+        unit_t *u = reinterpret_cast<unit_t*>(arg);
+        return u->ex->send(u, task, id);
+    }
+
+    // svc_end is not called if svc_init failed
+    void terminate(unit_t* u, bool initialized=true) {
+        if (initialized) u->node->svc_end();
+        u->done = true;
+        for(auto c: u->out) push(c, FF_EOS);
+        // the producers may be waiting for space in the channels
+        for(auto c: u->in) schedule(c->producer);
+        if (++ndone == units.size()) {
+            std::lock_guard<std::mutex> lck(mtx);
+            finished = true;
+            cond.notify_all();
+        }
+    }
+
+    // it runs the node u for at most 'batch' input elements
+    void run(unit_t* u) {
+        if (!u->initialized) {
+            u->initialized = true;
+            if (u->node->svc_init()<0) {
+                error("EXECUTOR, svc_init failed\n");
+                ok = false;
+                terminate(u, false);
+                return;
+            }
+        }
+        for(size_t k=0; k<batch && !u->done; ++k) {
+            if (!has_space(u)) break;
+            void   *task = nullptr;
+            ssize_t chid = -1;
+            if (!u->in.empty()) {
+                if (!pop(u, &task, chid)) break;
+                if (task == FF_EOS || task == FF_EOSW) {
+                    u->node->eosnotify(u->in.size()>1 ? chid : -1);
+                    if (++u->neos == u->in.size()) terminate(u);
+                    continue;
+                }
+            }
+            void *r = u->node->svc(task);
+            if (r == FF_GO_ON || r == FF_GO_OUT || r == FF_EOS_NOFREEZE) continue;
+            if (!r || r == FF_EOS || r == FF_EOSW) {
+                terminate(u);
+                break;
+            }
+            // nobody owns the task, it can only be reported
+            if (!send(u, r, -1)) ndropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void worker_loop() {
+        for(;;) {
+            unit_t *u;
+            {
+                std::unique_lock<std::mutex> lck(mtx);
+                cond.wait(lck, [this] { return !readyq.empty() || finished; });
+                if (readyq.empty()) return;
+                u = readyq.front();
+                readyq.pop_front();
+            }
+            run(u);
+            nactivations.fetch_add(1, std::memory_order_relaxed);
+            u->scheduled.store(false);
+            if (runnable(u)) schedule(u);
+        }
+    }
+
+protected:
+    const size_t             nthreads;
+    const size_t             batch;
+    const long               capacity;
+    std::vector<unit_t*>     units;
+    std::vector<ff_node*>    defaults;
+    std::deque<unit_t*>      readyq;
+    std::mutex               mtx;
+    std::condition_variable  cond;
+    bool                     finished = false;
+    std::atomic<bool>        ok{true};
+    std::atomic<size_t>      ndone{0};
+    std::atomic<size_t>      nactivations{0};
+    std::atomic<size_t>      ndropped{0};
+    size_t                   nnodes = 0;
+};
+
+} // namespace ff
+
+#endif /* FF_EXECUTOR_HPP */
@@ -79,6 +79,143 @@ namespace ff {
 // forward decls
 class ff_farm;
 static inline int optimize_static(ff_farm&, const OptLevel&);
+
+/**
+ * \internal
+ * \brief Slot of a farm with live reconfiguration of the workers
+ * (see ff_farm::set_live_workers).
+ *
+ * It runs the current worker node (none for a spare slot) and counts the
+ * tasks executed. The node is replaced by the slot's own thread, before
+ * executing the next task or while waiting for input (idle_in), so that
+ * svc_init, svc, svc_end of the nodes are all called by that thread and
+ * never concurrently with the replacement. If the thread is not running
+ * (not started yet, frozen or terminated) the node is replaced directly by
+ * the caller, svc_init of the new node is called at the next start.
+ */
+class live_worker: public ff_node {
+    enum { NONE=0, REQUESTED=1, DONE=2, FAILED=3 };
+public:
+    live_worker(ff_node* node, bool cleanup): node(nullptr), cleanup(false) {
+        init_unlocked(lock);
+        install(node, cleanup);
+    }
+    ~live_worker() { if (node && cleanup) delete node; }
+
+    void *svc(void *task) {
+        apply_swap();
+        void *r = GO_ON;
+        if (node) r = node->svc(task);
+        else {
+            // the explicit sends to a slot without a worker are rejected by
+            // the load balancer, the task is forwarded instead of being lost
+            error("FARM, live worker %ld: task received by a spare slot, forwarded\n", (long)get_my_id());
+            r = task;
+        }
+        if (ff_loadbalancer::live_task(task))
+            done.store(done.load(std::memory_order_relaxed)+1, std::memory_order_release);
+        return r;
+    }
+    int svc_init() {
+        spin_lock(lock);
+        running = true;
+        spin_unlock(lock);
+        int r = node ? node->svc_init() : 0;
+        if (r<0) stopped();
+        return r;
+    }
+    void svc_end() {
+        if (node) node->svc_end();
+        stopped();
+    }
+    void eosnotify(ssize_t id) { if (node) node->eosnotify(id); }
+    void idle_in() {
+        apply_swap();
+        if (node) node->idle_in();
+    }
+
+    ff_node* get_node() const { return node; }
+    size_t   get_done() const { return done.load(std::memory_order_acquire); }
+
+    /*
+     * Installs the node n (nullptr for a spare slot), it returns the old one.
+     * If the slot is running, the replacement is done by the slot's thread
+     * (svc_init of the new node and svc_end of the old one included) and the
+     * caller waits for it.
+     */
+    ff_node* set_node(ff_node* n, bool c, int *err=nullptr) {
+        spin_lock(lock);
+        if (!running) {
+            ff_node *old = install(n, c);
+            spin_unlock(lock);
+            return old;
+        }
+        next_node = n; next_cleanup = c;
+        swap.store(REQUESTED, std::memory_order_release);
+        spin_unlock(lock);
+        int s;
+        while((s=swap.load(std::memory_order_acquire)) == REQUESTED) ff_relax(1);
+        swap.store(NONE, std::memory_order_relaxed);
+        if (s == FAILED) {
+            if (err) *err = -1;
+            return nullptr;
+        }
+        return old_node;
+    }
+
+protected:
+    void set_id(ssize_t id) {
+        ff_node::set_id(id);
+        if (node) node->set_id(id);
+    }
+    static bool send_out_cb(void *task, int id, unsigned long retry, unsigned long ticks, void *obj) {
+        return reinterpret_cast<live_worker*>(obj)->ff_send_out(task, id, retry, ticks);
+    }
+    ff_node* install(ff_node* n, bool c) {
+        if (n) {
+            n->set_id(get_my_id());
+            n->registerCallback(send_out_cb, this);
+        }
+        ff_node *old = node;
+        node = n; cleanup = c;
+        return old;
+    }
+    // called by the slot's thread while it is running
+    inline void apply_swap() {
+        if (swap.load(std::memory_order_acquire) != REQUESTED) return;
+        ff_node *n = next_node;
+        if (n) {
+            n->set_id(get_my_id());
+            n->registerCallback(send_out_cb, this);
+            if (n->svc_init()<0) {
+                swap.store(FAILED, std::memory_order_release);
+                return;
+            }
+        }
+        if (node) node->svc_end();
+        old_node = install(n, next_cleanup);
+        swap.store(DONE, std::memory_order_release);
+    }
+    // the thread stops, a pending replacement is done without calling svc_init
+    void stopped() {
+        spin_lock(lock);
+        running = false;
+        if (swap.load(std::memory_order_relaxed) == REQUESTED) {
+            old_node = install(next_node, next_cleanup);
+            swap.store(DONE, std::memory_order_release);
+        }
+        spin_unlock(lock);
+    }
+
+    ff_node            *node;
+    bool                cleanup;
+    bool                running = false;      // between svc_init and svc_end
+    lock_t              lock;                 // protects running and the requests
+    std::atomic<int>    swap{NONE};
+    ff_node            *next_node = nullptr, *old_node = nullptr;
+    bool                next_cleanup = false;
+    std::atomic<size_t> done{0};
+};
     
 
 /*!
@@ -265,6 +402,34 @@ protected:
             }        
         }
 
+        // live reconfiguration
+        if (live_spare>=0) {
+            if (nworkers + live_spare > max_nworkers) {
+                error("FARM: too many spare workers, please increase max_nworkers\n");
+                return -1;
+            }
+            for(size_t i=0;i<nworkers;++i) {
+                if (workers[i]->isFarm() || workers[i]->isPipe() || workers[i]->isMultiInput()
+                    || workers[i]->isMultiOutput() || workers[i]->isAll2All() || workers[i]->isComp()) {
+                    error("FARM: live reconfiguration is currently supported only for standard node!\n");
+                    return -1;
+                }
+                workers[i] = new live_worker(workers[i], worker_cleanup);
+                workers[i]->set_id(i);
+            }
+            for(ssize_t i=0;i<live_spare;++i) {
+                workers.push_back(new live_worker(nullptr, false));
+                workers.back()->set_id(nworkers+i);
+            }
+            worker_cleanup = true;
+            nworkers = workers.size();
+            lb->set_live(nworkers);
+            for(size_t i=workers.size()-live_spare;i<workers.size();++i) {
+                lb->pause_worker(i, true);
+                lb->close_worker(i, true);
+            }
+        }
+
         // accelerator
         if (has_input_channel) { 
             if (create_input_buffer(in_buffer_entries, fixedsize)<0) {
@@ -659,6 +824,18 @@ protected:
         return run(true);
     }
 
+    bool check_live(size_t i, const char *f) const {
+        if (live_spare<0 || !prepared) {
+            error("FARM, %s, live reconfiguration not enabled or farm not running\n", f);
+            return false;
+        }
+        if (i>=workers.size()) {
+            error("FARM, %s, wrong worker index %ld\n", f, (long)i);
+            return false;
+        }
+        return true;
+    }
+
     inline void skipfirstpop(bool sk)   { 
         lb->skipfirstpop(sk);
         skip1pop=sk;
@@ -804,6 +981,7 @@ public:
         collector_removed = f.collector_removed;
         ordered           = f.ordered;
         ordering_memsize  = f.ordering_memsize;
+        live_spare        = f.live_spare;
         ondemand = f.ondemand; in_buffer_entries = f.in_buffer_entries;
         out_buffer_entries = f.out_buffer_entries;
         worker_cleanup = f.worker_cleanup; 
@@ -846,6 +1024,7 @@ public:
         ordered           = f.ordered;
         ordering_memsize  = f.ordering_memsize;
         ordering_Memory   = std::move(f.ordering_Memory);
+        live_spare        = f.live_spare;
         ondemand = f.ondemand; in_buffer_entries = f.in_buffer_entries;
         out_buffer_entries = f.out_buffer_entries;
         worker_cleanup = f.worker_cleanup; 
@@ -1094,6 +1273,133 @@ public:
         return add_workers(w);
     }
 
+    /**
+     * \brief Enables the live reconfiguration of the workers.
+     *
+     * The workers can be quiesced, replaced and added while the farm is
+     * running, the other workers keep running. \p nspare slots are reserved
+     * for the workers added with \p add_worker: their channels and threads
+     * are created when the farm starts, they receive tasks only when a
+     * worker is installed.
+     *
+     * It must be called before running the farm, the workers must be
+     * standard (sequential) nodes and the farm cannot be ordered.
+     *
+     * \return 0 if successful, otherwise -1 is returned.
+     */
+    int set_live_workers(size_t nspare=0) {
+        if (prepared) {
+            error("FARM, set_live_workers, farm already prepared\n");
+            return -1;
+        }
+        if (ordered) {
+            error("FARM, set_live_workers, the farm is ordered\n");
+            return -1;
+        }
+        live_spare = nspare;
+        return 0;
+    }
+
+    /**
+     * \brief Quiesces the worker \p i.
+     *
+     * The emitter stops scheduling tasks to the worker (they go to the other
+     * workers), the call returns when the worker has executed all the tasks
+     * sent to it. The tasks explicitly sent to the worker (ff_send_out_to or
+     * broadcast) are still delivered: if the worker is being replaced, they
+     * are executed either by the old or by the new worker, never concurrently
+     * with the replacement. The explicit sends to a slot without a worker
+     * fail (broadcast skips it).
+     *
+     * \return 0 if successful, otherwise -1 is returned.
+     */
+    int quiesce_worker(size_t i) {
+        if (!check_live(i, "quiesce_worker")) return -1;
+        lb->pause_worker(i, true);
+        live_worker *s = reinterpret_cast<live_worker*>(workers[i]);
+        while(s->get_done() != lb->get_sent(i)) ff_relax(1);
+        return 0;
+    }
+
+    /**
+     * \brief The emitter schedules again tasks to the worker \p i.
+     *
+     * \return 0 if successful, otherwise -1 is returned.
+     */
+    int resume_worker(size_t i) {
+        if (!check_live(i, "resume_worker")) return -1;
+        if (!reinterpret_cast<live_worker*>(workers[i])->get_node()) {
+            error("FARM, resume_worker, slot %ld has no worker\n", (long)i);
+            return -1;
+        }
+        lb->pause_worker(i, false);
+        return 0;
+    }
+
+    /**
+     * \brief Replaces the worker \p i with \p w while the farm is running.
+     *
+     * The worker is quiesced, \p w is installed and the worker is resumed.
+     * If the farm is running, svc_end of the old worker and svc_init of the
+     * new one are called by the worker's thread, the caller waits for the
+     * replacement. If \p w is nullptr the slot becomes a spare one (i.e. the
+     * worker is removed). The ownership of the old
+     * worker passes to the caller, the new one is deleted by the farm
+     * if \p cleanup is true.
+     *
+     * \return the old worker (nullptr if the slot was spare or in case of error).
+     */
+    ff_node* replace_worker(size_t i, ff_node* w, bool cleanup=false) {
+        // a slot becoming spare rejects the explicit sends from now on
+        if (!w && check_live(i, "replace_worker")) lb->close_worker(i, true);
+        if (quiesce_worker(i)<0) return nullptr;
+        live_worker *s = reinterpret_cast<live_worker*>(workers[i]);
+        int err = 0;
+        ff_node *old = s->set_node(w, cleanup, &err);
+        if (err<0) {
+            error("FARM, replace_worker, svc_init of the new worker failed\n");
+            lb->pause_worker(i, s->get_node() == nullptr);
+            return nullptr;
+        }
+        if (w) {
+            lb->close_worker(i, false);
+            lb->pause_worker(i, false);
+        }
+        return old;
+    }
+
+    /**
+     * \brief Adds the worker \p w to the running farm, using a spare slot
+     * (see \p set_live_workers).
+     *
+     * \return the index of the worker, -1 if there are no spare slots.
+     */
+    ssize_t add_worker(ff_node* w, bool cleanup=false) {
+        if (!w) return -1;
+        for(size_t i=0;i<workers.size();++i) {
+            if (!check_live(i, "add_worker")) return -1;
+            live_worker *s = reinterpret_cast<live_worker*>(workers[i]);
+            if (s->get_node()) continue;
+            int err = 0;
+            s->set_node(w, cleanup, &err);
+            if (err<0) {
+                error("FARM, add_worker, svc_init of the new worker failed\n");
+                return -1;
+            }
+            lb->close_worker(i, false);
+            lb->pause_worker(i, false);
+            return i;
+        }
+        error("FARM, add_worker, no spare slots available\n");
+        return -1;
+    }
+
+    /// worker currently running in the slot \p i of a farm with live reconfiguration
+    ff_node* get_live_worker(size_t i) const {
+        if (live_spare<0 || !prepared || i>=workers.size()) return nullptr;
+        return reinterpret_cast<live_worker*>(workers[i])->get_node();
+    }
+
     
     /**
      *  \brief Adds the collector
@@ -1319,6 +1625,7 @@ public:
                 workers[i]->blocking_mode(blocking_in);
                 if (!default_mapping) workers[i]->no_mapping();
                 workers[i]->skipfirstpop(false);
+                workers[i]->set_epoch(lb->get_epoch());
                  if (workers[i]->freeze_and_run(true)<0) {
                     error("FARM, spawning worker thread\n");
                     return -1;
@@ -1332,6 +1639,7 @@ public:
                 workers[i]->blocking_mode(blocking_in);
                 if (!default_mapping) workers[i]->no_mapping();
                 workers[i]->skipfirstpop(false);
+                workers[i]->set_epoch(lb->get_epoch());
                  if (workers[i]->run(true)<0) {
                     error("FARM, spawning worker thread\n");
                     return -1;
@@ -1339,6 +1647,7 @@ public:
             }
         }
         // starting the collector node
+        gt->set_epoch(lb->get_epoch());
         if (!collector_removed)
             if (collector && gt->run(true)<0) {
                 error("FARM, running gather module\n");
@@ -1568,6 +1877,98 @@ public:
         }
         return gt->pop_nb(task);
     }
+
+    /**
+     * \brief Offloads a batch of tasks to the farm (accelerator mode)
+     *
+     * The tasks are pushed into the input queue with one call and (in
+     * blocking mode) with a single wake-up of the Emitter.
+     *
+     * \param tasks array of \p n tasks
+     * \param retry number of attempts to push a task when the queue is full
+     * (non-blocking mode only)
+     *
+     * \return the number of tasks offloaded, it is less than \p n only if
+     * the input queue has been full for \p retry attempts
+     */
+    inline size_t offload_n(void * const tasks[], size_t n,
+                            unsigned long retry=((unsigned long)-1),
+                            unsigned long ticks=ff_loadbalancer::TICKS2WAIT) {
+        FFBUFFER * inbuffer = get_in_buffer();
+        if (!inbuffer) {
+            if (!has_input_channel)
+                error("FARM: accelerator is not set, offload not available");
+            else
+                error("FARM: input buffer creation failed");
+            return 0;
+        }
+        size_t i=0;
+        if (blocking_out) {
+            while(true) {
+                const bool empty=inbuffer->empty();
+                while(i<n && inbuffer->push(tasks[i])) ++i;
+                if (empty) pthread_cond_signal(p_cons_c);
+                if (i==n) return n;
+                struct timespec tv;
+                timedwait_timeout(tv);
+                pthread_mutex_lock(prod_m);
+                pthread_cond_timedwait(prod_c, prod_m, &tv);
+                pthread_mutex_unlock(prod_m);
+            }
+        }
+        for(unsigned long r=0;i<n;) {
+            if (inbuffer->push(tasks[i])) { ++i; r=0; continue; }
+            if (++r >= retry) break;
+            losetime_out(ticks);
+        }
+        return i;
+    }
+
+    /**
+     * \brief Loads a batch of results from the farm (accelerator mode)
+     *
+     * It waits at most \p timeout_us microseconds for the first result, then
+     * it takes (without waiting) the results available, up to \p max.
+     * If the EOS is received, it is the last element stored in \p out.
+     *
+     * \return the number of elements stored in \p out (0 if the timeout expired)
+     */
+    inline size_t load_results(void ** out, size_t max, unsigned long timeout_us=0) {
+        if (!collector) {
+            error("FARM: load_results: no collector present!!");
+            return 0;
+        }
+        const unsigned long start = timeout_us ? getusec() : 0;
+        size_t n=0;
+        while(true) {
+            while(n<max && gt->pop_nb(&out[n]))
+                if (out[n++] == (void*)FF_EOS) return n;
+            if (n || !timeout_us || (getusec()-start) >= timeout_us) return n;
+            if (blocking_in) {
+                struct timespec tv;
+                timedwait_timeout(tv);
+                pthread_mutex_lock(cons_m);
+                pthread_cond_timedwait(cons_c, cons_m,&tv);
+                pthread_mutex_unlock(cons_m);
+            } else losetime_in(ff_gatherer::TICKS2WAIT);
+        }
+    }
+
+    /**
+     * \brief The results of the accelerator are passed to \p cb instead of
+     * being loaded with load_result(s)
+     *
+     * \p cb is called by the Collector thread, one result at a time (the EOS
+     * is not passed). It must be called before running the farm, the farm
+     * cannot have a user-defined Collector.
+     */
+    int set_completion_callback(const std::function<void(void*)>& cb) {
+        if (prepared) {
+            error("FARM, set_completion_callback, farm already prepared\n");
+            return -1;
+        }
+        return add_collector(new ff_completion_node(cb), true);
+    }
     
     /**
      * \internal
@@ -1839,8 +2240,11 @@ protected:
      * If the thread is frozen, then thaw it. 
      */
     inline void thaw(bool _freeze=false, ssize_t nw=-1) {
+        // all the threads of the farm are woken up by a single advance of the epoch
+        lb->get_epoch()->hold();
         lb->thaw(_freeze, nw);
         if (collector && !collector_removed) gt->thaw(_freeze, nw);
+        lb->get_epoch()->release();
     }
 
     /**
@@ -2035,6 +2439,7 @@ protected:
     int out_buffer_entries;
     size_t max_nworkers;
     size_t ordering_memsize;
+    ssize_t live_spare = -1;  // >=0 if the live reconfiguration of the workers is enabled
     
     ff_node          *  emitter;
     ff_node          *  collector;
@@ -0,0 +1,316 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \link
+ * \file join.hpp
+ * \ingroup building_blocks
+ *
+ * \brief Parallel keyed windowed join of two streams
+ *
+ * @detail Symmetric hash join built on an all-to-all: the elements of the two
+ * input streams are partitioned by key among the join workers, each worker
+ * keeps one hash table per input containing the elements of the last time
+ * window. Inner and left-outer joins are supported.
+ *
+ */
+
+#ifndef FF_JOIN_HPP
+#define FF_JOIN_HPP
+
+/* ***************************************************************************
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <ff/node.hpp>
+#include <ff/multinode.hpp>
+#include <ff/all2all.hpp>
+#include <ff/combine.hpp>
+
+namespace ff {
+
+// max n. of elements of each input kept by a join worker
+#if !defined(DEF_JOIN_CAPACITY)
+#define DEF_JOIN_CAPACITY  (1<<16)
+#endif
+
+enum ff_join_type { FF_INNER_JOIN, FF_LEFT_OUTER_JOIN };
+
+/*!
+ * \brief Counters of the join workers.
+ */
+struct ff_join_stats {
+    size_t matches     = 0;  ///< n. of joined pairs
+    size_t outer       = 0;  ///< n. of left elements produced without a match (left-outer join)
+    size_t expired     = 0;  ///< n. of elements removed because out of the window
+    size_t evicted     = 0;  ///< n. of elements removed because the table was full
+    size_t max_entries = 0;  ///< max n. of elements kept by a worker (both inputs)
+};
+
+/**
+ * \internal
+ * \brief Elements of one input kept by a join worker.
+ *
+ * The elements arrive in timestamp order, the table of each key keeps them
+ * in arrival order, the FIFO of the keys gives the oldest element overall.
+ */
+template<typename T, typename K>
+struct join_table {
+    struct entry_t {
+        T       *t;
+        uint64_t ts;
+        bool     matched;
+    };
+
+    void insert(const K& k, T* t, uint64_t ts, bool matched=false) {
+        table[k].push_back(entry_t{t, ts, matched});
+        order.push_back(k);
+    }
+    bool empty() const { return order.empty(); }
+    size_t size() const { return order.size(); }
+    const entry_t& oldest() { return table[order.front()].front(); }
+    void pop_oldest() {
+        auto it = table.find(order.front());
+        it->second.pop_front();
+        if (it->second.empty()) table.erase(it);
+        order.pop_front();
+    }
+    std::deque<entry_t>* find(const K& k) {
+        auto it = table.find(k);
+        return (it == table.end()) ? nullptr : &it->second;
+    }
+
+    std::unordered_map<K, std::deque<entry_t> > table;
+    std::deque<K>                                order;
+};
+
+/**
+ * \internal
+ * \brief First set node of the join, it routes the elements of one input by key.
+ */
+template<typename T, typename K>
+struct join_router: ff_monode_t<T> {
+    join_router(const std::function<K(const T&)>& key): key(key) {}
+    T* svc(T* t) {
+        this->ff_send_out_to(t, (int)(std::hash<K>()(key(*t)) % this->get_num_outchannels()));
+        return this->GO_ON;
+    }
+    const std::function<K(const T&)> key;
+};
+
+/*!
+ *  \class ff_join_worker
+ *  \ingroup building_blocks
+ *
+ *  \brief Second set node of the join, it joins the elements of its keys.
+ *
+ *  The elements of the left input (channel 0) and of the right input
+ *  (channel 1) match if they have the same key and their timestamps differ at
+ *  most by \p window. An element is kept until it cannot match the elements
+ *  of the other input any more (the timestamps of each input must be
+ *  non-decreasing), or until the table is full (\p capacity elements per
+ *  input): in this case the oldest element is evicted.
+ *
+ *  This class is defined in \ref join.hpp
+ */
+template<typename L, typename R, typename K, typename OUT>
+class ff_join_worker: public ff_minode {
+public:
+    typedef std::function<OUT*(const L*, const R*)> join_t;
+
+    ff_join_worker(uint64_t window, const std::function<K(const L&)>& key_l, const std::function<K(const R&)>& key_r,
+                   const std::function<uint64_t(const L&)>& ts_l, const std::function<uint64_t(const R&)>& ts_r,
+                   const join_t& join, ff_join_type type, size_t capacity, bool cleanup):
+        window(window), key_l(key_l), key_r(key_r), ts_l(ts_l), ts_r(ts_r), join(join),
+        type(type), capacity(capacity?capacity:1), cleanup(cleanup) {}
+
+    void* svc(void* in) {
+        if (get_channel_id() == 0) left(reinterpret_cast<L*>(in));
+        else                             right(reinterpret_cast<R*>(in));
+        const size_t n = TL.size() + TR.size();
+        if (n > stats.max_entries) stats.max_entries = n;
+        return GO_ON;
+    }
+
+    void eosnotify(ssize_t id) {
+        // no more elements from one input, the elements of the other one
+        // cannot match anything else
+        if (id == 0) {
+            wm_l = UINT64_MAX;
+            while(!TR.empty()) remove_right(stats.expired);
+        } else {
+            wm_r = UINT64_MAX;
+            while(!TL.empty()) remove_left(stats.expired);
+        }
+    }
+
+    const ff_join_stats& get_stats() const { return stats; }
+
+protected:
+    void emit(const L* l, const R* r) {
+        OUT *out = join(l, r);
+        if (out) ff_send_out(out);
+    }
+    void remove_left(size_t& counter) {
+        const auto& e = TL.oldest();
+        if (!e.matched && type == FF_LEFT_OUTER_JOIN) {
+            emit(e.t, nullptr);
+            ++stats.outer;
+        }
+        if (cleanup) delete e.t;
+        TL.pop_oldest();
+        ++counter;
+    }
+    void remove_right(size_t& counter) {
+        if (cleanup) delete TR.oldest().t;
+        TR.pop_oldest();
+        ++counter;
+    }
+    bool in_window(uint64_t a, uint64_t b) const {
+        return (a > b ? a - b : b - a) <= window;
+    }
+
+    void left(L* l) {
+        const uint64_t ts = ts_l(*l);
+        if (ts > wm_l) wm_l = ts;
+        // the right elements older than the window cannot match anymore
+        while(!TR.empty() && TR.oldest().ts + window < wm_l) remove_right(stats.expired);
+
+        const K k = key_l(*l);
+        bool matched = false;
+        if (auto q = TR.find(k))
+            for(auto& e: *q)
+                if (in_window(ts, e.ts)) {
+                    emit(l, e.t);
+                    ++stats.matches;
+                    matched = true;
+                }
+        if (wm_r == UINT64_MAX) {
+            // the right input is terminated
+            if (!matched && type == FF_LEFT_OUTER_JOIN) {
+                emit(l, nullptr);
+                ++stats.outer;
+            }
+            if (cleanup) delete l;
+            return;
+        }
+        if (TL.size() == capacity) remove_left(stats.evicted);
+        TL.insert(k, l, ts, matched);
+    }
+
+    void right(R* r) {
+        const uint64_t ts = ts_r(*r);
+        if (ts > wm_r) wm_r = ts;
+        while(!TL.empty() && TL.oldest().ts + window < wm_r) remove_left(stats.expired);
+
+        const K k = key_r(*r);
+        if (auto q = TL.find(k))
+            for(auto& e: *q)
+                if (in_window(ts, e.ts)) {
+                    emit(e.t, r);
+                    ++stats.matches;
+                    e.matched = true;
+                }
+        if (wm_l == UINT64_MAX) {
+            if (cleanup) delete r;
+            return;
+        }
+        if (TR.size() == capacity) remove_right(stats.evicted);
+        TR.insert(k, r, ts);
+    }
+
+protected:
+    const uint64_t                        window;
+    const std::function<K(const L&)>      key_l;
+    const std::function<K(const R&)>      key_r;
+    const std::function<uint64_t(const L&)> ts_l;
+    const std::function<uint64_t(const R&)> ts_r;
+    const join_t                          join;
+    const ff_join_type                    type;
+    const size_t                          capacity;
+    const bool                            cleanup;
+    uint64_t                              wm_l = 0, wm_r = 0;  // latest timestamps received
+    join_table<L,K>                       TL;
+    join_table<R,K>                       TR;
+    ff_join_stats                         stats;
+};
+
+/*!
+ *  \class ff_join
+ *  \ingroup building_blocks
+ *
+ *  \brief Parallel windowed join of the streams produced by \p left and \p right.
+ *
+ *  \p left and \p right are sequential nodes producing the two input streams
+ *  (L* and R* elements). Their outputs are partitioned by key among
+ *  \p nworkers ff_join_worker(s). For each pair of elements having the same
+ *  key and timestamps not farther than \p window the function \p join is
+ *  called, its result (if not nullptr) is sent out. With a left-outer join,
+ *  \p join is also called with a null right element for the left elements
+ *  that have not matched any right element.
+ *
+ *  Each worker keeps at most \p capacity elements of each input. If
+ *  \p cleanup is true the input elements are deleted by the workers.
+ *  The order of the results is not specified.
+ *
+ *  This class is defined in \ref join.hpp
+ */
+template<typename L, typename R, typename K, typename OUT>
+class ff_join: public ff_a2a {
+public:
+    typedef ff_join_worker<L,R,K,OUT> worker_t;
+
+    ff_join(ff_node* left, ff_node* right, size_t nworkers, uint64_t window,
+            const std::function<K(const L&)>& key_l, const std::function<K(const R&)>& key_r,
+            const std::function<uint64_t(const L&)>& ts_l, const std::function<uint64_t(const R&)>& ts_r,
+            const typename worker_t::join_t& join, ff_join_type type=FF_INNER_JOIN,
+            size_t capacity=DEF_JOIN_CAPACITY, bool cleanup=true) {
+        if (nworkers == 0) nworkers = 1;
+        std::vector<ff_node*> F;
+        F.push_back(new ff_comb(left,  new join_router<L,K>(key_l), false, true));
+        F.push_back(new ff_comb(right, new join_router<R,K>(key_r), false, true));
+        for(size_t i=0;i<nworkers;++i)
+            W.push_back(new worker_t(window, key_l, key_r, ts_l, ts_r, join, type, capacity, cleanup));
+        add_firstset(F, 0, true);
+        add_secondset(W, true);
+    }
+
+    /// counters of all the workers (max_entries is the maximum among the workers)
+    ff_join_stats get_stats() const {
+        ff_join_stats s;
+        for(auto w: W) {
+            const ff_join_stats& x = w->get_stats();
+            s.matches += x.matches;
+            s.outer   += x.outer;
+            s.expired += x.expired;
+            s.evicted += x.evicted;
+            if (x.max_entries > s.max_entries) s.max_entries = x.max_entries;
+        }
+        return s;
+    }
+
+protected:
+    std::vector<worker_t*> W;
+};
+
+} // namespace ff
+
+#endif /* FF_JOIN_HPP */
@@ -35,6 +35,8 @@
 
 #include <iosfwd>
 #include <deque>
+#include <vector>
+#include <atomic>
 
 #include <ff/utils.hpp>
 #include <ff/node.hpp>
@@ -239,6 +241,10 @@ protected:
                 do {
                     nextw = selectworker();
                     assert(nextw>=0);                    
+                    if (live && !live_acquire(nextw)) {
+                        if (++cnt == nattempts()) break;
+                        continue;
+                    }
 #if defined(LB_CALLBACK)
                     task = callback(nextw, task);
 #endif
@@ -248,6 +254,7 @@ protected:
                         if (empty) put_done(nextw);
                         return true;
                     } 
+                    if (live) sent[nextw].fetch_sub(1);
                     ++cnt;
                     if (cnt == nattempts()) break; 
                 } while(1);
@@ -265,6 +272,11 @@ protected:
             do {
                 nextw = selectworker();
                 if (nextw<0) return false;
+                if (live && !live_acquire(nextw)) {
+                    if (++cnt>=retry) { nextw=-1; return false; }
+                    if (cnt == nattempts()) break;
+                    continue;
+                }
 #if defined(LB_CALLBACK)
                 task = callback(nextw, task);
 #endif
@@ -272,6 +284,7 @@ protected:
                     FFTRACE(++taskcnt);
                     return true;
                 }
+                if (live) sent[nextw].fetch_sub(1);
                 ++cnt;
                 if (cnt>=retry) { nextw=-1; return false; }
                 if (cnt == nattempts()) break; 
@@ -346,6 +359,7 @@ protected:
                 pthread_cond_timedwait(cons_c, cons_m, &tv);
                 pthread_mutex_unlock(cons_m);
             } else losetime_in();
+            if (filter) filter->idle_in();
         } while(1);
         return ite;
     }
@@ -378,6 +392,7 @@ protected:
                         pthread_mutex_lock(cons_m);
                         pthread_cond_timedwait(cons_c, cons_m, &tv);
                         pthread_mutex_unlock(cons_m);
+                        filter->idle_in();
                     } //while 
                 } else {
                     // NOTE:
@@ -395,7 +410,7 @@ protected:
         if (!filter) 
             while (! buffer->pop(task)) losetime_in();
         else 
-            while (! filter->pop(task)) losetime_in();
+            while (! filter->pop(task)) { losetime_in(); filter->idle_in(); }
         return true;
     }
     
@@ -480,6 +495,8 @@ public:
         wttime=0;
 
         blocking_in = blocking_out = FF_RUNTIME_MODE;
+        // the emitter and the workers are thawed together
+        set_epoch(&epoch);
 
         FFTRACE(taskcnt=0;lostpushticks=0;pushwait=0;lostpopticks=0;popwait=0;ticksmin=(ticks)-1;ticksmax=0;tickstot=0);
     }
@@ -707,6 +724,10 @@ public:
     virtual inline bool ff_send_out_to(void *task, int id,  
                                unsigned long retry=((unsigned long)-1),
                                unsigned long ticks=(TICKS2WAIT)) {        
+        // the tasks explicitly sent are delivered also to paused workers,
+        // they are rejected by the slots without a worker
+        const bool counted = live && live_task(task);
+        if (counted && !live_accept(id)) return false;
         if (blocking_out) {
         _retry:
             bool empty=workers[id]->get_in_buffer()->empty();
@@ -736,6 +757,7 @@ public:
             }
             losetime_out(ticks);
         }    
+        if (counted) sent[id].fetch_sub(1);
         return false;
     }
 
@@ -743,11 +765,15 @@ public:
      * \brief Send the same task to all workers 
      *
      * It sends the same task to all workers.   
+     * With the live reconfiguration of the workers, the slots without a worker
+     * are skipped (the tags are sent to all of them).
      */
     virtual inline void broadcast_task(void * task) {
        std::vector<size_t> retry;
+       const bool counted = live && live_task(task);
        if (blocking_out) {
            for(ssize_t i=0;i<running;++i) {
+               if (counted && !live_accept(i)) continue;
                bool empty=workers[i]->get_in_buffer()->empty();
                if(!workers[i]->put(task))
                    retry.push_back(i);
@@ -772,6 +798,7 @@ public:
            return;
        }
        for(ssize_t i=0;i<running;++i) {
+           if (counted && !live_accept(i)) continue;
            if(!workers[i]->put(task))
                retry.push_back(i);
        }
@@ -835,6 +862,40 @@ public:
     }
         
     
+    /*
+     * Live reconfiguration of the workers (see ff_farm::set_live_workers).
+     * The tasks sent to each worker are counted, the scheduling skips the
+     * paused workers and the explicit sends are rejected by the closed ones
+     * (slots without a worker). A task is counted before checking the flags,
+     * so once a flag has been set the counter can only be decreased.
+     */
+    void set_live(size_t nworkers) {
+        std::vector<std::atomic<bool> >(nworkers).swap(paused);
+        std::vector<std::atomic<bool> >(nworkers).swap(closed);
+        std::vector<std::atomic<size_t> >(nworkers).swap(sent);
+        for(size_t i=0;i<nworkers;++i) {
+            paused[i].store(false); closed[i].store(false); sent[i].store(0);
+        }
+        live = true;
+    }
+    inline bool live_acquire(size_t w) {
+        sent[w].fetch_add(1);
+        if (!paused[w].load()) return true;
+        sent[w].fetch_sub(1);
+        return false;
+    }
+    inline bool live_accept(size_t w) {
+        sent[w].fetch_add(1);
+        if (!closed[w].load()) return true;
+        sent[w].fetch_sub(1);
+        return false;
+    }
+    static inline bool live_task(void *task) { return task && task < FF_TAG_MIN; }
+    void   pause_worker(size_t w, bool p) { paused[w].store(p); }
+    void   close_worker(size_t w, bool c) { closed[w].store(c); }
+    bool   is_paused(size_t w) const      { return paused[w].load(); }
+    size_t get_sent(size_t w) const       { return sent[w].load(); }
+
     /**
      * \brief Gets the masterworker flags
      */
@@ -1161,6 +1222,7 @@ public:
                 workers[i]->blocking_mode(blocking_in);
                 if (!default_mapping) workers[i]->no_mapping();
                 workers[i]->skipfirstpop(false);
+                workers[i]->set_epoch(&epoch);
                 if (workers[i]->freeze_and_run(true)<0) {
                     error("LB, spawning worker thread\n");
                     return -1;
@@ -1174,6 +1236,7 @@ public:
                 workers[i]->blocking_mode(blocking_in);
                 if (!default_mapping) workers[i]->no_mapping();
                 workers[i]->skipfirstpop(false);
+                workers[i]->set_epoch(&epoch);
                 if (workers[i]->run(true)<0) {
                     error("LB, spawning worker thread\n");
                     return -1;
@@ -1185,8 +1248,10 @@ public:
     virtual int thawWorkers(bool _freeze=false, ssize_t nw=-1) {
         if (nw == -1 || (size_t)nw > workers.size()) running = workers.size();
         else running = nw;
+        epoch.hold();   // one wake-up for all the workers
         for(ssize_t i=0;i<running;++i)
             workers[i]->thaw(_freeze);
+        epoch.release();
         return 0;
     }
     inline int wait_freezingWorkers() {
@@ -1361,8 +1426,10 @@ public:
     virtual inline void thaw(bool _freeze=false, ssize_t nw=-1) {
         if (nw == -1 || (size_t)nw > workers.size()) running = workers.size();
         else running = nw;
+        epoch.hold();   // one wake-up for the emitter and all the workers
         ff_thread::thaw(_freeze); // NOTE:start scheduler first
         for(ssize_t i=0;i<running;++i) workers[i]->thaw(_freeze);
+        epoch.release();
     }
 
     /**
@@ -1430,6 +1497,7 @@ public:
 #endif
 
 private:
+    ff_epoch           epoch;               /// Epoch of the emitter and of the workers
     ssize_t            running;             /// Number of workers running
     size_t             max_nworkers;        /// Max number of workers allowed
     ssize_t            nextw;               /// out index
@@ -1449,6 +1517,10 @@ private:
     svector<ff_node*>  inputNodesFeedback;  /// nodes coming node feedback channels
     size_t             multi_input_start;   /// position in the availworkers array
     ssize_t            managerpos=-1;       /// position in the availworkers array of the manager
+    bool               live = false;        /// live reconfiguration of the workers enabled
+    std::vector<std::atomic<bool> >   paused;  /// workers not selected by the scheduling
+    std::vector<std::atomic<bool> >   closed;  /// slots without a worker, explicit sends rejected
+    std::vector<std::atomic<size_t> > sent;    /// n. of tasks sent to each worker
 
     struct timeval tstart;
     struct timeval tstop;
@@ -42,6 +42,8 @@
 
 #include <climits>
 #include <set>
+#include <vector>
+#include <string>
 #include <algorithm>
 #include <iosfwd>
 #include <errno.h>
@@ -345,6 +347,76 @@ static inline ssize_t ff_numSockets() {
 }
 
 
+/**
+ *  \brief Parses a Linux cpu list string (e.g. "0-3,8,10-11") 
+ *
+ *  \return the number of ids appended to \p ids
+ */
+static inline size_t ff_parseCpuList(const char *str, std::vector<int>& ids) {
+    size_t n=0;
+    char *end;
+    while(*str) {
+        while(*str==',' || *str==' ' || *str=='\n') ++str;
+        if (!*str) break;
+        long first = strtol(str, &end, 10);
+        if (end == str) break;
+        long last = first;
+        str = end;
+        if (*str == '-') {
+            last = strtol(str+1, &end, 10);
+            if (end == str+1) break;
+            str = end;
+        }
+        for(long i=first;i<=last;++i,++n) ids.push_back((int)i);
+    }
+    return n;
+}
+
+/**
+ *  \brief Returns the NUMA topology of the system.
+ *
+ *  It fills \p nodes with the list of core ids of each NUMA node (the
+ *  position in \p nodes is the NUMA node id). It works on Linux OS, on other
+ *  systems, or if the information is not available, a single node containing
+ *  all cores is returned.
+ *
+ *  \return The number of NUMA nodes.
+ */
+static inline ssize_t ff_numaTopology(std::vector<std::vector<int> >& nodes) {
+    nodes.clear();
+#if defined(__linux__)
+    char buf[4096];
+    std::vector<int> online;
+    FILE *f = fopen("/sys/devices/system/node/online", "r");
+    if (f) {
+        if (fgets(buf, sizeof(buf), f)) ff_parseCpuList(buf, online);
+        fclose(f);
+    }
+    for(size_t i=0;i<online.size();++i) {
+        const std::string str="/sys/devices/system/node/node"+std::to_string(online[i])+"/cpulist";
+        if ((f = fopen(str.c_str(), "r")) == NULL) continue;
+        if ((size_t)online[i] >= nodes.size()) nodes.resize(online[i]+1);
+        if (fgets(buf, sizeof(buf), f)) ff_parseCpuList(buf, nodes[online[i]]);
+        fclose(f);
+    }
+#endif
+    if (nodes.size()==0) {
+        ssize_t nc = ff_numCores();
+        nodes.resize(1);
+        for(ssize_t i=0;i<(nc>0?nc:1);++i) nodes[0].push_back((int)i);
+    }
+    return nodes.size();
+}
+
+/**
+ *  \brief Returns the NUMA node of the given core, 0 if it is not known.
+ */
+static inline ssize_t ff_getNumaNode(int cpu_id, const std::vector<std::vector<int> >& nodes) {
+    for(size_t i=0;i<nodes.size();++i)
+        if (std::find(nodes[i].begin(), nodes[i].end(), cpu_id) != nodes[i].end()) return i;
+    return 0;
+}
+
 /**
  * \brief Sets the scheduling priority
  *
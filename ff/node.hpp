@@ -64,6 +64,7 @@ static void* FF_TAG_MIN       = (void*)(ULLONG_MAX-10);  /// just a lower bound
 //
     
 /* optimization levels used in the optimize_static call (see optimize.hpp) */    
+class ff_opt_profile;
 struct OptLevel {
     ssize_t  max_nb_threads{MAX_NUM_THREADS};
     ssize_t  max_mapped_threads{MAX_NUM_THREADS};
@@ -75,6 +76,9 @@ struct OptLevel {
     bool     remove_collector{false};
     bool     merge_farms{false};
     bool     introduce_a2a{false};
+    bool     fuse_stages{false};         // profile-guided fusion of pipeline stages
+    double   fusion_threshold{2000};     // svc ticks per message below which a stage is "cheap"
+    const ff_opt_profile* profile{nullptr};
 };
 struct OptLevel1: OptLevel {
     OptLevel1() {
@@ -94,6 +98,16 @@ struct OptLevel2: OptLevel {
         merge_farms= true;
     }
 };
+/* OptLevel2 plus the fusion of sequential pipeline stages (see fuse_pipeline_stages).
+ * The profile p comes from a previous run, without it stages are fused only
+ * to keep the number of threads within max_nb_threads. */
+struct OptLevel3: OptLevel2 {
+    OptLevel3(const ff_opt_profile* p=nullptr) {
+        max_nb_threads=ff_numCores();   // TODO: use the mapper
+        fuse_stages=true;
+        profile=p;
+    }
+};
 /* ----------------------------------------------------------------------- */
 
 // This is just a counter, and is used to set the ff_node::tid value.
@@ -175,6 +189,22 @@ static inline int init_thread_affinity(pthread_attr_t*,int) {
  */
 static void * proxy_thread_routine(void * arg);
 
+/*
+ * \brief N. of FastFlow threads currently running, i.e. started and not
+ * frozen (used to bound the n. of threads of the nested parallel loops)
+ */
+inline std::atomic<long>& ff_running_threads() {
+    static std::atomic<long> n{0};
+    return n;
+}
+/*
+ * \brief It returns true if the calling thread is a FastFlow thread
+ */
+inline bool& ff_in_thread() {
+    static thread_local bool in = false;
+    return in;
+}
+
 /*!
  *  \class ff_thread
  *  \ingroup buiding_blocks
@@ -194,32 +224,20 @@ protected:
     ff_thread(BARRIER_T * barrier=NULL, bool default_mapping=true):
         tid((size_t)-1),threadid(0), default_mapping(default_mapping),
         barrier(barrier), stp(true), // only one shot by default
-        spawned(false), freezing(0), frozen(false),isdone(false),
-        init_error(false), attr(NULL) {
+        spawned(false), state(0), isdone(false),
+        init_error(false), attr(NULL), epoch(&own_epoch) {
         (void)FF_TAG_MIN; // to avoid warnings
-        
-        /* Attr is NULL, default mutex attributes are used. Upon successful
-         * initialization, the state of the mutex becomes initialized and
-         * unlocked. 
-         * */
-        if (pthread_mutex_init(&mutex,NULL)!=0) {
-            error("FATAL ERROR: ff_thread: pthread_mutex_init fails!\n");
-            abort();
-        }
-        if (pthread_cond_init(&cond,NULL)!=0) {
-            error("FATAL ERROR: ff_thread: pthread_cond_init fails!\n");
-            abort();
-        }
-        if (pthread_cond_init(&cond_frozen,NULL)!=0) {
-            error("FATAL ERROR: ff_thread: pthread_cond_init fails!\n");
-            abort();
-        }
     }
 
     virtual ~ff_thread() {}
     
     void thread_routine() {
         threadid = ff_getThreadID();
+        ff_in_thread() = true;
+        struct running_t {
+            running_t()  { ff_running_threads().fetch_add(1, std::memory_order_relaxed); }
+            ~running_t() { ff_running_threads().fetch_sub(1, std::memory_order_relaxed); }
+        } running;
 #if defined(FF_INITIAL_BARRIER)
         if (barrier) {
             barrier->doBarrier(tid);
@@ -246,23 +264,28 @@ protected:
                 return;
             }
 
-            // acquire lock. While freezing is true,
-            // freeze and wait. 
-            pthread_mutex_lock(&mutex);
+            // While freezing is 1, freeze and wait for the next epoch.
             if (ret != FF_EOS_NOFREEZE && !stp) {
-                if ((freezing == 0) && (ret == FF_EOS)) stp = true;
-                while(freezing==1) { // NOTE: freezing can change to 2
-                    frozen=true; 
-                    pthread_cond_signal(&cond_frozen);
-                    pthread_cond_wait(&cond,&mutex);
+                if ((freezing() == 0) && (ret == FF_EOS)) stp = true;
+                // the generation is read before publishing the frozen state,
+                // so a thaw cannot be missed
+                int g = epoch->get();
+                int s = 1;
+                if (state.compare_exchange_strong(s, 1|FROZEN)) {
+                    ff_running_threads().fetch_sub(1, std::memory_order_relaxed);
+                    ff_word_wake(&state);  // see wait_freezing
+                    // NOTE: thaw changes the state to 0 or 2
+                    while(state.load() == (1|FROZEN)) {
+                        epoch->wait(g);
+                        g = epoch->get();
+                    }
+                    ff_running_threads().fetch_add(1, std::memory_order_relaxed);
                 }
             }
             
-            //thawed=true;
-            //pthread_cond_signal(&cond);
-            //frozen=false; 
-            if (freezing != 0) freezing = 1; // freeze again next time 
-            pthread_mutex_unlock(&mutex);
+            int s = state.load();
+            if ((s & 3) == 2) // freeze again next time 
+                state.compare_exchange_strong(s, 1);
 
             if (enable_cancelability()) {
                 error("ff_thread, thread_routine, could not change thread cancelability");
@@ -270,11 +293,9 @@ protected:
             }
         } while(!stp);
         
-        if (freezing) {
-            pthread_mutex_lock(&mutex);
-            frozen=true;
-            pthread_cond_signal(&cond_frozen);
-            pthread_mutex_unlock(&mutex);
+        if (freezing()) {
+            state.fetch_or(FROZEN);
+            ff_word_wake(&state);
         }
         isdone = true;
     }
@@ -372,9 +393,12 @@ public:
     }
 
     virtual int wait_freezing() {
-        pthread_mutex_lock(&mutex);
-        while(!frozen) pthread_cond_wait(&cond_frozen,&mutex);
-        pthread_mutex_unlock(&mutex);
+        int s;
+        for(int i=0, n=ff_epoch_spin(); i<n; ++i) {
+            if (state.load() & FROZEN) return (init_error?-1:0);
+            PAUSE();
+        }
+        while(!((s=state.load()) & FROZEN)) ff_word_wait(&state, s);
         return (init_error?-1:0);
     }
 
@@ -382,32 +406,30 @@ public:
 
     virtual void freeze() {  
         stp=false;
-        freezing = 1;
+        int s = state.load();
+        while(!state.compare_exchange_weak(s, (s & FROZEN)|1)) ;
     }
     
     virtual void thaw(bool _freeze=false, ssize_t=-1) {
-        pthread_mutex_lock(&mutex);
-        // if this function is called even if the thread is not 
-        // in frozen state, then freezing has to be set to 1 and not 2
-        //if (_freeze) freezing= (frozen?2:1); // next time freeze again the thread
-        // October 2014, changed the above policy.
+        // October 2014, changed the policy.
         // If thaw is called and the thread is not in the frozen stage, 
         // then the thread won't fall to sleep at the next freezing point
 
-        if (_freeze) freezing = 2; // next time freeze again the thread
-        else freezing=0;
-        //assert(thawed==false);
-        frozen=false; 
-        pthread_cond_signal(&cond);
-        pthread_mutex_unlock(&mutex);
-
-        //pthread_mutex_lock(&mutex);
-        //while(!thawed) pthread_cond_wait(&cond, &mutex);
-        //thawed=false;
-        //pthread_mutex_unlock(&mutex);
+        // 2: next time freeze again the thread
+        state.store(_freeze ? 2 : 0);
+        epoch->advance();
     }
-    virtual bool isfrozen() const { return freezing>0;} 
-    virtual bool done()     const { return isdone || (frozen && !stp);}
+    virtual bool isfrozen() const { return freezing()>0;} 
+    virtual bool done()     const { return isdone || ((state.load() & FROZEN) && !stp);}
+
+    /**
+     * \brief Sets the epoch the thread waits on when it is frozen.
+     *
+     * The threads of a skeleton share the same epoch, it must be set
+     * before spawning the thread.
+     */
+    void set_epoch(ff_epoch *e) { epoch = e ? e : &own_epoch; }
+    ff_epoch* get_epoch() const { return epoch; }
 
     pthread_t get_handle() const { return th_handle;}
 
@@ -422,14 +444,16 @@ private:
     BARRIER_T    *  barrier;            /// A \p Barrier object
     bool            stp;
     bool            spawned;
-    int             freezing;  
-    bool            frozen,isdone;
+    // bits 0-1: freezing (0, 1 or 2), bit 2: frozen
+    enum { FROZEN = 4 };
+    std::atomic<int> state;
+    inline int freezing() const { return state.load() & 3; }
+    bool            isdone;
     bool            init_error;
     pthread_t       th_handle;
     pthread_attr_t *attr;
-    pthread_mutex_t mutex; 
-    pthread_cond_t  cond;
-    pthread_cond_t  cond_frozen;
+    ff_epoch        own_epoch;
+    ff_epoch       *epoch; 
     int             old_cancelstate;
 };
     
@@ -495,6 +519,10 @@ private:
     friend class ff_comb;
     friend struct internal_mo_transformer;
     friend struct internal_mi_transformer;
+    friend class replica_worker;
+    friend class ff_executor;
+    friend class async_worker;
+    friend class live_worker;
     
 private:
     FFBUFFER        * in;           ///< Input buffer, built upon SWSR lock-free (wait-free) 
@@ -511,6 +539,7 @@ private:
     bool              my_own_thread;
 
     ff_thread       * thread;       /// A \p thWorker object, which extends the \p ff_thread class 
+    ff_epoch        * epoch=nullptr;
     bool (*callback)(void *, int, unsigned long,unsigned long, void *);
     void            * callback_arg;
     BARRIER_T       * barrier;      /// A \p Barrier object
@@ -569,6 +598,7 @@ protected:
                 pthread_mutex_lock(cons_m);
                 pthread_cond_timedwait(cons_c, cons_m,&tv);
                 pthread_mutex_unlock(cons_m);
+                idle_in();
                 goto retry;
             }
             return true;
@@ -577,6 +607,7 @@ protected:
             if (!in_active) { *ptr=NULL; return false; }
             if (pop(ptr)) return true;
             losetime_in(ticks);
+            idle_in();
         } 
         return true;
     }
@@ -759,6 +790,7 @@ protected:
         if (thread) delete reinterpret_cast<thWorker*>(thread);
         thread = new thWorker(this,neos);
         if (!thread) return -1;
+        thread->set_epoch(epoch);
         return thread->run();
     }
     
@@ -773,6 +805,7 @@ protected:
         if (thread) delete reinterpret_cast<thWorker*>(thread);
         thread = new thWorker(this,neos);
         if (!thread) return 0;
+        thread->set_epoch(epoch);
         freeze();
         return thread->run();
     }
@@ -1013,6 +1046,13 @@ public:
         barrier = b;
     }
     virtual BARRIER_T* get_barrier() const { return barrier; }
+
+    /**
+     * \internal
+     * \brief Sets the epoch shared with the other threads of the skeleton,
+     * it is used by the node's thread (if any) when it is frozen.
+     */
+    void set_epoch(ff_epoch * const e) { epoch = e; }
     
     /** 
      * \internal
@@ -1069,6 +1109,14 @@ public:
 #endif /* SPIN_USE_PAUSE */
     }
 
+    /**
+     * \brief Called by the node's thread while it waits for an input message:
+     * after each losetime_in in non-blocking mode, after each timed wait
+     * (FF_TIMEDWAIT_NS) in blocking mode. It can send out messages,
+     * by default it does nothing.
+     */
+    virtual inline void idle_in() {}
+
     /**
      * \brief Gets input channel
      *
@@ -1635,6 +1683,24 @@ protected:
     //  if (!r) timewait(cons_c);       // channel empty
 };
 
+/*!
+ * \class ff_completion_node
+ * \ingroup building_blocks
+ *
+ * \brief Node calling a function for each input element, it delivers the
+ * results of an accelerator to the user (see set_completion_callback in
+ * ff_pipeline and ff_farm).
+ */
+class ff_completion_node: public ff_node {
+public:
+    ff_completion_node(const std::function<void(void*)>& cb): cb(cb) {}
+    void* svc(void* task) {
+        cb(task);
+        return GO_ON;
+    }
+protected:
+    const std::function<void(void*)> cb;
+};
 
     
 
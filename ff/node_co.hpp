@@ -0,0 +1,304 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \link
+ * \file node_co.hpp
+ * \ingroup building_blocks
+ *
+ * \brief FastFlow node whose svc is a C++20 coroutine
+ *
+ * @detail Each input element starts a new coroutine (svc_co) that can suspend
+ * waiting for the readiness of a file descriptor (co_await) and can produce
+ * any number of outputs (co_yield). Many suspended coroutines are multiplexed
+ * on the thread of the node, which keeps receiving input elements in the
+ * meantime.
+ *
+ * It requires a compiler supporting C++20 coroutines (e.g. -std=c++20),
+ * otherwise the header is empty.
+ *
+ */
+
+#ifndef FF_NODE_CO_HPP
+#define FF_NODE_CO_HPP
+
+/* ***************************************************************************
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#include <ff/node.hpp>
+
+#if defined(__cpp_impl_coroutine) && (__cplusplus >= 202002L) && !defined(_WIN32)
+
+#include <coroutine>
+#include <vector>
+#include <cerrno>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+namespace ff {
+
+// max number of coroutines suspended at the same time in a node
+#if !defined(DEF_CO_MAX_INFLIGHT)
+#define DEF_CO_MAX_INFLIGHT   1024
+#endif
+// polling interval (ms) used when there are suspended coroutines and no input
+#if !defined(DEF_CO_POLL_MS)
+#define DEF_CO_POLL_MS        1
+#endif
+
+class ff_co_poller;
+
+/*!
+ * \brief Awaitable object, it suspends the coroutine until the file
+ * descriptor \p fd is ready for reading (or writing).
+ *
+ * co_await returns 0 if the descriptor is ready, an errno value otherwise.
+ * Only one coroutine at a time can wait on a given descriptor.
+ */
+struct ff_co_io {
+    ff_co_io(ff_co_poller* poller, int fd, bool write):
+        poller(poller), fd(fd), write(write) {}
+
+    bool await_ready() const noexcept { return false; }
+    inline bool await_suspend(std::coroutine_handle<> h);
+    int  await_resume() const noexcept { return err; }
+
+    ff_co_poller            *poller;
+    const int                fd;
+    const bool               write;
+    int                      err = 0;
+    std::coroutine_handle<>  handle;
+};
+
+/*!
+ * \brief Readiness notification for the suspended coroutines of a node
+ * (epoll on Linux, poll elsewhere).
+ */
+class ff_co_poller {
+public:
+    ff_co_poller() {
+#if defined(__linux__)
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd < 0) error("NODE_CO, epoll_create1 failed, errno=%d\n", errno);
+#endif
+    }
+    ~ff_co_poller() {
+        // coroutines never resumed (the node has been stopped before their completion)
+        for(auto w: waiting) w->handle.destroy();
+#if defined(__linux__)
+        if (epfd >= 0) close(epfd);
+#endif
+    }
+
+    int add(ff_co_io* w) {
+#if defined(__linux__)
+        struct epoll_event ev;
+        ev.events   = (w->write ? EPOLLOUT : EPOLLIN);
+        ev.data.ptr = w;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, w->fd, &ev) < 0) return -1;
+#else
+        struct pollfd p;
+        p.fd = w->fd; p.events = (w->write ? POLLOUT : POLLIN); p.revents = 0;
+        fds.push_back(p);
+#endif
+        waiting.push_back(w);
+        return 0;
+    }
+
+    /**
+     * \brief Waits at most \p timeout_ms milliseconds (-1 means forever) for
+     * the readiness of the descriptors and appends the ready coroutines to \p ready.
+     */
+    void poll(int timeout_ms, std::vector<std::coroutine_handle<> >& ready) {
+        if (waiting.empty()) return;
+#if defined(__linux__)
+        struct epoll_event ev[64];
+        const int n = epoll_wait(epfd, ev, 64, timeout_ms);
+        for(int i=0;i<n;++i) {
+            ff_co_io *w = reinterpret_cast<ff_co_io*>(ev[i].data.ptr);
+            epoll_ctl(epfd, EPOLL_CTL_DEL, w->fd, nullptr);
+            if (ev[i].events & (EPOLLERR)) w->err = EIO;
+            remove(w);
+            ready.push_back(w->handle);
+        }
+#else
+        if (::poll(fds.data(), fds.size(), timeout_ms) <= 0) return;
+        for(size_t i=0;i<fds.size();) {
+            if (fds[i].revents) {
+                ff_co_io *w = waiting[i];
+                if (fds[i].revents & (POLLERR|POLLNVAL)) w->err = EIO;
+                fds[i] = fds.back(); fds.pop_back();
+                waiting[i] = waiting.back(); waiting.pop_back();
+                ready.push_back(w->handle);
+            } else ++i;
+        }
+#endif
+    }
+
+    size_t size() const { return waiting.size(); }
+
+protected:
+    void remove(ff_co_io* w) {
+        for(size_t i=0;i<waiting.size();++i)
+            if (waiting[i] == w) {
+                waiting[i] = waiting.back();
+                waiting.pop_back();
+                return;
+            }
+    }
+
+    std::vector<ff_co_io*>     waiting;
+#if defined(__linux__)
+    int                        epfd = -1;
+#else
+    std::vector<struct pollfd> fds;
+#endif
+};
+
+inline bool ff_co_io::await_suspend(std::coroutine_handle<> h) {
+    handle = h;
+    if (poller->add(this) < 0) {
+        err = errno;
+        return false;   // not suspended, co_await returns the error
+    }
+    return true;
+}
+
+/*!
+ * \brief Return type of ff_node_co::svc_co.
+ *
+ * co_yield sends out an element, co_return terminates the coroutine.
+ */
+struct ff_co_task {
+    struct promise_type {
+        ff_co_task get_return_object() {
+            return ff_co_task{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend()   noexcept { return {}; }
+        std::suspend_never  yield_value(void* out) {
+            node->ff_send_out(out);
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() { error("NODE_CO, unhandled exception in svc_co\n"); }
+
+        ff_node *node = nullptr;
+    };
+    std::coroutine_handle<promise_type> handle;
+};
+
+/*!
+ *  \class ff_node_co
+ *  \ingroup building_blocks
+ *
+ *  \brief Typed node whose service method is a coroutine.
+ *
+ *  The user implements svc_co instead of svc. For each input element a new
+ *  coroutine is started, when it suspends on a file descriptor
+ *  (co_await readable(fd) / co_await writable(fd)) the node keeps receiving
+ *  input elements. The suspended coroutines are resumed by the node's thread
+ *  when the descriptors are ready. Output elements are produced with co_yield.
+ *
+ *  At most \p max_inflight coroutines can be suspended at the same time, when
+ *  the limit is reached the node stops reading its input. The node waits for
+ *  the termination of all the coroutines when it receives the EOS.
+ *
+ *  NOTE: the coroutines are executed by the node's thread, so they must not
+ *        block. The descriptors should be in non-blocking mode.
+ *        If the node redefines eosnotify, it must call ff_node_co::eosnotify.
+ *        The output order may differ from the input order.
+ *
+ *  This class is defined in \ref node_co.hpp
+ */
+template<typename IN_t, typename OUT_t = IN_t>
+struct ff_node_co: ff_node_t<IN_t, OUT_t> {
+    ff_node_co(size_t max_inflight=DEF_CO_MAX_INFLIGHT):
+        max_inflight(max_inflight?max_inflight:1) {}
+
+    virtual ff_co_task svc_co(IN_t*)=0;
+
+    OUT_t* svc(IN_t* in) {
+        start(in);
+        if (this->get_in_buffer() == nullptr) {
+            // first stage, the coroutine is started only once
+            drain();
+            return this->EOS;
+        }
+        progress(0);
+        while(inflight >= max_inflight) progress(-1);
+        // while there is no input, the suspended coroutines go on
+        while(inflight && this->get_in_buffer()->empty()) progress(DEF_CO_POLL_MS);
+        return this->GO_ON;
+    }
+
+    void eosnotify(ssize_t=-1) { drain(); }
+
+    /// awaitable, it suspends the coroutine until \p fd is ready for reading
+    ff_co_io readable(int fd) { return ff_co_io(&poller, fd, false); }
+    /// awaitable, it suspends the coroutine until \p fd is ready for writing
+    ff_co_io writable(int fd) { return ff_co_io(&poller, fd, true);  }
+
+    size_t get_inflight()     const { return inflight; }
+    /// maximum number of coroutines suspended at the same time
+    size_t get_max_inflight() const { return max_reached; }
+
+protected:
+    void start(IN_t* in) {
+        ff_co_task t = svc_co(in);
+        t.handle.promise().node = this;
+        ++inflight;
+        resume(t.handle);
+        if (inflight > max_reached) max_reached = inflight;
+    }
+    void resume(std::coroutine_handle<> h) {
+        h.resume();
+        if (h.done()) {
+            h.destroy();
+            --inflight;
+        }
+    }
+    void progress(int timeout_ms) {
+        ready.clear();
+        poller.poll(timeout_ms, ready);
+        for(auto h: ready) resume(h);
+    }
+    void drain() {
+        while(inflight) {
+            if (poller.size() == 0) {
+                error("NODE_CO, %ld coroutines suspended on something else than a descriptor\n", (long)inflight);
+                return;
+            }
+            progress(-1);
+        }
+    }
+
+    const size_t   max_inflight;
+    size_t         inflight = 0, max_reached = 0;
+    ff_co_poller   poller;
+    std::vector<std::coroutine_handle<> > ready;
+};
+
+} // namespace ff
+
+#endif /* __cpp_impl_coroutine */
+
+#endif /* FF_NODE_CO_HPP */
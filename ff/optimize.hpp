@@ -39,6 +39,9 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstdarg>
+#include <vector>
+#include <string>
+#include <fstream>
 #include <ff/node.hpp>
 #include <ff/pipeline.hpp>
 #include <ff/farm.hpp>
@@ -60,6 +63,82 @@ static inline void opt_report(int verbose_level, reportkind_t kind, const char *
     free(p);
 }
 
+/**
+ * \brief Execution profile of the stages of a (flattened) pipeline.
+ *
+ * For each stage it keeps the number of messages received and the total
+ * number of ticks spent in the svc method. It is used by optimize_static
+ * (OptLevel::fuse_stages) to decide which adjacent stages to fuse.
+ * A profile can be collected at the end of a (short) profiling run of a pipeline
+ * built in the same way (this requires TRACE_FASTFLOW), saved to and loaded
+ * from a file, or set by hand.
+ */
+class ff_opt_profile {
+public:
+    struct stage_t {
+        size_t ntasks{0};
+        ticks  svcticks{0};
+    };
+
+    size_t size() const { return stages.size(); }
+    void   clear()      { stages.clear(); }
+
+    void set(size_t stage, size_t ntasks, ticks svcticks) {
+        if (stage >= stages.size()) stages.resize(stage+1);
+        stages[stage].ntasks   = ntasks;
+        stages[stage].svcticks = svcticks;
+    }
+    const stage_t& get(size_t stage) const { return stages[stage]; }
+
+    /**
+     * It reads the counters of the stages of \p pipe at the end of its execution.
+     * Parallel building blocks (farm, all-to-all) are recorded with null counters.
+     */
+    int collect(ff_pipeline& pipe) {
+#if defined(TRACE_FASTFLOW)
+        const svector<ff_node*>& nodes = pipe.get_pipeline_nodes();
+        stages.clear();
+        stages.resize(nodes.size());
+        for(size_t i=0;i<nodes.size();++i) {
+            if (nodes[i]->isFarm() || nodes[i]->isAll2All() || nodes[i]->isPipe()) continue;
+            stages[i].ntasks   = nodes[i]->getnumtask();
+            stages[i].svcticks = nodes[i]->getsvcticks();
+        }
+        return 0;
+#else
+        (void)pipe;
+        error("ff_opt_profile: collect requires TRACE_FASTFLOW\n");
+        return -1;
+#endif
+    }
+
+    /// one line for each stage: <stage id> <n. of messages> <svc ticks>
+    int save(const std::string& filename) const {
+        std::ofstream out(filename);
+        if (!out) {
+            error("ff_opt_profile: cannot open file %s\n", filename.c_str());
+            return -1;
+        }
+        for(size_t i=0;i<stages.size();++i)
+            out << i << " " << stages[i].ntasks << " " << stages[i].svcticks << "\n";
+        return out.good() ? 0 : -1;
+    }
+    int load(const std::string& filename) {
+        std::ifstream in(filename);
+        if (!in) {
+            error("ff_opt_profile: cannot open file %s\n", filename.c_str());
+            return -1;
+        }
+        stages.clear();
+        size_t id, ntasks;
+        ticks  svcticks;
+        while(in >> id >> ntasks >> svcticks) set(id, ntasks, svcticks);
+        return 0;
+    }
+protected:
+    std::vector<stage_t> stages;
+};
+
 /**
  *  This function looks for internal farms with default collector in a farm building block.
  *  The internal default collectors are removed.
@@ -342,6 +421,7 @@ static inline int optimize_static(ff_farm& farm, const OptLevel& opt=OptLevel1()
     iopt.blocking_mode      = false;
     iopt.no_initial_barrier = false;
     iopt.no_default_mapping = false;
+    iopt.fuse_stages        = false;
     const svector<ff_node*> &Workers = farm.getWorkers();
     for(size_t i=0;i<Workers.size();++i) {
         if (Workers[i]->isPipe()) {
@@ -453,6 +533,115 @@ static inline int optimize_static(ff_farm& farm, const OptLevel& opt=OptLevel1()
     return 0;
 }
     
+/*
+ * Profile-guided fusion of adjacent sequential stages of a (flattened) pipeline.
+ *
+ * The cost of a stage is the number of svc ticks per message, where the number of
+ * messages is the maximum between the input and output messages of the stage.
+ * Adjacent stages (or groups of already fused stages) are fused into an ff_comb
+ * when both are cheaper than opt.fusion_threshold (the communication cost
+ * dominates) or when the pipeline has more threads than opt.max_nb_threads.
+ * At each step the pair having the minimum total load is fused so that the pipeline
+ * is split where stages are expensive and the slowest stage stays as fast as possible.
+ * Without a (matching) profile all the stages are assumed to have the same cost and
+ * they are fused only to bring the number of threads down to opt.max_nb_threads.
+ *
+ * NOTE: the profile is not collected here: it must come from a previous run of the
+ * application (see ff_opt_profile). Stages are only fused, expensive stages are
+ * neither split nor replicated (see ff_replicable_stage in replicate.hpp for the
+ * run-time replication of a bottleneck stage).
+ */
+static inline int fuse_pipeline_stages(ff_pipeline& pipe, const OptLevel& opt) {
+    svector<ff_node*>& nodes   = pipe.nodes_list;
+    const int nstages          = static_cast<int>(nodes.size());
+    ssize_t card               = pipe.cardinality();
+
+    // without a valid profile, all the stages have the same (unit) cost
+    ff_opt_profile uniform;
+    const ff_opt_profile* pprof = opt.profile;
+    if (pprof && static_cast<int>(pprof->size()) != nstages) {
+        opt_report(opt.verbose_level, OPT_INFO,
+                   "OPT (pipe): FUSE_STAGES: the profile has %ld stages, the pipeline %d, profile ignored\n",
+                   pprof->size(), nstages);
+        pprof = nullptr;
+    }
+    const bool profiled = (pprof != nullptr);
+    if (!profiled) {
+        if (card <= opt.max_nb_threads) {
+            opt_report(opt.verbose_level, OPT_INFO,
+                       "OPT (pipe): FUSE_STAGES: no profile available, fusion disabled\n");
+            return 0;
+        }
+        for(int i=0;i<nstages;++i) uniform.set(i, 1, 1);
+        pprof = &uniform;
+    }
+    const ff_opt_profile& prof = *pprof;
+    struct group_t {
+        int    first, last;
+        double load;
+        bool   fusible;
+    };
+    auto sequential = [](ff_node* n) {
+        return !(n->isFarm() || n->isAll2All() || n->isPipe());
+    };
+    std::vector<group_t> G;
+    for(int i=0;i<nstages;++i)
+        G.push_back({i,i,(double)prof.get(i).svcticks, sequential(nodes[i])});
+
+    // number of messages entering or leaving the group
+    auto messages = [&](const group_t& g) {
+        size_t in  = prof.get(g.first).ntasks;
+        size_t out = (g.last+1<nstages) ? prof.get(g.last+1).ntasks : 0;
+        return (std::max)((size_t)1,(std::max)(in,out));
+    };
+    auto cheap = [&](const group_t& g) {
+        return profiled && (g.load / messages(g)) < opt.fusion_threshold;
+    };
+
+    for(;;) {
+        int best=-1;
+        for(int i=0;i<static_cast<int>(G.size())-1;++i) {
+            const group_t& g1 = G[i], &g2 = G[i+1];
+            if (!g1.fusible || !g2.fusible) continue;
+            if (nodes[g1.last]->isMultiOutput() || nodes[g2.first]->isMultiInput()) continue;
+            if (card <= opt.max_nb_threads && !(cheap(g1) && cheap(g2))) continue;
+            if (best == -1 || (g1.load+g2.load) < (G[best].load+G[best+1].load)) best=i;
+        }
+        if (best == -1) break;
+        G[best].last  = G[best+1].last;
+        G[best].load += G[best+1].load;
+        G.erase(G.begin()+best+1);
+        --card;
+    }
+
+    // a stage is owned by the pipeline if it is deleted by the pipeline destructor
+    auto owned = [&](ff_node* n) {
+        for(size_t i=0;i<pipe.internalSupportNodes.size();++i)
+            if (pipe.internalSupportNodes[i] == n) return true;
+        if (!pipe.node_cleanup) return false;
+        for(size_t i=0;i<pipe.dontcleanup.size();++i)
+            if (pipe.dontcleanup[i] == n) return false;
+        return true;
+    };
+    // right-to-left so that the positions of the groups not yet fused do not change
+    for(int k=static_cast<int>(G.size())-1;k>=0;--k) {
+        const int first=G[k].first, last=G[k].last;
+        if (first == last) continue;
+        ff_node* comb = new ff_comb(nodes[first], nodes[first+1],
+                                    owned(nodes[first]), owned(nodes[first+1]));
+        assert(comb);
+        for(int i=first+2;i<=last;++i) {
+            comb = new ff_comb(comb, nodes[i], true, owned(nodes[i]));
+            assert(comb);
+        }
+        for(int i=first;i<=last;++i) pipe.remove_stage(first, true);
+        pipe.insert_stage(first, comb, true);
+        opt_report(opt.verbose_level, OPT_NORMAL,
+                   "OPT (pipe): FUSE_STAGES: Fused stages [%d-%d], load=%.0f ticks\n", first, last, G[k].load);
+    }
+    return 0;
+}
+
 /* 
  *
  */    
@@ -474,6 +663,7 @@ static inline int optimize_static(ff_pipeline& pipe, const OptLevel& opt=OptLeve
    iopt.blocking_mode      = false;
    iopt.no_initial_barrier = false;
    iopt.no_default_mapping = false;
+   iopt.fuse_stages        = false;
    for(int i=0;i<nstages;++i) {
        if (pipe.nodes_list[i]->isFarm()) {
            ff_farm *farm = reinterpret_cast<ff_farm*>(pipe.nodes_list[i]);
@@ -503,6 +693,11 @@ static inline int optimize_static(ff_pipeline& pipe, const OptLevel& opt=OptLeve
        }
    }
    
+   // profile-guided fusion of sequential stages (it does not apply to nested pipelines)
+   if (opt.fuse_stages) {
+       if (fuse_pipeline_stages(pipe, opt)<0) return -1;
+   }
+
    // ------------------ helping function ----------------------
    auto find_farm_with_null_collector =
        [](const svector<ff_node*>& nodeslist, int start=0)->int {
@@ -0,0 +1,290 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \link
+ * \file parallel_algorithms.hpp
+ * \ingroup high_level_patterns
+ *
+ * \brief Parallel algorithms over random-access iterator ranges
+ * (parallel_for_each, parallel_transform, parallel_transform_reduce,
+ * parallel_count_if, parallel_copy_if)
+ *
+ * @detail The range is divided in (at most) one block of consecutive
+ * elements per Worker, the blocks are processed on the shared pool of the
+ * one-shot parallel_for, or on the Workers of a given ParallelFor object.
+ * For contiguous ranges (pointers, std::vector, std::array, std::string) the
+ * loop over a block is a plain counted loop over a pointer, so that the
+ * compiler can vectorize it.
+ *
+ * The names have the parallel_ prefix (as parallel_for, parallel_sort), so
+ * they do not clash with the STL algorithms under using namespace ff.
+ *
+ */
+
+#ifndef FF_PARALLEL_ALGORITHMS_HPP
+#define FF_PARALLEL_ALGORITHMS_HPP
+
+/* ***************************************************************************
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <ff/parallel_for.hpp>
+
+namespace ff {
+
+// minimum n. of elements of a block
+#if !defined(DEF_PARALGO_MIN_BLOCK)
+#define DEF_PARALGO_MIN_BLOCK  1024
+#endif
+
+// n. of blocks of the range of n elements processed by run
+static inline long paralgo_nblocks(const ff_parallel_runner& run, long n) {
+    return std::max(1L, std::min(run.p, n / DEF_PARALGO_MIN_BLOCK));
+}
+
+/**
+ * \internal
+ * \brief true if the elements of the range are contiguous in memory.
+ */
+template<typename Iter, typename V = typename std::iterator_traits<Iter>::value_type>
+struct ff_is_contiguous:
+    std::integral_constant<bool, std::is_pointer<Iter>::value ||
+        (!std::is_same<V,bool>::value &&
+         (std::is_same<Iter, typename std::vector<V>::iterator>::value ||
+          std::is_same<Iter, typename std::vector<V>::const_iterator>::value)) ||
+        std::is_same<Iter, typename std::basic_string<char>::iterator>::value ||
+        std::is_same<Iter, typename std::basic_string<char>::const_iterator>::value> {};
+
+// the pointer to the first element of a contiguous range
+template<typename Iter>
+static inline auto ff_ptr(Iter it, std::true_type) -> decltype(&*it) { return &*it; }
+template<typename Iter>
+static inline Iter ff_ptr(Iter it, std::false_type) { return it; }
+
+/**
+ * \internal
+ * \brief Sequential kernels executed on a block, the iterators are replaced
+ * by pointers if the ranges are contiguous.
+ */
+template<typename Iter, typename Function>
+static inline void paralgo_for_each(Iter first, long n, Function& f) {
+    auto p = ff_ptr(first, ff_is_contiguous<Iter>());
+    PRAGMA_IVDEP;
+    for(long i=0;i<n;++i) f(p[i]);
+}
+template<typename Iter, typename OutIter, typename UnaryOp>
+static inline void paralgo_transform(Iter first, long n, OutIter out, UnaryOp& op) {
+    auto p = ff_ptr(first, ff_is_contiguous<Iter>());
+    auto q = ff_ptr(out,   ff_is_contiguous<OutIter>());
+    PRAGMA_IVDEP;
+    for(long i=0;i<n;++i) q[i] = op(p[i]);
+}
+template<typename Iter1, typename Iter2, typename OutIter, typename BinaryOp>
+static inline void paralgo_transform(Iter1 first1, long n, Iter2 first2, OutIter out, BinaryOp& op) {
+    auto p1 = ff_ptr(first1, ff_is_contiguous<Iter1>());
+    auto p2 = ff_ptr(first2, ff_is_contiguous<Iter2>());
+    auto q  = ff_ptr(out,    ff_is_contiguous<OutIter>());
+    PRAGMA_IVDEP;
+    for(long i=0;i<n;++i) q[i] = op(p1[i], p2[i]);
+}
+template<typename Iter, typename T, typename BinaryOp, typename UnaryOp>
+static inline T paralgo_transform_reduce(Iter first, long n, T acc, BinaryOp& reduce, UnaryOp& op) {
+    auto p = ff_ptr(first, ff_is_contiguous<Iter>());
+    for(long i=0;i<n;++i) acc = reduce(acc, op(p[i]));
+    return acc;
+}
+
+/**
+ * \internal
+ * \brief Implementation of the parallel algorithms, \p run executes the blocks.
+ */
+template<typename Iter, typename Function>
+static void paralgo_for_each(const ff_parallel_runner& run, Iter first, Iter last, Function& f) {
+    const long n  = last - first;
+    if (n <= 0) return;
+    const long nb = paralgo_nblocks(run, n);
+    run(nb, [&](const long b) {
+            const long s = (b*n)/nb;
+            paralgo_for_each(first + s, ((b+1)*n)/nb - s, f);
+        });
+}
+template<typename Iter, typename OutIter, typename UnaryOp>
+static OutIter paralgo_transform(const ff_parallel_runner& run, Iter first, Iter last, OutIter out, UnaryOp& op) {
+    const long n  = last - first;
+    if (n <= 0) return out;
+    const long nb = paralgo_nblocks(run, n);
+    run(nb, [&](const long b) {
+            const long s = (b*n)/nb;
+            paralgo_transform(first + s, ((b+1)*n)/nb - s, out + s, op);
+        });
+    return out + n;
+}
+template<typename Iter1, typename Iter2, typename OutIter, typename BinaryOp>
+static OutIter paralgo_transform(const ff_parallel_runner& run, Iter1 first1, Iter1 last1, Iter2 first2,
+                                 OutIter out, BinaryOp& op) {
+    const long n  = last1 - first1;
+    if (n <= 0) return out;
+    const long nb = paralgo_nblocks(run, n);
+    run(nb, [&](const long b) {
+            const long s = (b*n)/nb;
+            paralgo_transform(first1 + s, ((b+1)*n)/nb - s, first2 + s, out + s, op);
+        });
+    return out + n;
+}
+template<typename Iter, typename T, typename BinaryOp, typename UnaryOp>
+static T paralgo_transform_reduce(const ff_parallel_runner& run, Iter first, Iter last, T init,
+                                  BinaryOp& reduce, UnaryOp& op) {
+    const long n  = last - first;
+    if (n <= 0) return init;
+    const long nb = paralgo_nblocks(run, n);
+    if (nb == 1) return paralgo_transform_reduce(first, n, init, reduce, op);
+    // the first element of each block is the initial value of its partial result
+    std::vector<T> P(nb, init);
+    run(nb, [&](const long b) {
+            const long s = (b*n)/nb, e = ((b+1)*n)/nb;
+            P[b] = paralgo_transform_reduce(first + s + 1, e - s - 1, T(op(first[s])), reduce, op);
+        });
+    // the partial results are combined in order
+    T r = init;
+    for(long b=0;b<nb;++b) r = reduce(r, P[b]);
+    return r;
+}
+template<typename Iter, typename Predicate>
+static long paralgo_count_if(const ff_parallel_runner& run, Iter first, Iter last, Predicate& pred) {
+    auto one  = [&pred](const typename std::iterator_traits<Iter>::value_type& x) -> long {
+        return pred(x) ? 1 : 0;
+    };
+    auto sum  = [](const long a, const long b) { return a+b; };
+    return paralgo_transform_reduce(run, first, last, 0L, sum, one);
+}
+template<typename Iter, typename OutIter, typename Predicate>
+static OutIter paralgo_copy_if(const ff_parallel_runner& run, Iter first, Iter last, OutIter out, Predicate& pred) {
+    const long n  = last - first;
+    if (n <= 0) return out;
+    const long nb = paralgo_nblocks(run, n);
+    if (nb == 1) return std::copy_if(first, last, out, pred);
+    // first pass: the results of pred and the n. of elements copied by each block
+    std::vector<char> flags(n);
+    std::vector<long> offset(nb+1, 0);
+    run(nb, [&](const long b) {
+            const long s = (b*n)/nb, e = ((b+1)*n)/nb;
+            long c = 0;
+            for(long i=s;i<e;++i) c += (flags[i] = pred(first[i]) ? 1 : 0);
+            offset[b+1] = c;
+        });
+    for(long b=0;b<nb;++b) offset[b+1] += offset[b];
+    // second pass: each block copies its elements starting from its offset
+    run(nb, [&](const long b) {
+            const long s = (b*n)/nb, e = ((b+1)*n)/nb;
+            OutIter o = out + offset[b];
+            for(long i=s;i<e;++i)
+                if (flags[i]) *o++ = first[i];
+        });
+    return out + offset[nb];
+}
+
+/// ---------------------------------------------------------------------------------
+///  Parallel algorithms over the random-access range [first,last(, with the
+///  signatures of the corresponding STL ones. nw is the max n. of Worker threads used (default n. of cores). The 
+///  versions with a ParallelFor object as first parameter run on its Worker 
+///  threads. The functions are called concurrently on different elements.
+
+//! Applies f to each element of [first,last(
+template<typename Iter, typename Function>
+static void parallel_for_each(Iter first, Iter last, Function f, const long nw=FF_AUTO) {
+    paralgo_for_each(ff_parallel_runner(nullptr, nw), first, last, f);
+}
+template<typename Iter, typename Function>
+static void parallel_for_each(ParallelFor& pf, Iter first, Iter last, Function f, const long nw=FF_AUTO) {
+    paralgo_for_each(ff_parallel_runner(&pf, nw), first, last, f);
+}
+
+//! out[i] = op(first[i]), it returns the end of the output range
+template<typename Iter, typename OutIter, typename UnaryOp>
+static OutIter parallel_transform(Iter first, Iter last, OutIter out, UnaryOp op, const long nw=FF_AUTO) {
+    return paralgo_transform(ff_parallel_runner(nullptr, nw), first, last, out, op);
+}
+template<typename Iter, typename OutIter, typename UnaryOp>
+static OutIter parallel_transform(ParallelFor& pf, Iter first, Iter last, OutIter out, UnaryOp op, const long nw=FF_AUTO) {
+    return paralgo_transform(ff_parallel_runner(&pf, nw), first, last, out, op);
+}
+
+//! out[i] = op(first1[i], first2[i]), it returns the end of the output range
+template<typename Iter1, typename Iter2, typename OutIter, typename BinaryOp,
+         typename = typename std::enable_if<!std::is_integral<BinaryOp>::value>::type>
+static OutIter parallel_transform(Iter1 first1, Iter1 last1, Iter2 first2, OutIter out, BinaryOp op,
+                                  const long nw=FF_AUTO) {
+    return paralgo_transform(ff_parallel_runner(nullptr, nw), first1, last1, first2, out, op);
+}
+template<typename Iter1, typename Iter2, typename OutIter, typename BinaryOp,
+         typename = typename std::enable_if<!std::is_integral<BinaryOp>::value>::type>
+static OutIter parallel_transform(ParallelFor& pf, Iter1 first1, Iter1 last1, Iter2 first2, OutIter out, BinaryOp op,
+                                  const long nw=FF_AUTO) {
+    return paralgo_transform(ff_parallel_runner(&pf, nw), first1, last1, first2, out, op);
+}
+
+/**
+ * \brief init reduce op(first[0]) reduce ... reduce op(first[n-1])
+ *
+ * \p reduce has to be associative (the partial results of the blocks are
+ * combined in order).
+ */
+template<typename Iter, typename T, typename BinaryOp, typename UnaryOp>
+static T parallel_transform_reduce(Iter first, Iter last, T init, BinaryOp reduce, UnaryOp op, const long nw=FF_AUTO) {
+    return paralgo_transform_reduce(ff_parallel_runner(nullptr, nw), first, last, init, reduce, op);
+}
+template<typename Iter, typename T, typename BinaryOp, typename UnaryOp>
+static T parallel_transform_reduce(ParallelFor& pf, Iter first, Iter last, T init, BinaryOp reduce, UnaryOp op,
+                                   const long nw=FF_AUTO) {
+    return paralgo_transform_reduce(ff_parallel_runner(&pf, nw), first, last, init, reduce, op);
+}
+
+//! n. of elements satisfying pred
+template<typename Iter, typename Predicate>
+static long parallel_count_if(Iter first, Iter last, Predicate pred, const long nw=FF_AUTO) {
+    return paralgo_count_if(ff_parallel_runner(nullptr, nw), first, last, pred);
+}
+template<typename Iter, typename Predicate>
+static long parallel_count_if(ParallelFor& pf, Iter first, Iter last, Predicate pred, const long nw=FF_AUTO) {
+    return paralgo_count_if(ff_parallel_runner(&pf, nw), first, last, pred);
+}
+
+/**
+ * \brief Copies the elements satisfying pred to out, keeping their order.
+ * It returns the end of the output range (out must be random-access).
+ *
+ * pred is called once per element, its results are kept in a temporary 
+ * buffer (1 byte per element).
+ */
+template<typename Iter, typename OutIter, typename Predicate>
+static OutIter parallel_copy_if(Iter first, Iter last, OutIter out, Predicate pred, const long nw=FF_AUTO) {
+    return paralgo_copy_if(ff_parallel_runner(nullptr, nw), first, last, out, pred);
+}
+template<typename Iter, typename OutIter, typename Predicate>
+static OutIter parallel_copy_if(ParallelFor& pf, Iter first, Iter last, OutIter out, Predicate pred, const long nw=FF_AUTO) {
+    return paralgo_copy_if(ff_parallel_runner(&pf, nw), first, last, out, pred);
+}
+
+} // namespace ff
+
+#endif /* FF_PARALLEL_ALGORITHMS_HPP */
@@ -50,6 +50,35 @@
  *  If you want to use the static scheduling policy (either default or with a given grain),
  *  please use the **parallel_for_static** method.
  *
+ *  The **parallel_for_guided** and **parallel_for_auto** methods (and the corresponding
+ *  parallel_reduce ones) use chunks of decreasing size taken by the Workers from the 
+ *  shared iteration space; with the auto policy the chunk size is selected at run-time
+ *  by measuring the cost of the iterations. By defining PARFOR_AUTO_SCHEDULING at 
+ *  compile time, the auto policy is used also by the methods without the grain 
+ *  parameter (instead of the default static scheduling).
+ *
+ *  Nested loops: a parallel loop started by a FastFlow thread (e.g. in the svc of a
+ *  farm Worker) uses only the cores that are not used by other FastFlow threads 
+ *  (see ff_nested_cores), it is executed by the calling thread if there are no idle
+ *  cores. The nested loops never oversubscribe the cores.
+ *
+ *  NUMA: the **parallel_for_affinity** method (and parallel_reduce_affinity) pins the
+ *  Workers to the cores of the NUMA nodes and always maps the same sub-ranges of 
+ *  (first,last,step) to the same Workers, so that the data initialized with 
+ *  **parallel_first_touch** (or with parallel_for_affinity) is accessed locally.
+ *  They always use all the Workers, also when nested (the limit on the nested
+ *  loops does not apply), otherwise the sub-ranges would change from call to call.
+ *
+ *  Reduce: parallel_reduce combines the partial results of the Workers sequentially.
+ *  **parallel_reduce_tree** combines them in parallel (log2(nw) steps), useful for 
+ *  large (e.g. vector-valued) reduction variables. **parallel_reduce_deterministic** 
+ *  reduces fixed blocks of iterations and combines them in a fixed order: the result
+ *  does not depend on the scheduling nor on the n. of Workers (bit-reproducible 
+ *  floating-point reductions).
+ *
+ *  Scan: the ParallelForReduce class provides the **parallel_scan** method (inclusive
+ *  and exclusive prefix scan of an array, also in-place, or of an index range).
+ *
  *  To use or not to use a scheduler thread ?
  *  As always, it depends on the application, scheduling strategy, platform at hand, 
  *  parallelism degree, ...etc....
@@ -80,14 +109,13 @@
  * For just a single parallel loop, it is better to use the one-shot version (see at the end of 
  * this file).  Useful when there is just 
      * a single parallel loop.
-     * This version should not be used if the parallel loop is called many 
-     * times (e.g., within a sequential loop)  or if there are several loops 
-     * that can be parallelized by using the same ParallelFor* object. 
-     * If this is the case, the version with the object instance is more 
-     * efficient because the Worker threads are created once and then 
-     * re-used many times.
-     * On the contrary, the one-shot version has a lower setup overhead but 
-     * Worker threads are destroyed at the end of the loop.
+     * The one-shot versions share a process-wide pool of Worker threads,
+     * created at the first call and re-used by the following ones. 
+     * The version with the object instance is still to be preferred if 
+     * extra settings are needed (e.g. spin-waiting Workers) or if several 
+     * threads run parallel loops at the same time: only one loop at a time 
+     * can use the shared pool, the other ones create and destroy their own 
+     * Worker threads.
 
  *
  */
@@ -95,11 +123,22 @@
 #ifndef FF_PARFOR_HPP
 #define FF_PARFOR_HPP
 
+#include <cstring>
 #include <ff/pipeline.hpp>
 #include <ff/parallel_for_internals.hpp>
 
 namespace ff {
 
+// n. of blocks (partial results) of parallel_reduce_deterministic
+#if !defined(DEF_PARFOR_REDUCE_BLOCKS)
+#define DEF_PARFOR_REDUCE_BLOCKS  64
+#endif
+
+// minimum n. of elements of a block of parallel_scan
+#if !defined(DEF_PARFOR_SCAN_GRAIN)
+#define DEF_PARFOR_SCAN_GRAIN  2048
+#endif
+
 //
 // TODO: to re-write the ParallelFor class as a specialization of the ParallelForReduce
 //
@@ -195,6 +234,7 @@ public:
     template <typename Function>
     inline void parallel_for(long first, long last, const Function& f, 
                              const long nw=FF_AUTO) {
+        this->setNoGrainPolicy();
         FF_PARFOR_START(this, parforidx,first,last,1,PARFOR_STATIC(0),nw) {
             f(parforidx);            
         } FF_PARFOR_STOP(this);
@@ -217,6 +257,7 @@ public:
     template <typename Function>
     inline void parallel_for(long first, long last, long step, const Function& f, 
                              const long nw=FF_AUTO) {
+        this->setNoGrainPolicy();
         FF_PARFOR_START(this, parforidx,first,last,step,PARFOR_STATIC(0),nw) {
             f(parforidx);            
         } FF_PARFOR_STOP(this);
@@ -335,6 +376,145 @@ public:
             } FF_PARFOR_T_STOP(this,int);
         }
     }
+
+    /**
+     * @brief Parallel for region (step, grain) - guided
+     *
+     * @detail Dynamic scheduling onto nw worker threads with chunks of 
+     * decreasing size: each Worker takes ~remaining/(2*nw) iterations, but
+     * not less than <b>grain</b> iterations. The first chunks are large (low
+     * overhead), the last ones are small (load balancing).
+     *
+     * @param grain minimum n. of iterations scheduled together
+     * @param f <b>f(const long idx)</b> body of the parallel loop
+     * @param nw number of worker threads (default n. of platform HW contexts)
+     */
+    template <typename Function>
+    inline void parallel_for_guided(long first, long last, long step, long grain,
+                                    const Function& f, const long nw=FF_AUTO) {
+        this->setPolicy(PARFOR_POLICY_GUIDED);
+        FF_PARFOR_START(this, parforidx,first,last,step,PARFOR_DYNAMIC(grain),nw) {
+            f(parforidx);
+        } FF_PARFOR_STOP(this);
+    }
+
+    /**
+     * @brief Parallel for region (step) - auto
+     *
+     * @detail As the guided scheduling, but the chunk size is selected at
+     * run-time by measuring the time spent in the iterations, so that each
+     * chunk lasts ~DEF_PARFOR_AUTO_CHUNK_NSEC nanoseconds. Useful when the 
+     * cost of the iterations is unknown and/or irregular.
+     *
+     * @param f <b>f(const long idx)</b> body of the parallel loop
+     * @param nw number of worker threads (default n. of platform HW contexts)
+     */
+    template <typename Function>
+    inline void parallel_for_auto(long first, long last, long step,
+                                  const Function& f, const long nw=FF_AUTO) {
+        this->setPolicy(PARFOR_POLICY_AUTO);
+        FF_PARFOR_START(this, parforidx,first,last,step,1,nw) {
+            f(parforidx);
+        } FF_PARFOR_STOP(this);
+    }
+
+    /**
+     * @brief Parallel for region over a 2D tiled iteration space - dynamic
+     *
+     * @detail The space [first_i,last_i( x [first_j,last_j( is divided in tiles
+     * of tile_i x tile_j iterations (the last ones may be smaller). The tiles
+     * are scheduled dynamically onto nw worker threads one at a time, following
+     * a Morton curve so that the tiles computed at the same time are close.
+     *
+     * @param f <b>f(const long ib, const long ie, const long jb, const long je)</b>
+     * Lambda function, body of the parallel loop. It computes the tile 
+     * [ib,ie( x [jb,je(.
+     * @param nw number of worker threads (default n. of platform HW contexts)
+     */
+    template <typename Function>
+    inline void parallel_for_2d(long first_i, long last_i, long tile_i,
+                                long first_j, long last_j, long tile_j,
+                                const Function& f, const long nw=FF_AUTO) {
+        const long ntiles = tiles.setup(first_i,last_i,tile_i, first_j,last_j,tile_j);
+        if (ntiles == 0) return;
+        auto body = [&f,this](const long start, const long stop, const int) {
+            long ib,ie,jb,je,kb,ke;
+            for(long t=start;t<stop;++t) {
+                tiles.tile(t, ib,ie,jb,je,kb,ke);
+                f(ib,ie,jb,je);
+            }
+        };
+        parallel_for_idx(0,ntiles,1,1,body,nw);
+    }
+
+    /**
+     * @brief Parallel for region over a 3D tiled iteration space - dynamic
+     *
+     * @detail As parallel_for_2d, the body is
+     * <b>f(ib, ie, jb, je, kb, ke)</b>.
+     */
+    template <typename Function>
+    inline void parallel_for_3d(long first_i, long last_i, long tile_i,
+                                long first_j, long last_j, long tile_j,
+                                long first_k, long last_k, long tile_k,
+                                const Function& f, const long nw=FF_AUTO) {
+        const long ntiles = tiles.setup(first_i,last_i,tile_i, first_j,last_j,tile_j,
+                                        first_k,last_k,tile_k);
+        if (ntiles == 0) return;
+        auto body = [&f,this](const long start, const long stop, const int) {
+            long ib,ie,jb,je,kb,ke;
+            for(long t=start;t<stop;++t) {
+                tiles.tile(t, ib,ie,jb,je,kb,ke);
+                f(ib,ie,jb,je,kb,ke);
+            }
+        };
+        parallel_for_idx(0,ntiles,1,1,body,nw);
+    }
+
+    /**
+     * @brief Parallel for region (step) - static, affinity-preserving
+     *
+     * @detail Default static scheduling onto all the worker threads, each 
+     * Worker is pinned to a core (Workers block-distributed among the NUMA
+     * nodes). A given (first, last, step) is always partitioned in the same
+     * sub-ranges computed by the same Workers, so repeated loops over the same
+     * data touch the memory local to the NUMA node of the Worker (if the data
+     * has been initialized in the same way, see parallel_first_touch).
+     * All the Workers are used, also if the loop is nested.
+     *
+     * @param f <b>f(const long idx)</b> body of the parallel loop
+     */
+    template <typename Function>
+    inline void parallel_for_affinity(long first, long last, long step, const Function& f) {
+        this->setupAffinity();
+        this->setAllWorkers();
+        FF_PARFOR_START_IDX(this,parforidx,first,last,step,0,FF_AUTO) {
+            if (this->getnw()>1) this->pinWorker(_ff_thread_id);
+            for(long i=ff_start_idx;i<ff_stop_idx;i+=step) f(i);
+        } FF_PARFOR_STOP(this);
+    }
+
+    /**
+     * @brief Initializes (first touch) the memory [ptr, ptr+bytes( to zero
+     *
+     * @detail The memory is partitioned as the iterations of 
+     * parallel_for_affinity(0, bytes, 1, ...), so each page is allocated on
+     * the NUMA node of the Worker that will compute it. Useful for arrays
+     * processed with parallel_for_affinity over the same range of indexes
+     * (in this case the size of the elements is not relevant).
+     */
+    inline void parallel_first_touch(void* ptr, size_t bytes) {
+        char *p = reinterpret_cast<char*>(ptr);
+        this->setupAffinity();
+        this->setAllWorkers();
+        FF_PARFOR_START_IDX(this,parforidx,0,(long)bytes,1,0,FF_AUTO) {
+            if (this->getnw()>1) this->pinWorker(_ff_thread_id);
+            memset(p+ff_start_idx, 0, ff_stop_idx-ff_start_idx);
+        } FF_PARFOR_STOP(this);
+    }
+
+protected:
+    ff_tiles tiles;
 };
 
  /*!
@@ -420,6 +600,7 @@ public:
     template <typename Function>
     inline void parallel_for(long first, long last, const Function& f, 
                              const long nw=FF_AUTO) {
+        this->setNoGrainPolicy();
         FF_PARFOR_T_START(this, T, parforidx,first,last,1,PARFOR_STATIC(0),nw) {
             f(parforidx);            
         } FF_PARFOR_T_STOP(this,T);
@@ -440,6 +621,7 @@ public:
     template <typename Function>
     inline void parallel_for(long first, long last, long step, const Function& f, 
                              const long nw=FF_AUTO) {
+        this->setNoGrainPolicy();
         FF_PARFOR_T_START(this, T, parforidx,first,last,step,PARFOR_STATIC(0),nw) {
             f(parforidx);            
         } FF_PARFOR_T_STOP(this,T);
@@ -573,6 +755,7 @@ public:
                                 long first, long last, 
                                 const Function& partialreduce_body, const FReduction& finalreduce_body,
                                 const long nw=FF_AUTO) {
+        this->setNoGrainPolicy();
         FF_PARFORREDUCE_START(this, var, identity, parforidx, first, last, 1, PARFOR_STATIC(0), nw) {
             partialreduce_body(parforidx, var);
         } FF_PARFORREDUCE_F_STOP(this, var, finalreduce_body);
@@ -603,6 +786,7 @@ public:
                                 long first, long last, long step, 
                                 const Function& body, const FReduction& finalreduce,
                                 const long nw=FF_AUTO) {
+        this->setNoGrainPolicy();
         FF_PARFORREDUCE_START(this, var, identity, parforidx,first,last,step,PARFOR_STATIC(0),nw) {
             body(parforidx, var);            
         } FF_PARFORREDUCE_F_STOP(this, var, finalreduce);
@@ -691,6 +875,415 @@ public:
         }
     }
     
+    /**
+     * @brief Parallel for region (step, grain) - guided
+     *
+     * @detail Dynamic scheduling onto nw worker threads with chunks of 
+     * decreasing size: each Worker takes ~remaining/(2*nw) iterations, but
+     * not less than <b>grain</b> iterations. The first chunks are large (low
+     * overhead), the last ones are small (load balancing).
+     *
+     * @param grain minimum n. of iterations scheduled together
+     * @param f <b>f(const long idx)</b> body of the parallel loop
+     * @param nw number of worker threads (default n. of platform HW contexts)
+     */
+    template <typename Function>
+    inline void parallel_for_guided(long first, long last, long step, long grain,
+                                    const Function& f, const long nw=FF_AUTO) {
+        this->setPolicy(PARFOR_POLICY_GUIDED);
+        FF_PARFOR_START(this, parforidx,first,last,step,PARFOR_DYNAMIC(grain),nw) {
+            f(parforidx);
+        } FF_PARFOR_STOP(this);
+    }
+
+    /**
+     * @brief Parallel for region (step) - auto
+     *
+     * @detail As the guided scheduling, but the chunk size is selected at
+     * run-time by measuring the time spent in the iterations, so that each
+     * chunk lasts ~DEF_PARFOR_AUTO_CHUNK_NSEC nanoseconds. Useful when the 
+     * cost of the iterations is unknown and/or irregular.
+     *
+     * @param f <b>f(const long idx)</b> body of the parallel loop
+     * @param nw number of worker threads (default n. of platform HW contexts)
+     */
+    template <typename Function>
+    inline void parallel_for_auto(long first, long last, long step,
+                                  const Function& f, const long nw=FF_AUTO) {
+        this->setPolicy(PARFOR_POLICY_AUTO);
+        FF_PARFOR_START(this, parforidx,first,last,step,1,nw) {
+            f(parforidx);
+        } FF_PARFOR_STOP(this);
+    }
+
+    /**
+     * @brief Parallel for region over a 2D tiled iteration space - dynamic
+     *
+     * @detail The space [first_i,last_i( x [first_j,last_j( is divided in tiles
+     * of tile_i x tile_j iterations (the last ones may be smaller). The tiles
+     * are scheduled dynamically onto nw worker threads one at a time, following
+     * a Morton curve so that the tiles computed at the same time are close.
+     *
+     * @param f <b>f(const long ib, const long ie, const long jb, const long je)</b>
+     * Lambda function, body of the parallel loop. It computes the tile 
+     * [ib,ie( x [jb,je(.
+     * @param nw number of worker threads (default n. of platform HW contexts)
+     */
+    template <typename Function>
+    inline void parallel_for_2d(long first_i, long last_i, long tile_i,
+                                long first_j, long last_j, long tile_j,
+                                const Function& f, const long nw=FF_AUTO) {
+        const long ntiles = tiles.setup(first_i,last_i,tile_i, first_j,last_j,tile_j);
+        if (ntiles == 0) return;
+        auto body = [&f,this](const long start, const long stop, const int) {
+            long ib,ie,jb,je,kb,ke;
+            for(long t=start;t<stop;++t) {
+                tiles.tile(t, ib,ie,jb,je,kb,ke);
+                f(ib,ie,jb,je);
+            }
+        };
+        parallel_for_idx(0,ntiles,1,1,body,nw);
+    }
+
+    /**
+     * @brief Parallel for region over a 3D tiled iteration space - dynamic
+     *
+     * @detail As parallel_for_2d, the body is
+     * <b>f(ib, ie, jb, je, kb, ke)</b>.
+     */
+    template <typename Function>
+    inline void parallel_for_3d(long first_i, long last_i, long tile_i,
+                                long first_j, long last_j, long tile_j,
+                                long first_k, long last_k, long tile_k,
+                                const Function& f, const long nw=FF_AUTO) {
+        const long ntiles = tiles.setup(first_i,last_i,tile_i, first_j,last_j,tile_j,
+                                        first_k,last_k,tile_k);
+        if (ntiles == 0) return;
+        auto body = [&f,this](const long start, const long stop, const int) {
+            long ib,ie,jb,je,kb,ke;
+            for(long t=start;t<stop;++t) {
+                tiles.tile(t, ib,ie,jb,je,kb,ke);
+                f(ib,ie,jb,je,kb,ke);
+            }
+        };
+        parallel_for_idx(0,ntiles,1,1,body,nw);
+    }
+
+    /**
+     * \brief Parallel reduce (step, grain) - guided
+     *
+     * The iterations are scheduled as in parallel_for_guided.
+     */
+    template <typename Function, typename FReduction>
+    inline void parallel_reduce_guided(T& var, const T& identity,
+                                       long first, long last, long step, long grain,
+                                       const Function& body, const FReduction& finalreduce,
+                                       const long nw=FF_AUTO) {
+        this->setPolicy(PARFOR_POLICY_GUIDED);
+        FF_PARFORREDUCE_START(this, var, identity, parforidx,first,last,step,PARFOR_DYNAMIC(grain),nw) {
+            body(parforidx, var);
+        } FF_PARFORREDUCE_F_STOP(this, var, finalreduce);
+    }
+
+    /**
+     * \brief Parallel reduce (step) - auto
+     *
+     * The iterations are scheduled as in parallel_for_auto.
+     */
+    template <typename Function, typename FReduction>
+    inline void parallel_reduce_auto(T& var, const T& identity,
+                                     long first, long last, long step,
+                                     const Function& body, const FReduction& finalreduce,
+                                     const long nw=FF_AUTO) {
+        this->setPolicy(PARFOR_POLICY_AUTO);
+        FF_PARFORREDUCE_START(this, var, identity, parforidx,first,last,step,1,nw) {
+            body(parforidx, var);
+        } FF_PARFORREDUCE_F_STOP(this, var, finalreduce);
+    }
+
+    /**
+     * \brief Parallel reduce over a 2D tiled iteration space - dynamic
+     *
+     * The tiles are scheduled as in parallel_for_2d, the body is
+     * <b>body(ib, ie, jb, je, var)</b>.
+     */
+    template <typename Function, typename FReduction>
+    inline void parallel_reduce_2d(T& var, const T& identity,
+                                   long first_i, long last_i, long tile_i,
+                                   long first_j, long last_j, long tile_j,
+                                   const Function& body, const FReduction& finalreduce,
+                                   const long nw=FF_AUTO) {
+        const long ntiles = tiles.setup(first_i,last_i,tile_i, first_j,last_j,tile_j);
+        if (ntiles == 0) return;
+        auto tbody = [&body,this](const long start, const long stop, T& v, const int) {
+            long ib,ie,jb,je,kb,ke;
+            for(long t=start;t<stop;++t) {
+                tiles.tile(t, ib,ie,jb,je,kb,ke);
+                body(ib,ie,jb,je,v);
+            }
+        };
+        parallel_reduce_idx(var,identity,0,ntiles,1,1,tbody,finalreduce,nw);
+    }
+
+    /**
+     * \brief Parallel reduce over a 3D tiled iteration space - dynamic
+     *
+     * The tiles are scheduled as in parallel_for_3d, the body is
+     * <b>body(ib, ie, jb, je, kb, ke, var)</b>.
+     */
+    template <typename Function, typename FReduction>
+    inline void parallel_reduce_3d(T& var, const T& identity,
+                                   long first_i, long last_i, long tile_i,
+                                   long first_j, long last_j, long tile_j,
+                                   long first_k, long last_k, long tile_k,
+                                   const Function& body, const FReduction& finalreduce,
+                                   const long nw=FF_AUTO) {
+        const long ntiles = tiles.setup(first_i,last_i,tile_i, first_j,last_j,tile_j,
+                                        first_k,last_k,tile_k);
+        if (ntiles == 0) return;
+        auto tbody = [&body,this](const long start, const long stop, T& v, const int) {
+            long ib,ie,jb,je,kb,ke;
+            for(long t=start;t<stop;++t) {
+                tiles.tile(t, ib,ie,jb,je,kb,ke);
+                body(ib,ie,jb,je,kb,ke,v);
+            }
+        };
+        parallel_reduce_idx(var,identity,0,ntiles,1,1,tbody,finalreduce,nw);
+    }
+
+    /**
+     * @brief Parallel for region (step) - static, affinity-preserving
+     *
+     * @detail Default static scheduling onto all the worker threads, each 
+     * Worker is pinned to a core (Workers block-distributed among the NUMA
+     * nodes). A given (first, last, step) is always partitioned in the same
+     * sub-ranges computed by the same Workers, so repeated loops over the same
+     * data touch the memory local to the NUMA node of the Worker (if the data
+     * has been initialized in the same way, see parallel_first_touch).
+     * All the Workers are used, also if the loop is nested.
+     *
+     * @param f <b>f(const long idx)</b> body of the parallel loop
+     */
+    template <typename Function>
+    inline void parallel_for_affinity(long first, long last, long step, const Function& f) {
+        this->setupAffinity();
+        this->setAllWorkers();
+        FF_PARFOR_START_IDX(this,parforidx,first,last,step,0,FF_AUTO) {
+            if (this->getnw()>1) this->pinWorker(_ff_thread_id);
+            for(long i=ff_start_idx;i<ff_stop_idx;i+=step) f(i);
+        } FF_PARFOR_STOP(this);
+    }
+
+    /**
+     * @brief Initializes (first touch) the memory [ptr, ptr+bytes( to zero
+     *
+     * @detail The memory is partitioned as the iterations of 
+     * parallel_for_affinity(0, bytes, 1, ...), so each page is allocated on
+     * the NUMA node of the Worker that will compute it. Useful for arrays
+     * processed with parallel_for_affinity over the same range of indexes
+     * (in this case the size of the elements is not relevant).
+     */
+    inline void parallel_first_touch(void* ptr, size_t bytes) {
+        char *p = reinterpret_cast<char*>(ptr);
+        this->setupAffinity();
+        this->setAllWorkers();
+        FF_PARFOR_START_IDX(this,parforidx,0,(long)bytes,1,0,FF_AUTO) {
+            if (this->getnw()>1) this->pinWorker(_ff_thread_id);
+            memset(p+ff_start_idx, 0, ff_stop_idx-ff_start_idx);
+        } FF_PARFOR_STOP(this);
+    }
+
+    /**
+     * \brief Parallel reduce (step) - static, affinity-preserving
+     *
+     * The iterations are scheduled as in parallel_for_affinity.
+     */
+    template <typename Function, typename FReduction>
+    inline void parallel_reduce_affinity(T& var, const T& identity,
+                                         long first, long last, long step,
+                                         const Function& body, const FReduction& finalreduce) {
+        this->setupAffinity();
+        this->setAllWorkers();
+        FF_PARFORREDUCE_START_IDX(this, var, identity, parforidx,first,last,step,0,FF_AUTO) {
+            if (this->getnw()>1) this->pinWorker(_ff_thread_id);
+            for(long i=ff_start_idx;i<ff_stop_idx;i+=step) body(i, var);
+        } FF_PARFORREDUCE_F_STOP(this, var, finalreduce);
+    }
+
+    /**
+     * \brief Parallel prefix scan of the array in[0..n( - static
+     *
+     * out[i] = in[0] op ... op in[i] (inclusive), or
+     * out[i] = identity op in[0] op ... op in[i-1] (exclusive).
+     * \p op is associative, it has the same signature of the final reduce
+     * function: <b>op(T& acc, const T& elem)</b>. \p out can be equal to \p in
+     * (in-place scan).
+     *
+     * Two-pass blocked algorithm: the array is partitioned in (at most) nw
+     * blocks, each block is first reduced in parallel, the block offsets are
+     * scanned sequentially, then each block is scanned in parallel starting
+     * from its offset. The arrays are accessed sequentially in each block.
+     */
+    template <typename FOp>
+    inline void parallel_scan(const T* in, T* out, long n, const T& identity,
+                              const FOp& op, bool inclusive=true, const long nw=FF_AUTO) {
+        auto reduce = [in,&op](const long b, const long e, T& acc) {
+            for(long i=b;i<e;++i) op(acc, in[i]);
+        };
+        auto scan = [in,out,&op,inclusive](const long b, const long e, T& acc) {
+            if (inclusive) 
+                for(long i=b;i<e;++i) { op(acc, in[i]); out[i] = acc; }
+            else 
+                for(long i=b;i<e;++i) { const T v = in[i]; out[i] = acc; op(acc, v); }
+        };
+        scan_blocks(0, n, identity, op, reduce, scan, nw);
+    }
+    /// in-place version
+    template <typename FOp>
+    inline void parallel_scan(T* data, long n, const T& identity,
+                              const FOp& op, bool inclusive=true, const long nw=FF_AUTO) {
+        parallel_scan(data, data, n, identity, op, inclusive, nw);
+    }
+
+    /**
+     * \brief Parallel prefix scan over the index range [first,last( - static
+     *
+     * As the array version, the i-th element is <b>get(i)</b> (it returns a T), 
+     * the i-th result is stored by calling <b>put(i, const T& value)</b>.
+     */
+    template <typename FGet, typename FOp, typename FPut>
+    inline void parallel_scan_idx(long first, long last, const T& identity,
+                                  const FGet& get, const FOp& op, const FPut& put,
+                                  bool inclusive=true, const long nw=FF_AUTO) {
+        auto reduce = [&get,&op](const long b, const long e, T& acc) {
+            for(long i=b;i<e;++i) op(acc, get(i));
+        };
+        auto scan = [&get,&op,&put,inclusive](const long b, const long e, T& acc) {
+            if (inclusive) 
+                for(long i=b;i<e;++i) { op(acc, get(i)); put(i, acc); }
+            else 
+                for(long i=b;i<e;++i) { const T v = get(i); put(i, acc); op(acc, v); }
+        };
+        scan_blocks(first, last, identity, op, reduce, scan, nw);
+    }
+
+    /**
+     * \brief Parallel reduce (step, grain) - tree combine
+     *
+     * As parallel_reduce with dynamic scheduling, but the partial results 
+     * of the nw Workers are combined in parallel along a binary tree 
+     * (log2(nw) steps) instead of sequentially by the calling thread. 
+     * Useful when combining two partial results is expensive (e.g. 
+     * vector-valued reductions with many Workers).
+     */
+    template <typename Function, typename FReduction>
+    inline void parallel_reduce_tree(T& var, const T& identity,
+                                     long first, long last, long step, long grain,
+                                     const Function& body, const FReduction& finalreduce,
+                                     const long nw=FF_AUTO) {
+        this->setloop(first,last,step,PARFOR_DYNAMIC(grain),nw);
+        auto F = [&body,step](const long start, const long stop, const int, T& v) {
+            for(long i=start;i<stop;i+=step) body(i, v);
+        };
+        const size_t n = this->getnw();
+        if (n <= 1) {
+            F(this->startIdx(), this->stopIdx(), 0, var);
+            return;
+        }
+        this->setF(F, identity);
+        if (this->run_then_freeze(n)<0)
+            error("running ParallelForReduce (tree)\n");
+        this->wait_freezing();
+        std::vector<T> P;
+        P.reserve(n);
+        for(size_t i=0;i<n;++i) P.push_back(this->takeres(i));
+        combine_tree(P, finalreduce, nw);
+        finalreduce(var, P[0]);
+    }
+
+    /**
+     * \brief Parallel reduce (step) - deterministic
+     *
+     * The iteration space is divided in \p nblocks blocks of consecutive 
+     * iterations, each block is reduced sequentially (starting from 
+     * \p identity) by one Worker, then the partial results of the blocks are 
+     * combined in parallel along a binary tree. Both the blocks and the 
+     * combining order are fixed: the result is the same at each run, 
+     * independently of the scheduling and of the n. of Workers.
+     */
+    template <typename Function, typename FReduction>
+    inline void parallel_reduce_deterministic(T& var, const T& identity,
+                                              long first, long last, long step,
+                                              const Function& body, const FReduction& finalreduce,
+                                              const long nw=FF_AUTO, 
+                                              const long nblocks=DEF_PARFOR_REDUCE_BLOCKS) {
+        if (first >= last) return;
+        const long niter = (last - first + step - 1) / step;
+        const long nb    = std::max(1L, std::min(nblocks, niter));
+        std::vector<T> P(nb, identity);
+        this->parallel_for(0, nb, 1, 1, [&](const long b) {
+                T acc = identity;
+                const long e = first + ((b+1)*niter/nb)*step;
+                for(long i=first + (b*niter/nb)*step; i<e; i+=step) body(i, acc);
+                P[b] = std::move(acc);
+            }, nw);
+        combine_tree(P, finalreduce, nw);
+        finalreduce(var, P[0]);
+    }
+
+protected:
+    // combines P[0..m( along a binary tree, the result is in P[0]. At the step
+    // s (1,2,4,...) P[i] is combined with P[i+s], for i multiple of 2s.
+    template <typename FReduction>
+    inline void combine_tree(std::vector<T>& P, const FReduction& finalreduce, const long nw) {
+        const long m = P.size();
+        const long maxnw = (nw<=0 || nw>(long)this->getNWorkers()) ? (long)this->getNWorkers() : nw;
+        for(long s=1; s<m; s*=2) {
+            const long npairs = (m + s - 1) / (2*s);
+            auto combine = [&P,&finalreduce,s](const long k) {
+                finalreduce(P[2*s*k], P[2*s*k+s]);
+            };
+            if (npairs == 1) combine(0);
+            else this->parallel_for_static(0, npairs, 1, 0, combine, std::min(maxnw, npairs));
+        }
+    }
+
+    // two-pass blocked scan of [first,last(
+    template <typename FOp, typename FReduce, typename FScan>
+    inline void scan_blocks(long first, long last, const T& identity, const FOp& op,
+                            const FReduce& reduce, const FScan& scan, const long nw) {
+        const long n = last - first;
+        if (n <= 0) return;
+        long nb = (nw<=0 || nw>(long)this->getNWorkers()) ? (long)this->getNWorkers() : nw;
+        nb = std::min(nb, std::max(1L, n / DEF_PARFOR_SCAN_GRAIN));
+        if (nb <= 1) {
+            T acc = identity;
+            scan(first, last, acc);
+            return;
+        }
+        auto begin = [first,n,nb](const long b) { return first + (b*n)/nb; };
+        std::vector<T> partial(nb, identity);
+        // first pass: reduction of each block, the adjacent partial[b] share
+        // cache lines so each block accumulates locally and writes once
+        this->parallel_for_static(0, nb, 1, 0, [&](const long b) {
+                T acc = identity;
+                reduce(begin(b), begin(b+1), acc);
+                partial[b] = std::move(acc);
+            }, nb);
+        // exclusive scan of the block reductions
+        T acc = identity;
+        for(long b=0;b<nb;++b) {
+            const T v = partial[b];
+            partial[b] = acc;
+            op(acc, v);
+        }
+        // second pass: scan of each block starting from a local copy of its offset
+        this->parallel_for_static(0, nb, 1, 0, [&](const long b) {
+                T acc = partial[b];
+                scan(begin(b), begin(b+1), acc);
+            }, nb);
+    }
+    ff_tiles tiles;
 };
 
 
@@ -809,42 +1402,171 @@ public:
 };
 //#endif //VS12
 
+// n. of Worker threads of the shared pool (0 means the n. of cores)
+#if !defined(DEF_PARFOR_POOL_NW)
+#define DEF_PARFOR_POOL_NW  0
+#endif
+
+/**
+ * \internal
+ * \brief Process-wide pool of worker threads used by the free parallel_for
+ * and parallel_reduce functions (one pool for each type of the reduction
+ * variable, int for parallel_for).
+ *
+ * The ff_forall_farm is created at the first call and kept frozen between
+ * the calls. Only one loop at a time can use it: if it is busy (concurrent
+ * calls from different threads, or a call from the body of a loop running
+ * on the pool) or if more workers than the pool's ones are requested,
+ * acquire returns nullptr and the caller runs the one-shot version.
+ *
+ * By defining at compile time NO_PARFOR_SHARED_POOL the pool is never used.
+ */
+template<typename Tres>
+class ff_parfor_pool {
+public:
+    typedef ff_forall_farm<forallreduce_W<Tres> > farm_t;
+
+    static farm_t* acquire(const long nw) {
+#if defined(NO_PARFOR_SHARED_POOL)
+        FF_IGNORE_UNUSED(nw);
+        return nullptr;
+#else
+        ff_parfor_pool& p = instance();
+        if (nw > (long)p.maxnw) return nullptr;
+        bool expected = false;
+        if (!p.busy.compare_exchange_strong(expected, true, std::memory_order_acquire))
+            return nullptr;
+        if (!p.farm) p.farm = new farm_t(p.maxnw);
+        return p.farm;
+#endif
+    }
+    static void release(farm_t* farm) {
+        farm->disableScheduler(false);
+        instance().busy.store(false, std::memory_order_release);
+    }
+
+protected:
+    ff_parfor_pool(): maxnw(DEF_PARFOR_POOL_NW>0 ? DEF_PARFOR_POOL_NW : ff_numCores()) {}
+    ~ff_parfor_pool() {
+        if (farm) {
+            farm->stop();
+            farm->wait();
+            delete farm;
+        }
+    }
+    static ff_parfor_pool& instance() {
+        static ff_parfor_pool p;
+        return p;
+    }
+
+    const size_t      maxnw;
+    farm_t           *farm = nullptr;
+    std::atomic<bool> busy{false};
+};
+
 /// ---------------------------------------------------------------------------------
 ///  These are the one-shot versions. It is not needed to create an object instance.
-///  They are useful (and more efficient) for a one-shot parallel loop execution
-///  or when no extra settings are needed.
+///  They are useful for a one-shot parallel loop execution or when no extra
+///  settings are needed. The Worker threads are taken from a shared pool
+///  created at the first call (see ff_parfor_pool), so they can also be called
+///  many times (e.g. within a sequential loop). If the pool is busy a new set of
+///  Worker threads is used and destroyed at the end of the loop.
+
+// one-shot loop without a user grain, same policy as the pool (see setNoGrainPolicy)
+template <typename Function>
+static inline void parallel_for_nograin(long first, long last, long step,
+                                        const Function& body, const long nw) {
+    ff_forall_farm<forallreduce_W<int> > pfor(nw,false,true);
+    pfor.setNoGrainPolicy();
+    pfor.setloop(first,last,step,PARFOR_STATIC(0),nw);
+    auto F = [&] (const long start, const long stop, const int, const int) {
+        PRAGMA_IVDEP;
+        for(long idx=start;idx<stop;idx+=step) body(idx);
+    };
+    if (pfor.getnw()>1) {
+        pfor.setF(F);
+        if (pfor.run_and_wait_end()<0) error("running parallel for\n");
+    } else F(pfor.startIdx(),pfor.stopIdx(),0,0);
+}
 
 // ----------------- parallel_for ----------------------    
 //! Parallel loop over a range of indexes (step=1)
 template <typename Function>
 static void parallel_for(long first, long last, const Function& body, 
                          const long nw=FF_AUTO) {
-    FF_PARFOR_BEGIN(pfor, parforidx,first,last,1,PARFOR_STATIC(0),nw) {
-        body(parforidx);            
-    } FF_PARFOR_END(pfor);
+    if (auto pfor = ff_parfor_pool<int>::acquire(nw)) {
+        pfor->setNoGrainPolicy();
+        FF_PARFOR_START(pfor, parforidx,first,last,1,PARFOR_STATIC(0),nw) {
+            body(parforidx);
+        } FF_PARFOR_STOP(pfor);
+        ff_parfor_pool<int>::release(pfor);
+        return;
+    }
+    parallel_for_nograin(first, last, 1, body, nw);
 }
 //! Parallel loop over a range of indexes using a given step
 template <typename Function>
 static void parallel_for(long first, long last, long step, const Function& body, 
                          const long nw=FF_AUTO) {
-    FF_PARFOR_BEGIN(pfor, parforidx,first,last,step,PARFOR_STATIC(0),nw) {
-        body(parforidx);            
-    } FF_PARFOR_END(pfor);
+    if (auto pfor = ff_parfor_pool<int>::acquire(nw)) {
+        pfor->setNoGrainPolicy();
+        FF_PARFOR_START(pfor, parforidx,first,last,step,PARFOR_STATIC(0),nw) {
+            body(parforidx);
+        } FF_PARFOR_STOP(pfor);
+        ff_parfor_pool<int>::release(pfor);
+        return;
+    }
+    parallel_for_nograin(first, last, step, body, nw);
 }
 //! Parallel loop over a range of indexes using a given step and granularity
 template <typename Function>
 static void parallel_for(long first, long last, long step, long grain, 
                          const Function& body, const long nw=FF_AUTO) {
+    if (auto pfor = ff_parfor_pool<int>::acquire(nw)) {
+        FF_PARFOR_START(pfor, parforidx,first,last,step,grain,nw) {
+            body(parforidx);
+        } FF_PARFOR_STOP(pfor);
+        ff_parfor_pool<int>::release(pfor);
+        return;
+    }
     FF_PARFOR_BEGIN(pfor, parforidx,first,last,step,grain,nw) {
         body(parforidx);            
     } FF_PARFOR_END(pfor);
 }
 
+/**
+ * \internal
+ * \brief Runs f(0) ... f(n-1) in parallel, on the shared pool of the
+ * one-shot parallel_for (pf==nullptr) or on the Workers of pf.
+ */
+struct ff_parallel_runner {
+    ff_parallel_runner(ParallelFor* pf, long nw): pf(pf) {
+        const long max = pf ? (long)pf->getNWorkers() : ff_numCores();
+        p = (nw<=0 || nw>max) ? max : nw;
+    }
+    template<typename Function>
+    void operator()(long n, const Function& f) const {
+        if (n == 1) { f(0); return; }
+        if (pf) pf->parallel_for_static(0, n, 1, 0, f, std::min(n, p));
+        else    parallel_for(0, n, f, std::min(n, p));
+    }
+    ParallelFor *pf;
+    long         p;   // n. of Workers
+};
+
 // advanced version    
 template <typename Function>
 inline void parallel_for_idx(long first, long last, long step, long grain, 
                              const Function& f, const long nw=FF_AUTO,
                              const bool noActiveScheduler=false) {
+    if (auto pfor = ff_parfor_pool<int>::acquire(nw)) {
+        pfor->disableScheduler(noActiveScheduler);
+        FF_PARFOR_START_IDX(pfor,parforidx,first,last,step,PARFOR_DYNAMIC(grain),nw) {
+            f(ff_start_idx, ff_stop_idx,_ff_thread_id);
+        } FF_PARFOR_STOP(pfor);
+        ff_parfor_pool<int>::release(pfor);
+        return;
+    }
     FF_PARFOR_BEGIN_IDX(pfor,parforidx,first,last,step,PARFOR_DYNAMIC(grain),nw,noActiveScheduler){
         f(ff_start_idx, ff_stop_idx,_ff_thread_id);            
     } FF_PARFOR_END(pfor);
@@ -859,6 +1581,14 @@ void parallel_reduce(Value_t& var, const Value_t& identity,
                      const Function& body, const FReduction& finalreduce,
                      const long nw=FF_AUTO) {
     Value_t _var = var;
+    if (auto pfr = ff_parfor_pool<Value_t>::acquire(nw)) {
+        FF_PARFORREDUCE_START(pfr, _var, identity, parforidx, first, last, step, PARFOR_DYNAMIC(grain), nw) {
+            body(parforidx, _var);
+        } FF_PARFORREDUCE_F_STOP(pfr, _var, finalreduce);
+        ff_parfor_pool<Value_t>::release(pfr);
+        var=_var;
+        return;
+    }
     FF_PARFORREDUCE_BEGIN(pfr, _var, identity, parforidx, first, last, step, PARFOR_DYNAMIC(grain), nw) {
         body(parforidx, _var);            
     } FF_PARFORREDUCE_F_END(pfr, _var, finalreduce);
@@ -872,6 +1602,15 @@ void parallel_reduce_idx(Value_t& var, const Value_t& identity,
                          const Function& body, const FReduction& finalreduce,
                          const long nw=FF_AUTO, const bool noActiveScheduler=false) {
     Value_t _var = var;
+    if (auto pfr = ff_parfor_pool<Value_t>::acquire(nw)) {
+        pfr->disableScheduler(noActiveScheduler);
+        FF_PARFORREDUCE_START_IDX(pfr, _var, identity, idx,first,last,step,PARFOR_DYNAMIC(grain),nw) {
+            body(ff_start_idx, ff_stop_idx, _var, _ff_thread_id);
+        } FF_PARFORREDUCE_F_STOP(pfr, _var, finalreduce);
+        ff_parfor_pool<Value_t>::release(pfr);
+        var=_var;
+        return;
+    }
     FF_PARFORREDUCE_BEGIN_IDX(pfr, _var, identity, idx,first,last,step,PARFOR_DYNAMIC(grain),nw,noActiveScheduler) {
         body(ff_start_idx, ff_stop_idx, _var, _ff_thread_id);
     } FF_PARFORREDUCE_F_END(pfr, _var, finalreduce);
@@ -59,6 +59,8 @@
 #include <deque>
 #include <vector>
 #include <cmath>
+#include <cstdint>
+#include <chrono>
 #include <functional>
 #include <ff/lb.hpp>
 #include <ff/node.hpp>
@@ -453,6 +455,25 @@ static inline void workerlosetime_in(const bool aggressive) {
 }
 
 
+// target duration (in nanoseconds) of a chunk of iterations with the auto policy
+#if !defined(DEF_PARFOR_AUTO_CHUNK_NSEC)
+#define DEF_PARFOR_AUTO_CHUNK_NSEC  20000
+#endif
+
+/* Scheduling policies:
+ *  - PARFOR_POLICY_CHUNK : static or dynamic scheduling, according to the chunk
+ *                          value (see the NOTE of ff_forall_farm::setloop)
+ *  - PARFOR_POLICY_GUIDED: the Workers take from the iteration space chunks of
+ *                          decreasing size, i.e. ~remaining/(2*nw) iterations but
+ *                          not less than chunk iterations
+ *  - PARFOR_POLICY_AUTO  : as the guided policy, but the chunk size is selected
+ *                          online by measuring the time spent in the iterations
+ *                          (each chunk should last DEF_PARFOR_AUTO_CHUNK_NSEC)
+ *
+ * With the guided and auto policies the scheduler thread is never started.
+ */
+enum { PARFOR_POLICY_CHUNK=0, PARFOR_POLICY_GUIDED=1, PARFOR_POLICY_AUTO=2 };
+
 // parallel for/reduce task scheduler
 class forall_Scheduler: public ff_node {
 protected:
@@ -462,6 +483,14 @@ protected:
 #ifdef FF_PARFOR_PASSIVE_NOSTEALING
     std::atomic_long       _nextIteration;
 #endif
+    // guided and auto policies
+    struct alignas(CACHE_LINE_SIZE) autotime_t {
+        long t0    = 0;    // when the last chunk has been taken (0 not known)
+        long iters = 0;    // n. of iterations of the last chunk
+    };
+    std::atomic_long        nextidx;
+    std::atomic_long        autograin;
+    std::vector<autotime_t> autotime;
 protected:
     // initialize the data vector
     virtual inline size_t init_data(ssize_t start, ssize_t stop) {
@@ -551,6 +580,64 @@ protected:
 
         return ntxw;
     }    
+    // initialize the shared iteration space (guided and auto policies)
+    virtual inline size_t init_data_guided(long start, long stop) {
+        static_scheduling = false;
+        skip1=false,jump=0,maxid=-1;
+        if (_chunk <= 0) _chunk = 1;
+        const long numtasks = std::lrint(std::ceil((stop-start)/(double)_step));
+        data.resize(_nw); taskv.resize(8*_nw); eossent.resize(_nw);
+        autotime.resize(_nw);
+        for(size_t i=0;i<_nw;++i) autotime[i].t0 = 0, autotime[i].iters = 0;
+        nextidx.store(start, std::memory_order_relaxed);
+        autograin.store(1, std::memory_order_relaxed);
+        // upper bound of the n. of chunks, it is used to select the n. of Workers
+        if (policy == PARFOR_POLICY_AUTO) return numtasks;
+        return std::lrint(std::ceil(numtasks/(double)_chunk));
+    }
+
+    static inline long nsecs() {
+        return (long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    // auto policy: it measures the time spent by the Worker wid in its last
+    // chunk and updates the chunk size accordingly
+    inline long autoGrain(const int wid) {
+        autotime_t &a = autotime[wid];
+        const long now = nsecs();
+        if (a.t0 && a.iters>0) {
+            const long elapsed = now - a.t0;
+            long g = (elapsed > 0) ?
+                (long)((double)DEF_PARFOR_AUTO_CHUNK_NSEC * a.iters / elapsed) : 4*a.iters;
+            // it does not grow too fast because of a noisy measure
+            g = (std::min)(g, 4*a.iters);
+            const long old = autograin.load(std::memory_order_relaxed);
+            autograin.store((std::max)(1L, (old+g)/2), std::memory_order_relaxed);
+        }
+        a.t0 = now;
+        return autograin.load(std::memory_order_relaxed);
+    }
+    // guided and auto policies: it takes the next chunk of the shared
+    // iteration space, this method is accessed concurrently by all worker threads
+    inline bool nextChunk(forall_task_t *task, const int wid) {
+        const long grain = (policy == PARFOR_POLICY_AUTO) ? autoGrain(wid) : _chunk;
+        const long half  = 2*(long)_nw;
+        long start = nextidx.load(std::memory_order_relaxed), end, c;
+        do {
+            if (start >= _stop) return false;
+            const long remaining = (_stop-start+_step-1)/_step;
+            if (policy == PARFOR_POLICY_AUTO)
+                c = (std::max)(1L, (std::min)(grain, remaining/half));
+            else 
+                c = (std::max)(grain, remaining/half);
+            end = (c >= remaining) ? _stop : start + c*_step;
+        } while(!nextidx.compare_exchange_weak(start, end,
+                                               std::memory_order_relaxed,
+                                               std::memory_order_relaxed));
+        task->set(start, end);
+        if (policy == PARFOR_POLICY_AUTO) autotime[wid].iters = c;
+        return true;
+    }
 public:
     forall_Scheduler(ff_loadbalancer* lb, long start, long stop, long step, long chunk, size_t nw):
         lb(lb),_start(start),_stop(stop),_step(step),_chunk(chunk),totaltasks(0),_nw(nw),
@@ -576,7 +663,8 @@ public:
 
 #ifdef FF_PARFOR_PASSIVE_NOSTEALING
     inline bool canUseNoStealing(){
-        return !globalSchedRunning && !static_scheduling && _step == 1 && _chunk == 1;
+        return !globalSchedRunning && !static_scheduling && _step == 1 && _chunk == 1 &&
+            policy == PARFOR_POLICY_CHUNK;
     }
 #endif
     inline bool sendTask(const bool skipmore=false) {
@@ -589,6 +677,17 @@ public:
         return true;
         }
 #endif
+        if (policy != PARFOR_POLICY_CHUNK) {
+            // one chunk to each Worker (an empty one if there are no more 
+            // iterations), they will take the next ones by themselves
+            for(size_t wid=0;wid<_nw;++wid) {
+                if (!nextChunk(&taskv[wid], (int)wid)) taskv[wid].set(_stop,_stop);
+                autotime[wid].t0 = 0;  // the Worker has not started yet
+                lb->ff_send_out_to(&taskv[wid], (int) wid);
+                eossent[wid]=false;
+            }
+            return false;
+        }
         size_t remaining    = totaltasks;
         const long endchunk = (_chunk-1)*_step + 1;
 
@@ -644,6 +743,7 @@ public:
             return nextTaskConcurrentNoStealing(task, wid);
         }
 #endif
+        if (policy != PARFOR_POLICY_CHUNK) return nextChunk(task, wid);
         const long endchunk = (_chunk-1)*_step + 1; // next end-point
         auto id  = wid;
     L1:
@@ -730,6 +830,7 @@ public:
                 return nextTaskConcurrentNoStealing(task, wid);
         }
 #endif
+        if (policy != PARFOR_POLICY_CHUNK) return nextChunk(task, wid);
         const long endchunk = (_chunk-1)*_step + 1;
         int id  = wid;
         if (data[id].ntask) {
@@ -808,14 +909,17 @@ public:
         return GO_ON;
     }
 
-    inline void setloop(long start, long stop, long step, long chunk, size_t nw) {
+    inline void setloop(long start, long stop, long step, long chunk, size_t nw,
+                        int policy=PARFOR_POLICY_CHUNK) {
         _start=start, _stop=stop, _step=step, _chunk=chunk, _nw=nw;
+        this->policy = policy;
         
 #ifdef FF_PARFOR_PASSIVE_NOSTEALING
         _nextIteration = _start;
 #endif
-        if (_chunk<=0) totaltasks = init_data_static(start,stop);
-        else           totaltasks = init_data(start,stop);
+        if (policy != PARFOR_POLICY_CHUNK) totaltasks = init_data_guided(start,stop);
+        else if (_chunk<=0) totaltasks = init_data_static(start,stop);
+        else                totaltasks = init_data(start,stop);
 
         assert(totaltasks>=1);        
         // adjust the number of workers that have to be started
@@ -829,6 +933,7 @@ public:
     inline size_t running() const { return _nw; }
     inline void workersSpinWait() { workersspinwait=true;}
     inline size_t getnumtasks() const { return totaltasks;}
+    inline int    getpolicy()   const { return policy;}
 protected:
     // the following fields are used only by the scheduler thread
     ff_loadbalancer *lb;
@@ -840,6 +945,7 @@ protected:
     bool             skip1;
     bool             workersspinwait;
     bool             static_scheduling;
+    int              policy = PARFOR_POLICY_CHUNK;
     std::vector<forall_task_t> taskv;
 };
 
@@ -895,6 +1001,7 @@ public:
         F=_F, res=idtt, aggressive=a;
     }
     inline const Tres& getres() const { return res; }
+    inline Tres& getres() { return res; }
 
 protected:
     forall_Scheduler *const sched;
@@ -950,6 +1057,127 @@ public:
 };
 
 
+/**
+ * \internal
+ * \brief Tiles of a 2D/3D iteration space, used by the parallel_for_2d/3d
+ * and parallel_reduce_2d/3d methods.
+ *
+ * The tiles are numbered along a Morton (Z-order) curve, so that the tiles
+ * scheduled one after the other (to the same Worker or to different
+ * Workers at the same time) are close in the iteration space. The order is
+ * computed only when the shape of the tile grid changes.
+ */
+class ff_tiles {
+public:
+    /**
+     * sets up the tiles of [fi,li( x [fj,lj( x [fk,lk( with tiles of size
+     * ti x tj x tk, it returns the n. of tiles.
+     */
+    long setup(long fi, long li, long ti, long fj, long lj, long tj,
+               long fk=0, long lk=1, long tk=1) {
+        if (li<=fi || lj<=fj || lk<=fk) return 0;
+        this->fi=fi; this->li=li; this->ti=(ti>0)?ti:1;
+        this->fj=fj; this->lj=lj; this->tj=(tj>0)?tj:1;
+        this->fk=fk; this->lk=lk; this->tk=(tk>0)?tk:1;
+        const long ni = (li-fi+this->ti-1)/this->ti;
+        const long nj = (lj-fj+this->tj-1)/this->tj;
+        const long nk = (lk-fk+this->tk-1)/this->tk;
+        if (ni!=this->ni || nj!=this->nj || nk!=this->nk) build(ni,nj,nk);
+        return (long)order.size();
+    }
+
+    /// bounds of the tile \p t (in curve order)
+    inline void tile(long t, long& ib, long& ie, long& jb, long& je, long& kb, long& ke) const {
+        const long x  = order[t];
+        const long k  = x % nk, ij = x / nk;
+        ib = fi + (ij / nj)*ti;  ie = (std::min)(ib+ti, li);
+        jb = fj + (ij % nj)*tj;  je = (std::min)(jb+tj, lj);
+        kb = fk + k*tk;          ke = (std::min)(kb+tk, lk);
+    }
+
+protected:
+    // spreads the low bits of x so that 2 (3) zero bits separate them
+    static inline uint64_t spread2(uint64_t x) {
+        x &= 0xffffffffULL;
+        x = (x | (x << 16)) & 0x0000ffff0000ffffULL;
+        x = (x | (x <<  8)) & 0x00ff00ff00ff00ffULL;
+        x = (x | (x <<  4)) & 0x0f0f0f0f0f0f0f0fULL;
+        x = (x | (x <<  2)) & 0x3333333333333333ULL;
+        x = (x | (x <<  1)) & 0x5555555555555555ULL;
+        return x;
+    }
+    static inline uint64_t spread3(uint64_t x) {
+        x &= 0x1fffffULL;
+        x = (x | (x << 32)) & 0x001f00000000ffffULL;
+        x = (x | (x << 16)) & 0x001f0000ff0000ffULL;
+        x = (x | (x <<  8)) & 0x100f00f00f00f00fULL;
+        x = (x | (x <<  4)) & 0x10c30c30c30c30c3ULL;
+        x = (x | (x <<  2)) & 0x1249249249249249ULL;
+        return x;
+    }
+
+    void build(long ni, long nj, long nk) {
+        this->ni=ni; this->nj=nj; this->nk=nk;
+        std::vector<std::pair<uint64_t,long> > keys;
+        keys.reserve(ni*nj*nk);
+        for(long i=0;i<ni;++i)
+            for(long j=0;j<nj;++j)
+                for(long k=0;k<nk;++k) {
+                    const uint64_t key = (nk==1) ?
+                        (spread2(i) << 1 | spread2(j)) :
+                        (spread3(i) << 2 | spread3(j) << 1 | spread3(k));
+                    keys.push_back(std::make_pair(key, (i*nj+j)*nk+k));
+                }
+        std::sort(keys.begin(), keys.end());
+        order.resize(keys.size());
+        for(size_t t=0;t<keys.size();++t) order[t] = keys[t].second;
+    }
+
+    long fi=0, li=0, ti=1, fj=0, lj=0, tj=1, fk=0, lk=0, tk=1;
+    long ni=0, nj=0, nk=0;
+    std::vector<long> order;
+};
+
+
+/**
+ * \internal
+ * \brief Cores lent to the nested parallel loops.
+ *
+ * A parallel loop started by a FastFlow thread (e.g. in the svc of a farm
+ * Worker, or in the body of another parallel loop) is a nested loop: it
+ * uses the calling thread's core (the caller waits for the end of the loop)
+ * plus the cores not used by any running FastFlow thread, so the n. of
+ * running threads never exceeds the n. of cores. If there are no idle cores
+ * the nested loop is executed by the calling thread.
+ *
+ * By defining at compile time NO_PARFOR_NESTED_LIMIT the nested loops are
+ * not bounded.
+ */
+struct ff_nested_cores {
+    // it reserves up to n idle cores, it returns the n. of cores reserved;
+    // own is the n. of running threads belonging to the loop itself (the
+    // Workers spinning between two loops), their cores are available
+    static long acquire(long n, long own=0) {
+        static const long ncores = ff_numCores();
+        std::atomic<long>& r = reserved();
+        long cur = r.load(std::memory_order_relaxed), k;
+        do {
+            const long idle = ncores - ff_running_threads().load(std::memory_order_relaxed) + own - cur;
+            k = (std::min)(n, idle);
+            if (k <= 0) return 0;
+        } while(!r.compare_exchange_weak(cur, cur+k, std::memory_order_relaxed));
+        return k;
+    }
+    static void release(long k) {
+        if (k>0) reserved().fetch_sub(k, std::memory_order_relaxed);
+    }
+    // cores reserved by the nested loops running, their Workers are also
+    // counted as running threads once started (i.e. the estimate is conservative)
+    static std::atomic<long>& reserved() {
+        static std::atomic<long> r{0};
+        return r;
+    }
+};
 
 template <typename Worker_t>
 class ff_forall_farm: public ff_farm {
@@ -991,7 +1219,7 @@ public:
         ff_farm(false,8*DEF_MAX_NUM_WORKERS,8*DEF_MAX_NUM_WORKERS,
                             true, DEF_MAX_NUM_WORKERS,true), // cleanup at exit !
         loopbar( (spinwait && spinbarrier) ? 
-                 (ffBarrier*)(new spinBarrier(maxnw<=0?DEF_MAX_NUM_WORKERS+1:(size_t)(maxnw+1))) :
+                 (ffBarrier*)(new BARRIER_T(maxnw<=0?DEF_MAX_NUM_WORKERS+1:(size_t)(maxnw+1))) :
                  (ffBarrier*)(new Barrier(maxnw<=0?DEF_MAX_NUM_WORKERS+1:(size_t)(maxnw+1))) ),
         skipwarmup(skipwarmup),spinwait(spinwait) {
 
@@ -1036,6 +1264,7 @@ public:
         ff_farm::cleanup_all(); // delete everything at exit
     }
     virtual ~ff_forall_farm() {
+        ff_nested_cores::release(nested);
         if (loopbar) delete loopbar;
         if (ff_farm::getlb()) delete ff_farm::getlb();
     }
@@ -1096,6 +1325,8 @@ public:
 
             r = getlb()->thawWorkers(true, nwtostart);
         }
+        // with spinWait the Workers keep running after the loop
+        if (spinwait && r>=0) spinning = (std::max)(spinning, (long)nwtostart);
         return r;
     }
 
@@ -1116,6 +1347,8 @@ public:
             if (getlb()->runWorkers(nwtostart) != -1)
                 r = getlb()->waitWorkers();
         }
+        ff_nested_cores::release(nested);
+        nested = 0;
         return r;
     }
     
@@ -1127,6 +1360,7 @@ public:
         // executing the parallel iterations)
         size_t running = getlb()->getnworkers();
         if (running == (size_t)-1) return 0;
+        spinning = 0;
         getlb()->freezeWorkers();
         getlb()->broadcast_task(GO_OUT);
         return getlb()->wait_freezingWorkers();
@@ -1145,13 +1379,14 @@ public:
     }
 
     inline int wait_freezing() {
+        int r = 0;
         //if (startScheduler(getnw())) return getlb()->wait_lb_freezing();
-        if (schedRunning) return getlb()->wait_lb_freezing();
-        if (spinwait) { 
-            loopbar->doBarrier(getnw()); 
-            return 0;
-        }
-        return getlb()->wait_freezingWorkers();
+        if (schedRunning) r = getlb()->wait_lb_freezing();
+        else if (spinwait) loopbar->doBarrier(getnw());
+        else r = getlb()->wait_freezingWorkers();
+        ff_nested_cores::release(nested);
+        nested = 0;
+        return r;
     }
     
     inline int wait() {
@@ -1159,6 +1394,7 @@ public:
             const svector<ff_node*> &nodes = getWorkers();
             for(size_t i=0;i<nodes.size();++i) 
                 getlb()->ff_send_out_to(EOS,i);
+            spinning = 0;
         }
         return ff_farm::wait();
     }
@@ -1171,7 +1407,10 @@ public:
         const bool mode = (nw <= numCores);
     
         // NOTE: in case of static scheduling, the scheduler is never started !
-        schedRunning = (!removeSched && startScheduler(nw, ((forall_Scheduler*)getEmitter())->getnumtasks()));
+        //       The same for the guided and auto policies.
+        const forall_Scheduler *sched = (forall_Scheduler*)getEmitter();
+        schedRunning = (!removeSched && sched->getpolicy() == PARFOR_POLICY_CHUNK &&
+                        startScheduler(nw, sched->getnumtasks()));
 
 #ifdef FF_PARFOR_PASSIVE_NOSTEALING
         globalSchedRunning = schedRunning;
@@ -1209,9 +1448,38 @@ public:
             nw = getNWorkers();
         }
         assert(nw<=(ssize_t)getNWorkers());
+        ff_nested_cores::release(nested);
+        nested = 0;
+#if !defined(NO_PARFOR_NESTED_LIMIT)
+        if (ff_in_thread() && !allworkers) {
+            // nested loop: the caller's core plus the idle ones
+            nested = ff_nested_cores::acquire(((nw<=0)?(long)getNWorkers():nw) - 1, spinning);
+            nw = nested + 1;
+        }
+#endif
         forall_Scheduler *sched = (forall_Scheduler*)getEmitter();
-        sched->setloop(begin,end,step,chunk,(nw<=0)?getNWorkers():(size_t)nw);
+        sched->setloop(begin,end,step,chunk,(nw<=0)?getNWorkers():(size_t)nw, policy);
+        policy = PARFOR_POLICY_CHUNK;
+        allworkers = false;
+        // the scheduler may start less Workers than requested
+        if (nested > (long)getnw()-1) {
+            ff_nested_cores::release(nested - ((long)getnw()-1));
+            nested = (long)getnw()-1;
+        }
     }
+    // scheduling policy of the next loop (see forall_Scheduler), the 
+    // policy is reset to PARFOR_POLICY_CHUNK by setloop
+    inline void setPolicy(int p) { policy = p; }
+    // policy of the next loop, if no grain is given by the user: static
+    // scheduling unless PARFOR_AUTO_SCHEDULING is defined at compile time
+    inline void setNoGrainPolicy() {
+#if defined(PARFOR_AUTO_SCHEDULING)
+        policy = PARFOR_POLICY_AUTO;
+#endif
+    }
+    // the next loop uses the n. of Workers requested also if it is nested (the
+    // ff_nested_cores limit is not applied), reset by setloop
+    inline void setAllWorkers() { allworkers = true; }
     // return the number of workers running or supposed to run
     inline size_t getnw() { return ((const forall_Scheduler*)getEmitter())->running(); }
     
@@ -1219,16 +1487,69 @@ public:
         //return  ((forallreduce_W<Tres>*)(getWorkers()[i]))->getres();
         return  ((Worker_t*)(getWorkers()[i]))->getres();
     }
+    // moves out the partial result of the Worker i (it is reset by the next setF)
+    inline Tres_t takeres(int i) {
+        return std::move(((Worker_t*)(getWorkers()[i]))->getres());
+    }
     inline long startIdx(){ return ((const forall_Scheduler*)getEmitter())->startIdx(); }
     inline long stopIdx() { return ((const forall_Scheduler*)getEmitter())->stopIdx(); }
     inline long stepIdx() { return ((const forall_Scheduler*)getEmitter())->stepIdx(); }
 
     void resetskipwarmup() { assert(skipwarmup); skipwarmup=false;}
+
+    /*
+     * Affinity-preserving schedule: the Workers are block-distributed among
+     * the NUMA nodes, the Worker i is pinned to a core of the NUMA node
+     * (i*N)/nw (N NUMA nodes, nw Workers). With the default static 
+     * scheduling onto all the Workers, a given (first, last, step) is 
+     * always partitioned in the same way, and contiguous blocks of 
+     * iterations are computed on the same NUMA node.
+     */
+    inline void setupAffinity() {
+        if (affinity.size()) return;
+        const size_t nw = getNWorkers();
+        affinity.assign(nw, -1);
+        pinned.assign(nw, 0);
+#if !defined(NO_DEFAULT_MAPPING)
+        std::vector<std::vector<int> > topo, nodes;
+        ff_numaTopology(topo);
+        for(size_t i=0;i<topo.size();++i) {
+            std::vector<int> cpus;
+            for(size_t j=0;j<topo[i].size();++j)
+                if (threadMapper::instance()->checkCPUId(topo[i][j])) cpus.push_back(topo[i][j]);
+            if (cpus.size()) nodes.push_back(cpus);  // memory-only nodes are skipped
+        }
+        if (nodes.size()==0) return;
+        const size_t N = nodes.size();
+        std::vector<size_t> next(N,0);
+        for(size_t i=0;i<nw;++i) {
+            const size_t n = (i*N)/nw;
+            affinity[i] = nodes[n][next[n]++ % nodes[n].size()];
+        }
+#endif
+    }
+    // it is called by the Worker id, it pins the calling thread (only the first time)
+    inline void pinWorker(const int id) {
+        if (pinned[id]) return;
+        pinned[id] = 1;
+        if (affinity[id]>=0 && ff_mapThreadToCpu(affinity[id])!=0)
+            error("ff_forall_farm, unable to pin Worker %d to CPU %d\n", id, affinity[id]);
+    }
+    // the core of the Worker id (-1 not pinned), valid after setupAffinity
+    inline int getAffinity(const int id) const { 
+        return (size_t)id<affinity.size() ? affinity[id] : -1; 
+    }
 protected:
     bool   removeSched = false;
     bool   schedRunning= true;
     bool   skipwarmup  = false;
     bool   spinwait    = false;
+    int    policy      = PARFOR_POLICY_CHUNK;
+    long   nested      = 0;   // cores reserved by a nested loop
+    long   spinning    = 0;   // Workers kept running by spinWait between the loops
+    bool   allworkers  = false; // the next loop is not bounded by ff_nested_cores
+    std::vector<int>  affinity;   // core of each Worker (affinity-preserving schedule)
+    std::vector<char> pinned;     // written only by the corresponding Worker
 };
 
     
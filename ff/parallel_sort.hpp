@@ -0,0 +1,293 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \link
+ * \file parallel_sort.hpp
+ * \ingroup high_level_patterns
+ *
+ * \brief Parallel sort of random-access ranges (parallel_sort, parallel_stable_sort)
+ *
+ * @detail Multiway merge sort: the range is divided in one block per Worker,
+ * the blocks are sorted in parallel, then the sorted runs are merged pairwise,
+ * each merge is split among the Workers (merge path). Integral keys sorted
+ * with the default comparator use a parallel LSD radix sort. The parallel
+ * loops run on the shared pool of the one-shot parallel_for or on the
+ * Workers of a given ParallelFor object.
+ *
+ */
+
+#ifndef FF_PARALLEL_SORT_HPP
+#define FF_PARALLEL_SORT_HPP
+
+/* ***************************************************************************
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+#include <ff/parallel_for.hpp>
+
+namespace ff {
+
+// ranges shorter than this are sorted sequentially
+#if !defined(DEF_PARSORT_SEQ_THRESHOLD)
+#define DEF_PARSORT_SEQ_THRESHOLD  (1<<14)
+#endif
+// n. of bits of the digits of the radix sort
+#if !defined(DEF_PARSORT_RADIX_BITS)
+#define DEF_PARSORT_RADIX_BITS     8
+#endif
+
+/**
+ * \internal
+ * \brief N. of elements of a[0..na( in the first k elements of the stable
+ * merge of a[0..na( and b[0..nb(.
+ */
+template<typename S, typename Compare>
+static inline long parsort_corank(long k, S a, long na, S b, long nb, Compare& cmp) {
+    long lo = std::max(0L, k-nb), hi = std::min(k, na);
+    while(lo < hi) {
+        const long i = lo + (hi-lo)/2;
+        // a[i] is in the first k elements if it is not greater than b[k-i-1]
+        if (!cmp(b[k-i-1], a[i])) lo = i+1;
+        else hi = i;
+    }
+    return lo;
+}
+
+/**
+ * \internal
+ * \brief Moves the elements [kb,ke( of the stable merge of a[0..na( and
+ * b[0..nb( into out[kb..ke(.
+ */
+template<typename S, typename D, typename Compare>
+static inline void parsort_merge_part(S a, long na, S b, long nb, long kb, long ke, D out, Compare& cmp) {
+    const long ib = parsort_corank(kb, a, na, b, nb, cmp);
+    const long ie = parsort_corank(ke, a, na, b, nb, cmp);
+    std::merge(std::make_move_iterator(a+ib),      std::make_move_iterator(a+ie),
+               std::make_move_iterator(b+(kb-ib)), std::make_move_iterator(b+(ke-ie)),
+               out+kb, cmp);
+}
+
+/**
+ * \internal
+ * \brief Multiway merge sort, stable if std::stable_sort is used for the blocks.
+ */
+template<typename Iter, typename Compare>
+static void parsort_mergesort(Iter first, Iter last, Compare cmp, bool stable, const ff_parallel_runner& run) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    const long n = last - first;
+    long p = std::min(run.p, n / (DEF_PARSORT_SEQ_THRESHOLD/2));
+    if (p <= 1 || n < DEF_PARSORT_SEQ_THRESHOLD) {
+        if (stable) std::stable_sort(first, last, cmp);
+        else std::sort(first, last, cmp);
+        return;
+    }
+    // the sorted runs are [R[i],R[i+1](
+    std::vector<long> R(p+1);
+    for(long i=0;i<=p;++i) R[i] = (i*n)/p;
+    run(p, [&](const long i) {
+            if (stable) std::stable_sort(first+R[i], first+R[i+1], cmp);
+            else std::sort(first+R[i], first+R[i+1], cmp);
+        });
+
+    std::vector<T> buffer(n);
+    T* buf = buffer.data();
+    bool inbuf = false;   // where the runs are
+    struct part_t { long run, kb, ke; };  // a part of the merge of run and run+1
+    while(R.size() > 2) {
+        const long nr = R.size()-1;
+        std::vector<part_t> P;
+        for(long r=0; r+1<nr; r+=2) {
+            // each merge is split in parts proportional to its size
+            const long s  = R[r+2]-R[r];
+            const long np = std::max(1L, (s*p + n-1)/n);
+            for(long q=0;q<np;++q) P.push_back({r, (q*s)/np, ((q+1)*s)/np});
+        }
+        if (nr & 1) P.push_back({nr-1, 0, R[nr]-R[nr-1]});  // the last run is only moved
+        run((long)P.size(), [&](const long t) {
+                const part_t& x = P[t];
+                const long base = R[x.run];
+                if (x.run+1 == nr) {
+                    if (inbuf) std::move(buf+base+x.kb, buf+base+x.ke, first+base+x.kb);
+                    else std::move(first+base+x.kb, first+base+x.ke, buf+base+x.kb);
+                    return;
+                }
+                const long na = R[x.run+1]-base, nb = R[x.run+2]-R[x.run+1];
+                if (inbuf) parsort_merge_part(buf+base, na, buf+base+na, nb, x.kb, x.ke, first+base, cmp);
+                else parsort_merge_part(first+base, na, first+base+na, nb, x.kb, x.ke, buf+base, cmp);
+            });
+        std::vector<long> R2;
+        for(long r=0; r<nr; r+=2) R2.push_back(R[r]);
+        R2.push_back(n);
+        R.swap(R2);
+        inbuf = !inbuf;
+    }
+    if (inbuf)
+        run(p, [&](const long i) {
+                const long b = (i*n)/p, e = ((i+1)*n)/p;
+                std::move(buf+b, buf+e, first+b);
+            });
+}
+
+/**
+ * \internal
+ * \brief Parallel LSD radix sort of integral keys (ascending order, stable).
+ *
+ * For each digit the Workers compute the histogram of their block, then
+ * they scatter the block into the other buffer. The digits that are equal
+ * for all the keys are skipped.
+ */
+template<typename Iter>
+static void parsort_radix(Iter first, Iter last, const ff_parallel_runner& run) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    typedef typename std::make_unsigned<T>::type U;
+    const long n = last - first;
+    const long p = std::min(run.p, n / (DEF_PARSORT_SEQ_THRESHOLD/2));
+    if (p <= 1 || n < DEF_PARSORT_SEQ_THRESHOLD) {
+        std::sort(first, last);
+        return;
+    }
+    const int    bits   = DEF_PARSORT_RADIX_BITS;
+    const size_t radix  = size_t(1) << bits;
+    const int    npass  = (int)((sizeof(T)*8 + bits - 1) / bits);
+    // the sign bit is flipped, so that the negative keys come first
+    const U      flip   = std::is_signed<T>::value ? U(U(1) << (sizeof(T)*8-1)) : U(0);
+
+    std::vector<T> buffer(n);
+    T* buf = buffer.data();
+    std::vector<size_t> C(p*radix), total(radix);
+    bool inbuf = false;
+    for(int pass=0; pass<npass; ++pass) {
+        const int shift = pass*bits;
+        auto digit = [flip,shift,radix](const T v) {
+            return (size_t)((U(U(v) ^ flip) >> shift) & (radix-1));
+        };
+        run(p, [&](const long i) {
+                size_t *c = &C[i*radix];
+                std::fill(c, c+radix, 0);
+                const long b = (i*n)/p, e = ((i+1)*n)/p;
+                if (inbuf) for(long j=b;j<e;++j) ++c[digit(buf[j])];
+                else       for(long j=b;j<e;++j) ++c[digit(first[j])];
+            });
+        std::fill(total.begin(), total.end(), 0);
+        for(long i=0;i<p;++i)
+            for(size_t d=0;d<radix;++d) total[d] += C[i*radix+d];
+        if (std::find(total.begin(), total.end(), (size_t)n) != total.end()) continue;
+        // output position of the first key of each (digit, block)
+        size_t sum = 0;
+        for(size_t d=0;d<radix;++d)
+            for(long i=0;i<p;++i) {
+                const size_t c = C[i*radix+d];
+                C[i*radix+d] = sum;
+                sum += c;
+            }
+        run(p, [&](const long i) {
+                size_t *c = &C[i*radix];
+                const long b = (i*n)/p, e = ((i+1)*n)/p;
+                if (inbuf) for(long j=b;j<e;++j) first[c[digit(buf[j])]++] = buf[j];
+                else       for(long j=b;j<e;++j) buf[c[digit(first[j])]++] = first[j];
+            });
+        inbuf = !inbuf;
+    }
+    if (inbuf)
+        run(p, [&](const long i) {
+                const long b = (i*n)/p, e = ((i+1)*n)/p;
+                std::copy(buf+b, buf+e, first+b);
+            });
+}
+
+/**
+ * \internal
+ * \brief true if the radix sort can be used: integral keys and std::less.
+ */
+template<typename T, typename Compare>
+struct parsort_use_radix:
+    std::integral_constant<bool, std::is_integral<T>::value && !std::is_same<T,bool>::value &&
+                                 (std::is_same<Compare, std::less<T> >::value ||
+                                  std::is_same<Compare, std::less<> >::value)> {};
+
+template<typename Iter, typename Compare>
+static inline void parsort_dispatch(Iter first, Iter last, Compare& cmp, bool stable,
+                                    const ff_parallel_runner& run, std::false_type) {
+    parsort_mergesort(first, last, cmp, stable, run);
+}
+template<typename Iter, typename Compare>
+static inline void parsort_dispatch(Iter first, Iter last, Compare&, bool,
+                                    const ff_parallel_runner& run, std::true_type) {
+    parsort_radix(first, last, run);
+}
+template<typename Iter, typename Compare>
+static inline void parsort(Iter first, Iter last, Compare& cmp, bool stable, const ff_parallel_runner& run) {
+    typedef typename std::iterator_traits<Iter>::value_type T;
+    if (last - first < 2) return;
+    parsort_dispatch(first, last, cmp, stable, run, parsort_use_radix<T,Compare>());
+}
+
+/// ---------------------------------------------------------------------------------
+///  Sorts the random-access range [first,last( according to cmp (default
+///  std::less). The elements have to be default-constructible and movable.
+///  The stable versions keep the relative order of the equivalent elements.
+///  nw is the max n. of Worker threads used (default n. of cores). The
+///  versions with a ParallelFor object run on its Worker threads.
+
+//! Parallel sort of [first,last( with the comparator cmp
+template<typename Iter, typename Compare>
+static void parallel_sort(Iter first, Iter last, Compare cmp, const long nw=FF_AUTO) {
+    parsort(first, last, cmp, false, ff_parallel_runner(nullptr, nw));
+}
+//! Parallel sort of [first,last( in ascending order (radix sort for integral keys)
+template<typename Iter>
+static void parallel_sort(Iter first, Iter last) {
+    parallel_sort(first, last, std::less<typename std::iterator_traits<Iter>::value_type>());
+}
+//! Parallel stable sort of [first,last( with the comparator cmp
+template<typename Iter, typename Compare>
+static void parallel_stable_sort(Iter first, Iter last, Compare cmp, const long nw=FF_AUTO) {
+    parsort(first, last, cmp, true, ff_parallel_runner(nullptr, nw));
+}
+//! Parallel stable sort of [first,last( in ascending order
+template<typename Iter>
+static void parallel_stable_sort(Iter first, Iter last) {
+    parallel_stable_sort(first, last, std::less<typename std::iterator_traits<Iter>::value_type>());
+}
+
+//! Parallel sort of [first,last( on the Worker threads of pf
+template<typename Iter, typename Compare>
+static void parallel_sort(ParallelFor& pf, Iter first, Iter last, Compare cmp, const long nw=FF_AUTO) {
+    parsort(first, last, cmp, false, ff_parallel_runner(&pf, nw));
+}
+template<typename Iter>
+static void parallel_sort(ParallelFor& pf, Iter first, Iter last) {
+    parallel_sort(pf, first, last, std::less<typename std::iterator_traits<Iter>::value_type>());
+}
+//! Parallel stable sort of [first,last( on the Worker threads of pf
+template<typename Iter, typename Compare>
+static void parallel_stable_sort(ParallelFor& pf, Iter first, Iter last, Compare cmp, const long nw=FF_AUTO) {
+    parsort(first, last, cmp, true, ff_parallel_runner(&pf, nw));
+}
+template<typename Iter>
+static void parallel_stable_sort(ParallelFor& pf, Iter first, Iter last) {
+    parallel_stable_sort(pf, first, last, std::less<typename std::iterator_traits<Iter>::value_type>());
+}
+
+} // namespace ff
+
+#endif /* FF_PARALLEL_SORT_HPP */
@@ -47,6 +47,7 @@ namespace ff {
 // forward declarations
 class ff_pipeline;
 static inline int optimize_static(ff_pipeline&, const OptLevel&);
+static inline int fuse_pipeline_stages(ff_pipeline&, const OptLevel&);
 template<typename T>    
 static inline int combine_with_firststage(ff_pipeline&,T*,bool=false);
 template<typename T>    
@@ -67,6 +68,7 @@ static const svector<ff_node*>& isa2a_getsecondset(ff_node*);
 class ff_pipeline: public ff_node {
 
     friend inline int optimize_static(ff_pipeline&, const OptLevel&);
+    friend inline int fuse_pipeline_stages(ff_pipeline&, const OptLevel&);
     template<typename T> 
     friend inline int combine_with_firststage(ff_pipeline&,T*,bool);
     template<typename T>
@@ -1388,6 +1390,92 @@ public:
             error("PIPE: output buffer not created");
         return false;        
     }
+
+    /** 
+     * \brief offload a batch of tasks to the pipeline (accelerator mode)
+     * 
+     * The tasks are pushed into the input queue with one call and (in
+     * blocking mode) with a single wake-up of the first stage.
+     *
+     * \return the number of tasks offloaded, it is less than \p n only if
+     * the input queue has been full for \p retry attempts (non-blocking mode)
+     */
+    inline size_t offload_n(void * const tasks[], size_t n,
+                            unsigned long retry=((unsigned long)-1),
+                            unsigned long ticks=ff_node::TICKS2WAIT) {
+        FFBUFFER * inbuffer = get_in_buffer();
+        assert(inbuffer != NULL);
+
+        size_t i=0;
+        if (ff_node::blocking_out) {
+            while(true) {
+                while(i<n && inbuffer->push(tasks[i])) ++i;
+                pthread_cond_signal(p_cons_c);
+                if (i==n) return n;
+                struct timespec tv;
+                timedwait_timeout(tv);
+                pthread_mutex_lock(prod_m);
+                pthread_cond_timedwait(prod_c, prod_m, &tv);
+                pthread_mutex_unlock(prod_m);
+            }
+        }
+        for(unsigned long r=0;i<n;) {
+            if (inbuffer->push(tasks[i])) { ++i; r=0; continue; }
+            if (++r >= retry) break;
+            losetime_out(ticks);
+        }
+        return i;
+    }
+
+    /** 
+     * \brief gets a batch of results from the pipeline (accelerator mode)
+     * 
+     * It waits at most \p timeout_us microseconds for the first result, then
+     * it takes (without waiting) the results available, up to \p max.
+     * If the EOS is received, it is the last element stored in \p out.
+     *
+     * \return the number of elements stored in \p out (0 if the timeout expired)
+     */
+    inline size_t load_results(void ** out, size_t max, unsigned long timeout_us=0) {
+        FFBUFFER * outbuffer = get_out_buffer();
+        if (!outbuffer) {
+            if (!has_input_channel) 
+                error("PIPE: accelerator is not set, offload not available");
+            else
+                error("PIPE: output buffer not created");
+            return 0;
+        }
+        const unsigned long start = timeout_us ? getusec() : 0;
+        size_t n=0;
+        while(true) {
+            while(n<max && outbuffer->pop(&out[n]))
+                if (out[n++] == (void*)FF_EOS) return n;
+            if (n || !timeout_us || (getusec()-start) >= timeout_us) return n;
+            if (ff_node::blocking_in) {
+                struct timespec tv;
+                timedwait_timeout(tv);
+                pthread_mutex_lock(cons_m);
+                pthread_cond_timedwait(cons_c, cons_m, &tv);
+                pthread_mutex_unlock(cons_m);
+            } else losetime_in(ff_node::TICKS2WAIT);
+        }
+    }
+
+    /** 
+     * \brief the results of the accelerator are passed to \p cb instead of
+     * being loaded with load_result(s)
+     *
+     * \p cb is called by the thread of an additional last stage, one result
+     * at a time (the EOS is not passed). It must be called before running
+     * the pipeline.
+     */
+    int set_completion_callback(const std::function<void(void*)>& cb) {
+        if (prepared) {
+            error("PIPE, set_completion_callback, the PIPE has already been prepared\n");
+            return -1;
+        }
+        return add_stage(new ff_completion_node(cb), true);
+    }
     
 
     int cardinality() const { 
@@ -0,0 +1,168 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \link
+ * \file recycle.hpp
+ * \ingroup building_blocks
+ *
+ * \brief Typed object pool recycling the messages of an edge back to the producer
+ *
+ * @detail The producer of an edge allocates its messages from the pool, the
+ * last consumer gives them back through a dedicated SPSC return channel
+ * instead of freeing them. The memory of the messages is reused by the
+ * producer, so the general-purpose allocator (and the cross-thread frees)
+ * are out of the data path.
+ *
+ * The pool is a standalone building block, it is not wired into the
+ * pipeline/farm edges: the nodes using it get the pool from the user code
+ * and call get/put explicitly.
+ *
+ */
+
+#ifndef FF_RECYCLE_HPP
+#define FF_RECYCLE_HPP
+
+/* ***************************************************************************
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#include <atomic>
+#include <cassert>
+#include <new>
+#include <utility>
+#include <vector>
+#include <type_traits>
+#include <ff/buffer.hpp>
+#include <ff/utils.hpp>
+
+namespace ff {
+
+// n. of objects each return channel can hold, when a channel is full the
+// objects given back are freed
+#if !defined(DEF_RECYCLE_CAPACITY)
+#define DEF_RECYCLE_CAPACITY  (2*DEFAULT_BUFFER_CAPACITY)
+#endif
+
+/*!
+ *  \class ff_recycle_pool
+ *  \ingroup building_blocks
+ *
+ *  \brief Pool of objects of type T recycled from the consumers to the producer.
+ *
+ *  The pool has one SPSC return channel for each consumer. The producer
+ *  thread (only one) creates the objects with \p get: the memory is taken
+ *  from the return channels and it is allocated only if they are all empty.
+ *  The consumer thread \p i destroys the objects with \p put(obj, i), their
+ *  memory is pushed into the return channel \p i.
+ *
+ *  Typically the producer is a pipeline stage (or a farm emitter) and the
+ *  consumers are the last stage (or the farm workers, using get_my_id()
+ *  as consumer id).
+ *
+ *  NOTE: the pool is not known to the run-time, it has to be wired in by
+ *        hand: the same pool is given to the producer and to the consumers
+ *        (e.g. in their constructors), and each consumer must use its own
+ *        id. Two consumers giving back objects with the same id break the
+ *        single-producer assumption of the return channel.
+ *
+ *  NOTE: all the objects created by the pool must be given back before
+ *        deleting the pool.
+ *
+ *  This class is defined in \ref recycle.hpp
+ */
+template<typename T>
+class ff_recycle_pool {
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_t;
+public:
+    ff_recycle_pool(size_t nconsumers=1, size_t capacity=DEF_RECYCLE_CAPACITY):
+        dropped(nconsumers?nconsumers:1) {
+        if (nconsumers==0) nconsumers=1;
+        for(size_t i=0;i<nconsumers;++i) {
+            SWSR_Ptr_Buffer *ch = new SWSR_Ptr_Buffer(capacity?capacity:1);
+            if (!ch->init()) error("RECYCLE, unable to initialize the return channel %ld\n", (long)i);
+            R.push_back(ch);
+        }
+    }
+    ~ff_recycle_pool() {
+        void *p;
+        for(auto ch: R) {
+            while(ch->pop(&p)) delete reinterpret_cast<storage_t*>(p);
+            delete ch;
+        }
+    }
+
+    /**
+     * \brief Creates an object T(args...), it is called by the producer.
+     */
+    template<typename... Args>
+    T* get(Args&&... args) {
+        void *p = nullptr;
+        const size_t n = R.size();
+        for(size_t i=0;i<n;++i) {
+            const size_t id = (next+i) % n;
+            if (R[id]->pop(&p)) {
+                next = id;
+                ++recycled;
+                break;
+            }
+        }
+        if (!p) {
+            p = new storage_t;
+            ++allocated;
+        }
+        return new (p) T(std::forward<Args>(args)...);
+    }
+
+    /**
+     * \brief Destroys the object \p t and gives its memory back to the
+     * producer, it is called by the consumer \p consumer
+     * (0 <= consumer < get_num_consumers()).
+     */
+    void put(T* t, size_t consumer) {
+        assert(consumer < R.size());
+        t->~T();
+        if (!R[consumer]->push(t)) {
+            // the return channel is full
+            delete reinterpret_cast<storage_t*>(static_cast<void*>(t));
+            dropped[consumer].n.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    size_t get_num_consumers() const { return R.size(); }
+    /// n. of objects whose memory has been allocated (producer side)
+    size_t get_num_allocated() const { return allocated; }
+    /// n. of objects whose memory has been recycled (producer side)
+    size_t get_num_recycled()  const { return recycled; }
+    /// n. of objects freed because their return channel was full
+    size_t get_num_dropped()   const {
+        size_t n=0;
+        for(auto& d: dropped) n += d.n.load(std::memory_order_relaxed);
+        return n;
+    }
+
+protected:
+    // one counter per consumer, in different cache lines
+    struct alignas(CACHE_LINE_SIZE) counter_t { std::atomic<size_t> n{0}; };
+
+    std::vector<SWSR_Ptr_Buffer*> R;
+    std::vector<counter_t>        dropped;
+    size_t                        next = 0, allocated = 0, recycled = 0;
+};
+
+} // namespace ff
+
+#endif /* FF_RECYCLE_HPP */
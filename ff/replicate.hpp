@@ -0,0 +1,321 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \link
+ * \file replicate.hpp
+ * \ingroup building_blocks
+ *
+ * \brief Pipeline stage that is replicated at run-time when it becomes the bottleneck
+ *
+ * @detail The stage is implemented as a farm having up to \p max_replicas
+ * copies of the (stateless) node. The emitter measures the utilization of the
+ * active replicas and activates (thaws) or deactivates (freezes) replicas
+ * accordingly.
+ *
+ */
+
+#ifndef FF_REPLICATE_HPP
+#define FF_REPLICATE_HPP
+
+/* ***************************************************************************
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#include <atomic>
+#include <vector>
+#include <ff/node.hpp>
+#include <ff/multinode.hpp>
+#include <ff/farm.hpp>
+
+namespace ff {
+
+/*!
+ * \brief Parameters of the replication policy.
+ *
+ * Every \p period_us microseconds the emitter computes the average utilization U
+ * (svc time over elapsed time) of the active replicas. If U is greater than
+ * \p high and the previous stage is waiting for the replicated one, for \p samples
+ * consecutive periods, a new replica is activated. The previous stage is waiting
+ * if in the period the emitter found the input queues of all the active replicas
+ * full, or if at the end of the period at least \p backlog tasks per active
+ * replica are queued. The idleness of the next stage is not measured.
+ * If the utilization estimated with one replica less (U*n/(n-1)) is lower than
+ * \p low for \p samples consecutive periods, the last active replica is deactivated.
+ */
+struct replication_policy {
+    double        high      = 0.9;
+    double        low       = 0.6;
+    unsigned long period_us = 10000;
+    int           samples   = 2;
+    size_t        backlog   = 1;
+};
+
+/*!
+ * \brief Wrapper of one replica, it accounts the time spent in the svc method.
+ */
+class replica_worker: public ff_node {
+public:
+    replica_worker(ff_node* node, bool cleanup=true): node(node),cleanup(cleanup) {
+        node->registerCallback(send_out_cb, this);
+    }
+    ~replica_worker() { if (cleanup) delete node; }
+
+    void *svc(void *task) {
+        const ticks t0 = getticks();
+        void *r = node->svc(task);
+        busy.store(busy.load(std::memory_order_relaxed)+(getticks()-t0), std::memory_order_relaxed);
+        return r;
+    }
+    int  svc_init() {
+        started.store(1, std::memory_order_release);
+        ff_word_wake(&started);
+        return node->svc_init();
+    }
+    void svc_end()  { node->svc_end(); }
+    void eosnotify(ssize_t id) { node->eosnotify(id); }
+
+    ticks get_busy() const { return busy.load(std::memory_order_relaxed); }
+    bool  is_started() const { return started.load(std::memory_order_acquire)!=0; }
+    void  reset_started()    { started.store(0, std::memory_order_relaxed); }
+    /// it blocks until the thread of the replica has (re-)started
+    void  wait_started() {
+        while(!is_started()) ff_word_wait(&started, 0);
+    }
+
+protected:
+    static bool send_out_cb(void *task, int id, unsigned long retry, unsigned long ticks, void *obj) {
+        return reinterpret_cast<replica_worker*>(obj)->ff_send_out(task, id, retry, ticks);
+    }
+
+    ff_node           *node;
+    const bool         cleanup;
+    std::atomic<ticks> busy{0};
+    std::atomic<int>   started{0};
+};
+
+/*!
+ * \brief Emitter of the replicated stage, it implements the replication policy.
+ *
+ * The replicas [0, nactive) are active. A replica is deactivated by setting
+ * its freezing flag and by sending it a GO_OUT (it goes to sleep once its queue
+ * has been drained). It is activated again by thawing it.
+ * A replica whose thread has not started yet cannot be frozen, it stays
+ * PENDING (i.e. it does not receive tasks) until it starts.
+ * A thawed replica receives tasks immediately, the emitter waits for its
+ * restart only at the end of the stream (see eosnotify).
+ */
+class replica_emitter: public ff_monode {
+    enum { ACTIVE, PENDING, DRAINING, FROZEN };
+public:
+    replica_emitter(const std::vector<replica_worker*>& R, size_t initial, const replication_policy& policy):
+        R(R),state(R.size(),ACTIVE),snapshot(R.size(),0),initial(initial),policy(policy) {}
+
+    int svc_init() {
+        // svc_init is called again if the farm is re-started after freezing
+        if (nactive) return 0;
+        nactive = R.size();
+        while(nactive > initial) deactivate();
+        max_active = nactive;
+        last_us = getusec();
+        last_t  = getticks();
+        return 0;
+    }
+
+    void *svc(void *task) {
+        if (npending) freeze_pending();
+        if ((getusec() - last_us) >= policy.period_us) adapt();
+        // non-blocking attempt on each active replica, then blocking send
+        for(size_t i=0;i<nactive;++i) {
+            const size_t id = (next+i) % nactive;
+            if (ff_send_out_to(task, (int)id, 1)) {
+                next = id+1;
+                return GO_ON;
+            }
+        }
+        ++nstalls;  // all the queues are full, the previous stage has to wait
+        ff_send_out_to(task, (int)(next++ % nactive));
+        return GO_ON;
+    }
+
+    // the frozen replicas have to receive the EOS
+    void eosnotify(ssize_t=-1) {
+        const size_t m = max_active;
+        for(size_t i=nactive;i<R.size();++i) activate(i);
+        max_active = m;
+        // a thawed replica that has not yet restarted would terminate
+        // without draining its queue if the farm's wait is called
+        for(size_t i=0;i<R.size();++i) R[i]->wait_started();
+    }
+
+    size_t get_active()    const { return nactive; }
+    size_t get_max_active() const { return max_active; }
+    size_t get_scaleup()   const { return scaleup; }
+    size_t get_scaledown() const { return scaledown; }
+
+protected:
+    void adapt() {
+        const unsigned long now_us = getusec();
+        const ticks now = getticks();
+        const double elapsed = (double)(now - last_t);
+        ticks busy=0;
+        for(size_t i=0;i<nactive;++i) busy += R[i]->get_busy() - snapshot[i];
+        const double U = (elapsed>0) ? busy / (elapsed*nactive) : 0.0;
+
+        if (U > policy.high && nactive < R.size() && upstream_waiting()) {
+            nhigh++; nlow=0;
+        } else if (nactive > 1 && (U*nactive)/(nactive-1) < policy.low) {
+            nlow++; nhigh=0;
+        } else nhigh = nlow = 0;
+
+        if (nhigh >= policy.samples) {
+            activate(nactive);
+            ++scaleup; nhigh=0;
+        } else if (nlow >= policy.samples) {
+            deactivate();
+            ++scaledown; nlow=0;
+        }
+        for(size_t i=0;i<R.size();++i) snapshot[i] = R[i]->get_busy();
+        nstalls = 0;
+        last_us = now_us;
+        last_t  = getticks();
+    }
+
+    // true if the previous stage is waiting for this one
+    bool upstream_waiting() {
+        if (nstalls) return true;
+        const svector<ff_node*>& W = ff_monode::getlb()->getWorkers();
+        size_t queued = 0;
+        for(size_t i=0;i<nactive;++i) {
+            FFBUFFER* b = W[i]->get_in_buffer();
+            if (b) queued += b->length();
+        }
+        return queued >= policy.backlog*nactive;
+    }
+
+    void freeze(size_t id) {
+        ff_loadbalancer *lb = ff_monode::getlb();
+        R[id]->reset_started();
+        lb->freeze(id);
+        // bypassing the lb policy (e.g. the ordering one), GO_OUT is not a data element
+        lb->ff_loadbalancer::ff_send_out_to(FF_GO_OUT, (int)id);
+        state[id] = DRAINING;
+    }
+    void freeze_pending() {
+        for(size_t i=nactive;i<R.size();++i)
+            if (state[i] == PENDING && R[i]->is_started()) {
+                freeze(i);
+                --npending;
+            }
+    }
+    void deactivate() {
+        const size_t id = --nactive;
+        if (R[id]->is_started()) freeze(id);
+        else {
+            state[id] = PENDING;
+            ++npending;
+        }
+    }
+    void activate(size_t id) {
+        ff_loadbalancer *lb = ff_monode::getlb();
+        if (state[id] == PENDING) --npending;
+        if (state[id] == DRAINING) {
+            // the replica must be frozen before being thawed, otherwise
+            // the GO_OUT could be received after the thaw.
+            lb->wait_freezing(id);
+            state[id] = FROZEN;
+        }
+        if (state[id] == FROZEN) lb->thaw(id, false);
+        state[id] = ACTIVE;
+        if (id == nactive) ++nactive;
+        if (nactive > max_active) max_active = nactive;
+    }
+
+protected:
+    const std::vector<replica_worker*> R;
+    std::vector<int>   state;
+    std::vector<ticks> snapshot;
+    const size_t       initial;
+    const replication_policy policy;
+    size_t        nactive=0, npending=0, next=0, max_active=0;
+    size_t        scaleup=0, scaledown=0, nstalls=0;
+    int           nhigh=0, nlow=0;
+    unsigned long last_us=0;
+    ticks         last_t=0;
+};
+
+/*!
+ *  \class ff_replicable_stage
+ *  \ingroup building_blocks
+ *
+ *  \brief A stateless pipeline stage replicated at run-time when it is the bottleneck.
+ *
+ *  The node \p T must be stateless and copy-constructible: the copies are the
+ *  replicas of the stage. The stage is a farm with \p max_replicas workers, only
+ *  \p initial of them are active at the beginning. When the utilization of the
+ *  active replicas stays close to 100% and the previous stage is waiting for
+ *  them (i.e. the stage is the bottleneck, see replication_policy) one more
+ *  replica is activated, when the load drops the replicas are deactivated
+ *  (frozen) one at a time.
+ *  If \p ordered is true the output stream keeps the input order.
+ *
+ *  NOTE: svc_init and svc_end of a replica are called each time it is
+ *        activated and deactivated. Use the blocking mode to avoid that
+ *        inactive replicas spin on their input queue.
+ *        The stage is meant to be run with run/run_and_wait_end.
+ *
+ *  This class is defined in \ref replicate.hpp
+ */
+template<typename T>
+class ff_replicable_stage: public ff_farm {
+public:
+    ff_replicable_stage(const T& node, size_t max_replicas=ff_numCores(), bool ordered=false,
+                        size_t initial=1, const replication_policy& policy=replication_policy()) {
+        if (max_replicas==0) max_replicas=1;
+        if (initial==0 || initial>max_replicas) initial = max_replicas;
+        std::vector<ff_node*> W;
+        for(size_t i=0;i<max_replicas;++i) {
+            replica_worker *r = new replica_worker(new T(node), true);
+            R.push_back(r);
+            W.push_back(r);
+        }
+        emitter = new replica_emitter(R, initial, policy);
+        add_emitter(emitter);
+        add_workers(W);
+        add_collector(nullptr);
+        cleanup_all();
+        if (ordered) {
+            set_ordered();
+            set_scheduling_ondemand();
+        }
+    }
+
+    size_t get_max_replicas() const { return R.size(); }
+    /// n. of replicas currently active
+    size_t get_active_replicas() const { return emitter->get_active(); }
+    /// the maximum n. of replicas that have been active at the same time
+    size_t get_max_active_replicas() const { return emitter->get_max_active(); }
+    size_t get_num_scaleup()   const { return emitter->get_scaleup(); }
+    size_t get_num_scaledown() const { return emitter->get_scaledown(); }
+
+protected:
+    std::vector<replica_worker*> R;
+    replica_emitter             *emitter;
+};
+
+} // namespace ff
+
+#endif /* FF_REPLICATE_HPP */
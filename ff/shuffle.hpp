@@ -0,0 +1,224 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \link
+ * \file shuffle.hpp
+ * \ingroup building_blocks
+ *
+ * \brief Hash-partitioned shuffle for the nodes of the first set of an all-to-all
+ *
+ * @detail The first-set node partitions its output records by key, buffers
+ * them in per-destination batches and sends one batch per channel operation.
+ * An optional combiner pre-aggregates records having the same key.
+ *
+ */
+
+#ifndef FF_SHUFFLE_HPP
+#define FF_SHUFFLE_HPP
+
+/* ***************************************************************************
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <ff/node.hpp>
+#include <ff/multinode.hpp>
+
+namespace ff {
+
+// default number of records buffered for each destination before sending
+#if !defined(DEF_SHUFFLE_BATCH)
+#define DEF_SHUFFLE_BATCH      256
+#endif
+// default maximum time (microseconds) a record can stay in a non-full batch
+#if !defined(DEF_SHUFFLE_FLUSH_US)
+#define DEF_SHUFFLE_FLUSH_US   1000
+#endif
+
+/*!
+ * \brief The message exchanged between the two sets of the all-to-all.
+ *
+ * \p from is the id of the first-set node that produced the batch.
+ * The receiver owns the batch and has to delete it.
+ */
+template<typename T>
+struct ff_shuffle_batch {
+    ssize_t        from = -1;
+    std::vector<T> data;
+};
+
+/*!
+ *  \class ff_shuffle_node
+ *  \ingroup building_blocks
+ *
+ *  \brief Multi-output node partitioning its records by key (first set of an ff_a2a).
+ *
+ *  In the \p svc method the user calls \p shuffle for each output record
+ *  instead of \p ff_send_out_to. The destination is selected by the
+ *  \p partition method (by default hash(key) modulo the number of output channels).
+ *  A batch is sent when it contains \p batchsize records, when its oldest record
+ *  is older than \p flush_us microseconds (checked after each \p svc call and
+ *  while the node waits for input, see ff_node::idle_in), and at the end of
+ *  the stream.
+ *
+ *  If a combiner is given, records with the same key that are in the same
+ *  batch are merged with \p combiner(acc, rec) so that each batch contains at
+ *  most one record per key.
+ *
+ *  NOTE: if the \p eosnotify method is redefined, ff_shuffle_node::eosnotify
+ *        must be called to flush the pending batches.
+ *
+ *  This class is defined in \ref shuffle.hpp
+ */
+template<typename IN_t, typename T, typename K=T, typename Hash=std::hash<K> >
+class ff_shuffle_node: public ff_monode_t<IN_t, ff_shuffle_batch<T> > {
+public:
+    typedef ff_shuffle_batch<T>                    batch_t;
+    typedef std::function<K(const T&)>             key_f;
+    typedef std::function<void(T&, const T&)>      combiner_f;
+
+    using ff_monode_t<IN_t, batch_t>::svc;
+
+    ff_shuffle_node(key_f key, size_t batchsize=DEF_SHUFFLE_BATCH,
+                    unsigned long flush_us=DEF_SHUFFLE_FLUSH_US,
+                    combiner_f combiner=nullptr):
+        key(key),combiner(combiner),batchsize(batchsize?batchsize:1),flush_us(flush_us) {}
+
+    virtual ~ff_shuffle_node() {
+        for(size_t i=0;i<batches.size();++i) delete batches[i];
+    }
+
+    /**
+     * \brief Buffers the record \p rec into the batch of its destination.
+     */
+    inline void shuffle(const T& rec) {
+        const K k = key(rec);
+        const size_t d = destination(k);
+        batch_t *b = batches[d];
+        if (combiner) {
+            auto it = index[d].find(k);
+            if (it != index[d].end()) {
+                combiner(b->data[it->second], rec);
+                ++combined;
+                return;
+            }
+            index[d].emplace(k, b->data.size());
+        }
+        if (b->data.empty()) {
+            if (flush_us) first_us[d] = getusec();
+            ++pending;
+        }
+        b->data.push_back(rec);
+        ++records;
+        if (b->data.size() >= batchsize) flush(d);
+    }
+
+    /**
+     * \brief Sends the batch of destination \p d (if not empty).
+     */
+    void flush(size_t d) {
+        if (d >= batches.size() || batches[d]->data.empty()) return;
+        batch_t *b = batches[d];
+        b->from = this->get_my_id();
+        batches[d] = new batch_t;
+        batches[d]->data.reserve(batchsize);
+        if (combiner) index[d].clear();
+        --pending;
+        this->ff_send_out_to(b, (int)d);
+        ++sent;
+    }
+
+    /**
+     * \brief Sends the batches whose oldest record is older than \p flush_us.
+     */
+    void flush_expired() {
+        if (!flush_us || !pending) return;
+        const unsigned long now = getusec();
+        for(size_t i=0;i<batches.size();++i)
+            if (!batches[i]->data.empty() && (now-first_us[i]) >= flush_us)
+                flush(i);
+    }
+
+    /**
+     * \brief Sends all pending batches.
+     */
+    void flush() {
+        for(size_t i=0;i<batches.size();++i) flush(i);
+    }
+
+    void *svc(void *task) {
+        void *r = svc(reinterpret_cast<IN_t*>(task));
+        if (!r || r==FF_EOS || r==FF_EOSW) {
+            flush();
+            return r;
+        }
+        flush_expired();
+        return r;
+    }
+
+    // a quiet input stream does not delay the partial batches
+    void idle_in() { flush_expired(); }
+
+    void eosnotify(ssize_t=-1) { flush(); }
+
+    size_t get_num_records()  const { return records; }   ///< records buffered
+    size_t get_num_combined() const { return combined; }  ///< records merged by the combiner
+    size_t get_num_batches()  const { return sent; }      ///< batches sent
+
+protected:
+    /**
+     * \brief Selects the destination of key \p k among \p n output channels.
+     *
+     * It can be redefined to implement a different partitioning policy,
+     * it must always return the same value for the same key.
+     */
+    virtual size_t partition(const K& k, size_t n) { return hasher(k) % n; }
+
+    inline size_t destination(const K& k) {
+        if (batches.size()==0) setup();
+        return partition(k, batches.size());
+    }
+
+    void setup() {
+        size_t n = this->get_num_outchannels();
+        if (n==0) n=1;
+        batches.resize(n);
+        for(size_t i=0;i<n;++i) {
+            batches[i] = new batch_t;
+            batches[i]->data.reserve(batchsize);
+        }
+        first_us.resize(n, 0);
+        if (combiner) index.resize(n);
+    }
+
+protected:
+    key_f                   key;
+    combiner_f              combiner;
+    Hash                    hasher;
+    const size_t            batchsize;
+    const unsigned long     flush_us;
+    std::vector<batch_t*>   batches;
+    std::vector<unsigned long> first_us;
+    std::vector<std::unordered_map<K,size_t,Hash> > index;
+    size_t records=0, combined=0, sent=0, pending=0;
+};
+
+} // namespace ff
+
+#endif /* FF_SHUFFLE_HPP */
@@ -0,0 +1,410 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \link
+ * \file stream.hpp
+ * \ingroup high_level_patterns
+ *
+ * \brief Fluent stream operators (map, filter, flatMap, keyBy/reduce, sink)
+ * lowered to a FastFlow graph
+ *
+ * @detail Example:
+ *
+ *     auto g = ff::stream<long>(gen)
+ *                .parallel(4)
+ *                .map([](long& x) { return x*x; })
+ *                .filter([](long& x) { return x % 3; })
+ *                .keyBy([](long& x) { return x % 10; })
+ *                .reduce(0L, [](long& acc, long& x) { acc += x; })
+ *                .sink([](std::pair<long,long>& r) { ... });
+ *     g.run_and_wait_end();
+ *
+ */
+
+#ifndef FF_STREAM_HPP
+#define FF_STREAM_HPP
+
+/* ***************************************************************************
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <type_traits>
+#include <ff/node.hpp>
+#include <ff/multinode.hpp>
+#include <ff/pipeline.hpp>
+#include <ff/farm.hpp>
+#include <ff/all2all.hpp>
+#include <ff/combine.hpp>
+
+namespace ff {
+
+/* ---------------------------------------------------------------------------
+ *  Internal representation of the stream: a source followed by a list of
+ *  segments. A segment is a sequence of stateless operators executed with the
+ *  same parallelism degree, optionally terminated by a keyed reduction.
+ *  The elements flow through the graph as heap-allocated objects.
+ * --------------------------------------------------------------------------- */
+
+/// continuation called for each element produced by an operator
+typedef std::function<void(void*)>               stream_fn_t;
+/// stateless operator, given the continuation it returns the operator's continuation
+typedef std::function<stream_fn_t(stream_fn_t)>  stream_op_t;
+
+struct stream_segment_t {
+    std::vector<stream_op_t>        ops;
+    size_t                          par = 1;
+    // keyed reduction (nreducers > 0)
+    size_t                          nreducers = 0;
+    std::function<size_t(void*)>    hash;
+    std::function<ff_node*()>       reducer;
+};
+
+struct stream_plan_t {
+    std::function<void(const stream_fn_t&)> source;
+    std::vector<stream_segment_t>           segments;
+};
+
+/**
+ * \internal
+ * \brief Node executing the fused stateless operators of a segment.
+ *
+ * If the node is a multi-output node, the elements are either sent
+ * round-robin or routed by key (\p hash) to the output channels.
+ * If the node has a source, the source is executed in the first svc call.
+ */
+template<typename Base>
+struct stream_node: Base {
+    stream_node(const std::vector<stream_op_t>& ops,
+                const std::function<size_t(void*)>& hash=nullptr,
+                const std::function<void(const stream_fn_t&)>& source=nullptr):
+        hash(hash), source(source) {
+        stream_fn_t last;
+        if constexpr (std::is_base_of<ff_monode, Base>::value) {
+            if (hash)
+                last = [this](void* t) {
+                    this->ff_send_out_to(t, (int)(this->hash(t) % this->get_num_outchannels()));
+                };
+            else last = [this](void* t) { this->ff_send_out(t); };
+        } else
+            last = [this](void* t) { this->ff_send_out(t); };
+        fn = last;
+        for(size_t i=ops.size(); i>0; --i) fn = ops[i-1](fn);
+    }
+    void *svc(void *t) {
+        if (source) {
+            source(fn);
+            return this->EOS;
+        }
+        fn(t);
+        return this->GO_ON;
+    }
+
+    stream_fn_t                                fn;
+    const std::function<size_t(void*)>         hash;
+    const std::function<void(const stream_fn_t&)> source;
+};
+
+/**
+ * \internal
+ * \brief Keyed reduction, it keeps one accumulator per key and sends out
+ * the (key, accumulator) pairs at the end of the stream.
+ */
+template<typename T, typename K, typename A>
+struct stream_reducer: ff_minode {
+    stream_reducer(const std::function<K(T&)>& key, const A& init,
+                   const std::function<void(A&, T&)>& f):
+        key(key), init(init), f(f) {}
+
+    void *svc(void *p) {
+        T *t = reinterpret_cast<T*>(p);
+        const K k = key(*t);
+        auto it = M.find(k);
+        if (it == M.end()) it = M.emplace(k, init).first;
+        f(it->second, *t);
+        delete t;
+        return GO_ON;
+    }
+    void eosnotify(ssize_t) {
+        if (++neos < get_num_inchannels()) return;
+        for(auto& kv: M) ff_send_out(new std::pair<K,A>(kv.first, kv.second));
+        M.clear();
+    }
+
+    const std::function<K(T&)>       key;
+    const A                          init;
+    const std::function<void(A&,T&)> f;
+    std::unordered_map<K,A>          M;
+    size_t                           neos = 0;
+};
+
+/*!
+ *  \class ff_stream_graph
+ *  \ingroup high_level_patterns
+ *
+ *  \brief The FastFlow graph a stream has been lowered to.
+ *
+ *  The lowering tries to use as few threads as possible:
+ *   - consecutive stateless operators with the same parallelism degree are
+ *     fused in a single node (the first ones also with the source);
+ *   - stateless operators with parallelism degree n>1 are executed by a farm
+ *     with n workers, without collector if the farm is the last stage;
+ *   - keyBy/reduce is an all-to-all: the first set executes the operators
+ *     preceding keyBy and partitions the elements by key, the second set
+ *     executes the reduction;
+ *   - the sink is fused with the operators preceding it.
+ *
+ *  This class is defined in \ref stream.hpp
+ */
+class ff_stream_graph: public ff_pipeline {
+public:
+    ff_stream_graph(const stream_plan_t& plan) {
+        const std::vector<stream_segment_t>& S = plan.segments;
+        size_t k = 0;
+        // the first sequential segment is fused with the source
+        std::vector<stream_op_t> first;
+        if (S[0].par == 1 && S[0].nreducers == 0) first = S[k++].ops;
+        const bool next_keyed = (k < S.size() && S[k].nreducers > 0);
+        if (next_keyed)
+            add_stage(new stream_node<ff_monode>(first, nullptr, plan.source), true);
+        else
+            add_stage(new stream_node<ff_node>(first, nullptr, plan.source), true);
+
+        bool   prev_multi = false;  // the previous stage is an all-to-all
+        size_t prev_card  = 1;
+        for(; k<S.size(); ++k) {
+            const stream_segment_t& s = S[k];
+            const bool next_keyed = (k+1 < S.size() && S[k+1].nreducers > 0);
+            if (s.nreducers > 0) {
+                std::vector<ff_node*> W1, W2;
+                // after an all-to-all, the first set is connected point-to-point to
+                // the previous reducers
+                const size_t n = prev_multi ? prev_card : s.par;
+                for(size_t i=0;i<n;++i) W1.push_back(make_node(s.ops, false, true, s.hash));
+                for(size_t i=0;i<s.nreducers;++i) W2.push_back(s.reducer());
+                ff_a2a *a2a = new ff_a2a;
+                a2a->add_firstset(W1, 0, true);
+                a2a->add_secondset(W2, true);
+                add_stage(a2a, true);
+                prev_multi = true;
+                prev_card  = s.nreducers;
+                continue;
+            }
+            if (s.ops.empty()) continue;
+            if (s.par == 1) {
+                add_stage(make_node(s.ops, prev_multi, next_keyed, nullptr), true);
+            } else {
+                std::vector<ff_node*> W;
+                for(size_t i=0;i<s.par;++i) W.push_back(new stream_node<ff_node>(s.ops));
+                // the collector distributes the elements to the next all-to-all
+                ff_node *c = next_keyed ? new stream_node<ff_monode>(std::vector<stream_op_t>()) : nullptr;
+                ff_farm *farm = new ff_farm(W, nullptr, c);
+                farm->cleanup_all();
+                // the last stage (e.g. the sink is fused in the workers) needs no collector
+                if (!has_next_stage(S, k)) farm->remove_collector();
+                add_stage(farm, true);
+            }
+            prev_multi = false;
+        }
+    }
+
+protected:
+    // true if a stage follows the segment k
+    static bool has_next_stage(const std::vector<stream_segment_t>& S, size_t k) {
+        for(size_t i=k+1;i<S.size();++i)
+            if (S[i].nreducers > 0 || !S[i].ops.empty()) return true;
+        return false;
+    }
+
+    static ff_node* make_node(const std::vector<stream_op_t>& ops, bool multi_in, bool multi_out,
+                              const std::function<size_t(void*)>& hash) {
+        if (!multi_in && !multi_out) return new stream_node<ff_node>(ops);
+        if ( multi_in && !multi_out) return new stream_node<ff_minode>(ops);
+        if (!multi_in &&  multi_out) return new stream_node<ff_monode>(ops, hash);
+        // multi-input and multi-output node
+        return new ff_comb(new stream_node<ff_minode>(ops),
+                           new stream_node<ff_monode>(std::vector<stream_op_t>()), true, true);
+    }
+};
+
+template<typename T> class ff_stream;
+
+/*!
+ *  \class ff_keyed_stream
+ *  \ingroup high_level_patterns
+ *
+ *  \brief A stream partitioned by key, see ff_stream::keyBy.
+ *
+ *  This class is defined in \ref stream.hpp
+ */
+template<typename T, typename K>
+class ff_keyed_stream {
+public:
+    ff_keyed_stream(std::shared_ptr<stream_plan_t> plan, const std::function<K(T&)>& key, size_t n):
+        plan(plan), key(key), nreducers(n) {}
+
+    /**
+     * \brief Per-key reduction, \p f(acc, x) accumulates x in the accumulator of
+     * its key (initially \p init). At the end of the stream, the (key, accumulator)
+     * pairs are produced.
+     */
+    template<typename A, typename F>
+    ff_stream<std::pair<K,A> > reduce(const A& init, F f) {
+        stream_segment_t& s = plan->segments.back();
+        const std::function<K(T&)> k = key;
+        s.nreducers = nreducers ? nreducers : s.par;
+        s.hash      = [k](void* t) { return std::hash<K>()(k(*reinterpret_cast<T*>(t))); };
+        const std::function<void(A&,T&)> g = f;
+        s.reducer   = [k, init, g]() -> ff_node* { return new stream_reducer<T,K,A>(k, init, g); };
+        plan->segments.push_back(stream_segment_t());
+        return ff_stream<std::pair<K,A> >(plan);
+    }
+
+protected:
+    std::shared_ptr<stream_plan_t> plan;
+    const std::function<K(T&)>     key;
+    const size_t                   nreducers;
+};
+
+/*!
+ *  \class ff_stream
+ *  \ingroup high_level_patterns
+ *
+ *  \brief Fluent description of a stream computation (see \ref stream).
+ *
+ *  The operators must be thread-safe: they are called by the replicas of a
+ *  stage when the parallelism degree is greater than one. The element type
+ *  must be default-constructible and movable.
+ *
+ *  This class is defined in \ref stream.hpp
+ */
+template<typename T>
+class ff_stream {
+public:
+    typedef T value_type;
+
+    ff_stream(std::shared_ptr<stream_plan_t> plan): plan(plan) {}
+
+    /// x -> f(x)
+    template<typename F>
+    ff_stream<typename std::decay<typename std::invoke_result<F,T&>::type>::type> map(F f) {
+        typedef typename std::decay<typename std::invoke_result<F,T&>::type>::type U;
+        add([f](stream_fn_t next) -> stream_fn_t {
+            return [f, next](void* p) {
+                T *t = reinterpret_cast<T*>(p);
+                if constexpr (std::is_same<T,U>::value) {
+                    *t = f(*t);
+                    next(t);
+                } else {
+                    U *u = new U(f(*t));
+                    delete t;
+                    next(u);
+                }
+            };
+        });
+        return ff_stream<U>(plan);
+    }
+
+    /// it keeps the elements x such that p(x) is true
+    template<typename P>
+    ff_stream<T> filter(P p) {
+        add([p](stream_fn_t next) -> stream_fn_t {
+            return [p, next](void* e) {
+                T *t = reinterpret_cast<T*>(e);
+                if (p(*t)) next(t); else delete t;
+            };
+        });
+        return *this;
+    }
+
+    /// x -> f(x)[0], f(x)[1], ... (f returns a container)
+    template<typename F>
+    ff_stream<typename std::decay<typename std::invoke_result<F,T&>::type>::type::value_type> flatMap(F f) {
+        typedef typename std::decay<typename std::invoke_result<F,T&>::type>::type::value_type U;
+        add([f](stream_fn_t next) -> stream_fn_t {
+            return [f, next](void* p) {
+                T *t = reinterpret_cast<T*>(p);
+                for(auto& u: f(*t)) next(new U(std::move(u)));
+                delete t;
+            };
+        });
+        return ff_stream<U>(plan);
+    }
+
+    /// the following operators are executed by \p n replicas
+    ff_stream<T> parallel(size_t n) {
+        if (n == 0) n = 1;
+        stream_segment_t& s = plan->segments.back();
+        if (s.par == n) return *this;
+        if (s.ops.empty()) s.par = n;
+        else {
+            plan->segments.push_back(stream_segment_t());
+            plan->segments.back().par = n;
+        }
+        return *this;
+    }
+
+    /**
+     * \brief Partitions the stream by the key \p k(x) among \p n reducers
+     * (by default, as many as the current parallelism degree).
+     */
+    template<typename F>
+    ff_keyed_stream<T, typename std::decay<typename std::invoke_result<F,T&>::type>::type> keyBy(F k, size_t n=0) {
+        typedef typename std::decay<typename std::invoke_result<F,T&>::type>::type K;
+        return ff_keyed_stream<T,K>(plan, std::function<K(T&)>(k), n);
+    }
+
+    /// the last operator, it returns the graph to be executed
+    template<typename F>
+    ff_stream_graph sink(F f) {
+        add([f](stream_fn_t) -> stream_fn_t {
+            return [f](void* p) {
+                T *t = reinterpret_cast<T*>(p);
+                f(*t);
+                delete t;
+            };
+        });
+        return ff_stream_graph(*plan);
+    }
+
+protected:
+    void add(const stream_op_t& op) { plan->segments.back().ops.push_back(op); }
+
+    std::shared_ptr<stream_plan_t> plan;
+};
+
+/**
+ * \brief Creates a stream whose elements are produced by \p gen: gen(x) stores
+ * the next element in x and returns false at the end of the stream.
+ */
+template<typename T, typename G>
+static inline ff_stream<T> stream(G gen) {
+    std::shared_ptr<stream_plan_t> plan = std::make_shared<stream_plan_t>();
+    plan->source = [gen](const stream_fn_t& emit) mutable {
+        T x;
+        while(gen(x)) emit(new T(std::move(x)));
+    };
+    plan->segments.push_back(stream_segment_t());
+    return ff_stream<T>(plan);
+}
+
+} // namespace ff
+
+#endif /* FF_STREAM_HPP */
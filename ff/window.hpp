@@ -0,0 +1,431 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \link
+ * \file window.hpp
+ * \ingroup building_blocks
+ *
+ * \brief Windowed streaming aggregation (tumbling, sliding and session windows)
+ *
+ * @detail Count-based and time-based windows, keyed or global, with
+ * incremental aggregation. Sliding windows are split in panes (the greatest
+ * common divisor of size and slide), the aggregates of the panes are kept in a
+ * two-stack FIFO so that each input element costs O(1) amortized
+ * independently of the window size.
+ *
+ */
+
+#ifndef FF_WINDOW_HPP
+#define FF_WINDOW_HPP
+
+/* ***************************************************************************
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#include <cstdint>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <ff/node.hpp>
+#include <ff/multinode.hpp>
+#include <ff/farm.hpp>
+
+namespace ff {
+
+/*!
+ * \brief Window specification.
+ *
+ * Sizes, slides and gaps are numbers of elements for COUNT windows and
+ * time units (as returned by the timestamp function) for TIME windows.
+ * Session windows are time-based: a session is closed when no element of
+ * the key arrives for \p gap time units.
+ */
+struct ff_window_spec {
+    enum kind_t { TUMBLING, SLIDING, SESSION };
+    enum unit_t { COUNT, TIME };
+
+    static ff_window_spec tumbling(uint64_t size, unit_t unit=COUNT) {
+        return ff_window_spec(TUMBLING, unit, size, size);
+    }
+    static ff_window_spec sliding(uint64_t size, uint64_t slide, unit_t unit=COUNT) {
+        return ff_window_spec(SLIDING, unit, size, slide);
+    }
+    static ff_window_spec session(uint64_t gap) {
+        return ff_window_spec(SESSION, TIME, gap, gap);
+    }
+
+    kind_t   kind;
+    unit_t   unit;
+    uint64_t size, slide;   // for sessions, size=slide=gap
+
+protected:
+    ff_window_spec(kind_t kind, unit_t unit, uint64_t size, uint64_t slide):
+        kind(kind), unit(unit), size(size?size:1), slide(slide?slide:1) {}
+};
+
+/*!
+ * \brief Result of a window: the aggregate of the \p count elements of the
+ * key \p key in [start, end).
+ */
+template<typename K, typename A>
+struct ff_window_result {
+    K        key;
+    uint64_t start, end;
+    size_t   count;
+    A        value;
+};
+
+/*!
+ * \brief FIFO aggregation with two stacks (amortized O(1) push, pop and query).
+ *
+ * The combine function must be associative, it is not required to be commutative.
+ */
+template<typename V>
+class ff_two_stacks {
+public:
+    typedef std::function<V(const V&, const V&)> combine_t;
+
+    ff_two_stacks(const V& identity, const combine_t& combine):
+        identity(identity), combine(combine), back_agg(identity) {}
+
+    void push(const V& v) {
+        back.push_back(v);
+        back_agg = combine(back_agg, v);
+    }
+    void pop() {
+        if (front.empty()) {
+            // moving the elements, front.back() is the oldest one and it
+            // holds the aggregate of all the elements in front
+            V agg = identity;
+            for(size_t i=back.size(); i>0; --i) {
+                agg = combine(back[i-1], agg);
+                front.push_back(agg);
+            }
+            back.clear();
+            back_agg = identity;
+        }
+        front.pop_back();
+    }
+    /// aggregate of all the elements, from the oldest to the newest
+    V query() const {
+        if (front.empty()) return back_agg;
+        return combine(front.back(), back_agg);
+    }
+    size_t size() const { return front.size() + back.size(); }
+    void clear() { front.clear(); back.clear(); back_agg = identity; }
+
+protected:
+    const V           identity;
+    const combine_t   combine;
+    std::vector<V>    front, back;
+    V                 back_agg;
+};
+
+/*!
+ *  \class ff_window_node
+ *  \ingroup building_blocks
+ *
+ *  \brief Window operator: it aggregates the input elements of each key in windows.
+ *
+ *  The aggregate of a window is computed by \p add (it adds one element to a
+ *  partial aggregate) and \p combine (it merges two partial aggregates, it must
+ *  be associative), \p init is the identity of combine.
+ *  If \p key is nullptr, the windows are global. \p ts returns the timestamp
+ *  of an element (TIME windows), the timestamps of a key must be non-decreasing.
+ *
+ *  The results (ff_window_result) are produced as soon as the windows close:
+ *  for TIME windows when an element with a later timestamp is received by the
+ *  node. At the end of the stream the open windows are produced too (also the
+ *  partial COUNT windows). Windows without elements are not produced.
+ *
+ *  The node is multi-input, so that it can be used in the second set of an
+ *  all-to-all whose first set routes the elements by key (see ff_window_farm
+ *  for a ready-made keyed parallel operator).
+ *  If \p cleanup is true the input elements are deleted.
+ *
+ *  This class is defined in \ref window.hpp
+ */
+template<typename T, typename K, typename A>
+class ff_window_node: public ff_minode_t<T, ff_window_result<K,A> > {
+public:
+    typedef ff_window_result<K,A>                  result_t;
+    typedef std::function<void(A&, const T&)>      add_t;
+    typedef std::function<A(const A&, const A&)>   combine_t;
+    typedef std::function<K(const T&)>             key_t;
+    typedef std::function<uint64_t(const T&)>      ts_t;
+
+    ff_window_node(const ff_window_spec& spec, const A& init, const add_t& add, const combine_t& combine,
+                   const key_t& key=nullptr, const ts_t& ts=nullptr, bool cleanup=true):
+        spec(spec), init(init), add(add), combine(combine), key(key), ts(ts), cleanup(cleanup) {
+        pane = gcd(spec.size, spec.slide);
+        np   = spec.size  / pane;
+        ns   = spec.slide / pane;
+    }
+
+    int svc_init() {
+        if (spec.unit == ff_window_spec::TIME && !ts) {
+            error("WINDOW, time-based windows require a timestamp function\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    result_t* svc(T* t) {
+        const K k = key ? key(*t) : K();
+        if (spec.kind == ff_window_spec::SESSION) session_add(k, *t);
+        else                                      pane_add(k, *t);
+        if (cleanup) delete t;
+        return this->GO_ON;
+    }
+
+    void eosnotify(ssize_t=-1) {
+        if (++neos < this->get_num_inchannels()) return;
+        for(auto& s: S)  flush(s.first, s.second);
+        S.clear();
+        for(auto& s: SS) emit(s.first, s.second.start, s.second.last + spec.size, s.second.count, s.second.agg);
+        SS.clear();
+    }
+
+    size_t get_num_windows() const { return nwindows; }
+    /// n. of keys having an open window
+    size_t get_num_keys()    const { return S.size() + SS.size(); }
+
+protected:
+    struct pane_t { A agg; size_t count; };
+
+    // state of a key (tumbling and sliding windows)
+    struct state_t {
+        state_t(const ff_window_node* w):
+            fifo(pane_t{w->init, 0}, [w](const pane_t& a, const pane_t& b) {
+                    return pane_t{w->combine(a.agg, b.agg), a.count + b.count}; }),
+            cur_agg(w->init) {}
+        ff_two_stacks<pane_t> fifo;     // panes [first, next)
+        uint64_t first=0, next=0;       // first pane of the next window, next pane to be queued
+        uint64_t cur=0;                 // current (open) pane
+        A        cur_agg;
+        size_t   cur_count=0, queued=0;
+        uint64_t nelements=0;
+    };
+    // state of a key (session windows)
+    struct session_t {
+        uint64_t start=0, last=0;
+        size_t   count=0;
+        A        agg;
+    };
+
+    static uint64_t gcd(uint64_t a, uint64_t b) {
+        while(b) { uint64_t r = a % b; a = b; b = r; }
+        return a;
+    }
+    // first pane of the first window containing the pane p
+    uint64_t first_window(uint64_t p) const {
+        if (p+1 <= np) return 0;
+        return ((p + 1 - np + ns - 1) / ns) * ns;
+    }
+
+    void emit(const K& k, uint64_t start, uint64_t end, size_t count, const A& value) {
+        ++nwindows;
+        this->ff_send_out(new result_t{k, start, end, count, value});
+    }
+
+    // it queues the pane p, producing the windows that are complete
+    void push(const K& k, state_t& s, uint64_t p, const A& agg, size_t count) {
+        if (p < s.first) return;            // the pane does not belong to any window
+        s.fifo.push(pane_t{agg, count});
+        s.queued += count;
+        ++s.next;
+        if (s.fifo.size() < np) return;
+        const pane_t w = s.fifo.query();
+        if (w.count) emit(k, s.first*pane, s.first*pane + spec.size, w.count, w.agg);
+        for(uint64_t i=0; i<ns && s.fifo.size(); ++i) s.fifo.pop();
+        s.queued = s.fifo.size() ? s.fifo.query().count : 0;
+        s.first += ns;
+        if (s.next < s.first) s.next = s.first;
+    }
+
+    // it closes all the panes before p
+    void advance(const K& k, state_t& s, uint64_t p) {
+        push(k, s, s.cur, s.cur_agg, s.cur_count);
+        while(s.next < p) {
+            if (s.queued == 0) {
+                // nothing to produce before the pane p
+                reset(s, p);
+                break;
+            }
+            push(k, s, s.next, init, 0);
+        }
+        s.cur       = p;
+        s.cur_agg   = init;
+        s.cur_count = 0;
+    }
+
+    // it moves to the first window containing the pane p, the panes before
+    // p are empty (they are less than the panes of a window)
+    void reset(state_t& s, uint64_t p) {
+        const uint64_t f = first_window(p);
+        if (f > s.first) s.first = f;
+        s.fifo.clear();
+        for(s.next = s.first; s.next < p; ++s.next) s.fifo.push(pane_t{init, 0});
+    }
+
+    void pane_add(const K& k, const T& t) {
+        auto it = S.find(k);
+        const bool isnew = (it == S.end());
+        if (isnew) it = S.emplace(k, state_t(this)).first;
+        state_t& s = it->second;
+        const uint64_t now = (spec.unit == ff_window_spec::TIME) ? ts(t) : 0;
+        const uint64_t p   = (spec.unit == ff_window_spec::TIME) ? now / pane : s.nelements++ / pane;
+        if (isnew) {
+            reset(s, p);
+            s.cur = p;
+        }
+        else if (p > s.cur) advance(k, s, p);
+        add(s.cur_agg, t);
+        ++s.cur_count;
+        if (spec.unit == ff_window_spec::TIME) watermark(now);
+    }
+
+    void flush(const K& k, state_t& s) {
+        advance(k, s, s.cur + np);
+    }
+
+    void session_add(const K& k, const T& t) {
+        const uint64_t now = ts(t);
+        auto it = SS.find(k);
+        if (it != SS.end() && now > it->second.last + spec.size) {
+            session_t& s = it->second;
+            emit(k, s.start, s.last + spec.size, s.count, s.agg);
+            SS.erase(it);
+            it = SS.end();
+        }
+        if (it == SS.end()) {
+            it = SS.emplace(k, session_t()).first;
+            it->second.start = now;
+            it->second.agg   = init;
+        }
+        session_t& s = it->second;
+        s.last = now;
+        ++s.count;
+        add(s.agg, t);
+        watermark(now);
+    }
+
+    // time-based windows of the keys not receiving elements are closed
+    // periodically (every slide/gap), using the latest timestamp received
+    void watermark(uint64_t now) {
+        if (now < next_scan) return;
+        next_scan = now + spec.slide;
+        if (spec.kind == ff_window_spec::SESSION) {
+            for(auto it=SS.begin(); it!=SS.end();) {
+                session_t& s = it->second;
+                if (now > s.last + spec.size) {
+                    emit(it->first, s.start, s.last + spec.size, s.count, s.agg);
+                    it = SS.erase(it);
+                } else ++it;
+            }
+            return;
+        }
+        const uint64_t p = now / pane;
+        for(auto it=S.begin(); it!=S.end();) {
+            state_t& s = it->second;
+            if (s.cur < p) advance(it->first, s, p);
+            // idle key, its state can be removed
+            if (s.queued == 0 && s.cur_count == 0) it = S.erase(it);
+            else ++it;
+        }
+    }
+
+protected:
+    const ff_window_spec spec;
+    const A              init;
+    const add_t          add;
+    const combine_t      combine;
+    const key_t          key;
+    const ts_t           ts;
+    const bool           cleanup;
+    uint64_t             pane, np, ns;  // pane size, panes per window, panes per slide
+    uint64_t             next_scan = 0;
+    size_t               neos = 0, nwindows = 0;
+    std::unordered_map<K, state_t>   S;
+    std::unordered_map<K, session_t> SS;
+};
+
+/**
+ * \internal
+ * \brief Emitter of the ff_window_farm, it routes the elements by key.
+ */
+template<typename T, typename K>
+struct window_key_router: ff_monode_t<T> {
+    window_key_router(const std::function<K(const T&)>& key): key(key) {}
+    T* svc(T* t) {
+        this->ff_send_out_to(t, (int)(std::hash<K>()(key(*t)) % this->get_num_outchannels()));
+        return this->GO_ON;
+    }
+    const std::function<K(const T&)> key;
+};
+
+/*!
+ *  \class ff_window_farm
+ *  \ingroup building_blocks
+ *
+ *  \brief Keyed window operator executed by \p nworkers ff_window_node(s).
+ *
+ *  The emitter partitions the keys among the workers (all the elements of a
+ *  key are aggregated by the same worker), the collector gathers the results.
+ *  The order of the results of different keys is not specified.
+ *
+ *  This class is defined in \ref window.hpp
+ */
+template<typename T, typename K, typename A>
+class ff_window_farm: public ff_farm {
+public:
+    typedef ff_window_node<T,K,A> node_t;
+
+    ff_window_farm(size_t nworkers, const ff_window_spec& spec, const A& init,
+                   const typename node_t::add_t& add, const typename node_t::combine_t& combine,
+                   const typename node_t::key_t& key, const typename node_t::ts_t& ts=nullptr,
+                   bool cleanup=true) {
+        if (nworkers == 0) nworkers = 1;
+        if (!key) {
+            error("WINDOW, ff_window_farm requires a key function\n");
+            return;
+        }
+        std::vector<ff_node*> W;
+        for(size_t i=0;i<nworkers;++i) {
+            node_t *w = new node_t(spec, init, add, combine, key, ts, cleanup);
+            N.push_back(w);
+            W.push_back(w);
+        }
+        add_emitter(new window_key_router<T,K>(key));
+        add_workers(W);
+        add_collector(nullptr);
+        cleanup_all();
+    }
+
+    size_t get_num_windows() const {
+        size_t n = 0;
+        for(auto w: N) n += w->get_num_windows();
+        return n;
+    }
+
+protected:
+    std::vector<node_t*> N;
+};
+
+} // namespace ff
+
+#endif /* FF_WINDOW_HPP */
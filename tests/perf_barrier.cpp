@@ -0,0 +1,121 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+/*
+ * Barrier latency: average time of one barrier for an increasing number
+ * of threads, for each barrier implementation (the pthread barrier,
+ * the central counter spinBarrier, the treeBarrier and the
+ * disseminationBarrier).
+ *
+ *   perf_barrier [max-threads [num-barriers]]
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <ff/node.hpp>
+#include <ff/barrier.hpp>
+
+using namespace ff;
+
+static std::vector<long> data;
+
+class Thread: public ff_node {
+public:
+    Thread(ffBarrier& bar, int nbarriers, int nthreads):
+        bar(bar), nbarriers(nbarriers), nthreads(nthreads) {}
+
+    void* svc(void*) {
+        const size_t id = get_my_id();
+        for(int i=0;i<nbarriers;++i) {
+            ++data[id];
+            bar.doBarrier(id);
+            // nobody can be ahead or behind
+            for(int j=0;j<nthreads;++j)
+                if (data[j] != i+1) {
+                    printf("ERROR: thread %d at barrier %ld, expected %d\n", j, data[j], i+1);
+                    abort();
+                }
+            bar.doBarrier(id);
+        }
+        return EOS;
+    }
+    void set_id(ssize_t id) { ff_node::set_id(id); }
+    int run(bool=false)  { return ff_node::run();}
+    int wait()           { return ff_node::wait();}
+private:
+    ffBarrier& bar;
+    const int  nbarriers, nthreads;
+};
+
+// returns the average time of one barrier in microseconds
+static double bench(ffBarrier& bar, int nthreads, int nbarriers) {
+    bar.barrierSetup(nthreads);
+    data.assign(nthreads, 0);
+    std::vector<Thread*> T(nthreads);
+    for(int i=0;i<nthreads;++i) {
+        T[i] = new Thread(bar, nbarriers, nthreads);
+        T[i]->set_id(i);
+    }
+    ffTime(START_TIME);
+    for(int i=0;i<nthreads;++i) T[i]->run();
+    for(int i=0;i<nthreads;++i) T[i]->wait();
+    ffTime(STOP_TIME);
+    for(int i=0;i<nthreads;++i) delete T[i];
+    return ffTime(GET_TIME)*1000.0/(2.0*nbarriers);
+}
+
+int main(int argc, char* argv[]) {
+    int maxthreads = (int)ff_numCores();
+    int nbarriers  = 10000;
+    if (argc>1) {
+        maxthreads = atoi(argv[1]);
+        if (argc>2) nbarriers = atoi(argv[2]);
+    }
+    if (maxthreads<=0 || nbarriers<=0) {
+        printf("use: %s max-threads num-barriers\n", argv[0]);
+        return -1;
+    }
+    Barrier              pbar(maxthreads);
+    spinBarrier          sbar(maxthreads);
+    treeBarrier          tbar(maxthreads);
+    disseminationBarrier dbar(maxthreads);
+
+    printf("%8s %12s %12s %12s %12s  (us per barrier)\n",
+           "threads", "pthread", "spin", "tree", "dissemination");
+    for(int n=1; n<=maxthreads; n = (n<maxthreads && 2*n>maxthreads) ? maxthreads : 2*n) {
+        const double p = bench(pbar, n, nbarriers);
+        const double s = bench(sbar, n, nbarriers);
+        const double t = bench(tbar, n, nbarriers);
+        const double d = bench(dbar, n, nbarriers);
+        printf("%8d %12.3f %12.3f %12.3f %12.3f\n", n, p, s, t, d);
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+
+/*
+ * Performance test of parallel_sort: std::sort vs ff::parallel_sort on
+ * integral keys (radix sort) and on doubles (merge sort).
+ * Compile with -DUSE_PSTL to compare also with std::sort(std::execution::par, ...)
+ * (with g++ it requires TBB, -ltbb).
+ *
+ */
+
+#include <cstdio>
+#include <cstdint>
+#include <random>
+#include <vector>
+#if defined(USE_PSTL)
+#include <execution>
+#endif
+#include <ff/ff.hpp>
+#include <ff/parallel_sort.hpp>
+
+using namespace ff;
+
+template<typename T, typename Compare>
+static void bench(const char* name, const std::vector<T>& A, Compare cmp, long nw) {
+    std::vector<T> E(A), R(A);
+
+    ffTime(START_TIME);
+    std::sort(E.begin(), E.end(), cmp);
+    ffTime(STOP_TIME);
+    printf("%-8s std::sort           Time = %g (ms)\n", name, ffTime(GET_TIME));
+
+#if defined(USE_PSTL)
+    ffTime(START_TIME);
+    std::sort(std::execution::par, R.begin(), R.end(), cmp);
+    ffTime(STOP_TIME);
+    printf("%-8s std::sort(par)      Time = %g (ms)\n", name, ffTime(GET_TIME));
+    R = A;
+#endif
+
+    ffTime(START_TIME);
+    parallel_sort(R.begin(), R.end(), cmp, nw);
+    ffTime(STOP_TIME);
+    printf("%-8s ff::parallel_sort   Time = %g (ms) (%ld Workers)\n", name, ffTime(GET_TIME), nw);
+    if (R != E) printf("ERROR: wrong result\n");
+
+    R = A;
+    ffTime(START_TIME);
+    parallel_stable_sort(R.begin(), R.end(), cmp, nw);
+    ffTime(STOP_TIME);
+    printf("%-8s ff::parallel_stable Time = %g (ms) (%ld Workers)\n", name, ffTime(GET_TIME), nw);
+    if (R != E) printf("ERROR: wrong result\n");
+}
+
+int main(int argc, char *argv[]) {
+    long n  = 10000000;
+    long nw = ff_numCores();
+    if (argc>1) {
+        if (argc<3) {
+            printf("use: %s size nworkers\n", argv[0]);
+            return -1;
+        }
+        n  = atol(argv[1]);
+        nw = atol(argv[2]);
+    }
+    std::mt19937_64 gen(1);
+    {
+        std::vector<int64_t> A(n);
+        for(auto& a: A) a = (int64_t)gen();
+        bench("int64_t", A, std::less<int64_t>(), nw);
+    }
+    {
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+        std::vector<double> A(n);
+        for(auto& a: A) a = dist(gen);
+        bench("double", A, std::less<double>(), nw);
+    }
+    return 0;
+}
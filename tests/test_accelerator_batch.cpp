@@ -0,0 +1,175 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+/*
+ * Accelerator mode with batch offload (offload_n), batch results
+ * (load_results) and with the completion callback.
+ *
+ *  main --offload_n--> pipe/farm --load_results--> main
+ *  main --offload_n--> pipe/farm --callback (collector/last stage thread)
+ *
+ */
+
+#include <iostream>
+#include <atomic>
+#include <vector>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+struct Stage: ff_node_t<long> {
+    long* svc(long* t) { *t += 1; return t; }
+};
+
+static const size_t BATCH = 64;
+
+// offloads ntasks tasks in batches, then the EOS, collecting the results in batches
+template<typename ACC>
+static long offload_and_load(ACC& acc, long ntasks) {
+    std::vector<void*> in(BATCH), out(BATCH);
+    long sum = 0;
+    bool eos = false;
+    auto collect = [&](unsigned long timeout_us) {
+        const size_t n = acc.load_results(out.data(), out.size(), timeout_us);
+        for(size_t i=0;i<n;++i) {
+            if (out[i] == (void*)FF_EOS) { eos = true; break; }
+            sum += *(long*)out[i];
+            delete (long*)out[i];
+        }
+    };
+    for(long i=0;i<ntasks;) {
+        size_t n = 0;
+        for(; n<BATCH && i<ntasks; ++n, ++i) in[n] = new long(i);
+        if (acc.offload_n(in.data(), n) != n) {
+            error("offload_n\n");
+            return -1;
+        }
+        collect(0);
+    }
+    acc.offload((void*)FF_EOS);
+    while(!eos) collect(1000);
+    return sum;
+}
+
+int main(int argc, char* argv[]) {
+    long ntasks = 100000;
+    if (argc>1) ntasks = std::stol(argv[1]);
+    const long expected = ntasks*(ntasks+1)/2;
+
+    // pipeline accelerator, the accelerator is run and frozen several times
+    {
+        ff_pipeline pipe(true);
+        pipe.add_stage(new Stage, true);
+        pipe.add_stage(new Stage, true);
+        for(int k=0;k<3;++k) {
+            if (pipe.run_then_freeze()<0) {
+                error("running pipe\n");
+                return -1;
+            }
+            const long sum = offload_and_load(pipe, ntasks);
+            if (pipe.wait_freezing()<0) {
+                error("freezing pipe\n");
+                return -1;
+            }
+            if (sum != expected + ntasks) {
+                std::cerr << "pipeline: wrong result " << sum << "\n";
+                return -1;
+            }
+        }
+        pipe.wait();
+        std::cout << "pipeline, load_results: OK\n";
+    }
+    // farm accelerator
+    {
+        ff_farm farm(true);
+        std::vector<ff_node*> W;
+        for(int i=0;i<3;++i) W.push_back(new Stage);
+        farm.add_workers(W);
+        farm.add_collector(nullptr);
+        farm.cleanup_workers();
+        if (farm.run_then_freeze()<0) {
+            error("running farm\n");
+            return -1;
+        }
+        const long sum = offload_and_load(farm, ntasks);
+        farm.wait();
+        if (sum != expected) {
+            std::cerr << "farm: wrong result " << sum << "\n";
+            return -1;
+        }
+        std::cout << "farm, load_results: OK\n";
+    }
+    // completion callbacks, the main thread never polls
+    {
+        std::atomic<long> sum_farm{0}, sum_pipe{0};
+        ff_farm farm(true);
+        std::vector<ff_node*> W;
+        for(int i=0;i<3;++i) W.push_back(new Stage);
+        farm.add_workers(W);
+        farm.cleanup_workers();
+        farm.set_completion_callback([&](void* r) {
+                sum_farm.store(sum_farm.load(std::memory_order_relaxed) + *(long*)r, std::memory_order_relaxed);
+                delete (long*)r;
+            });
+        ff_pipeline pipe(true);
+        pipe.add_stage(new Stage, true);
+        pipe.set_completion_callback([&](void* r) {
+                sum_pipe.store(sum_pipe.load(std::memory_order_relaxed) + *(long*)r, std::memory_order_relaxed);
+                delete (long*)r;
+            });
+        if (farm.run()<0 || pipe.run()<0) {
+            error("running accelerators\n");
+            return -1;
+        }
+        std::vector<void*> in(BATCH);
+        for(ff_node* acc: {(ff_node*)&farm, (ff_node*)&pipe}) {
+            for(long i=0;i<ntasks;) {
+                size_t n = 0;
+                for(; n<BATCH && i<ntasks; ++n, ++i) in[n] = new long(i);
+                const size_t r = (acc == &farm) ? farm.offload_n(in.data(), n) : pipe.offload_n(in.data(), n);
+                if (r != n) {
+                    error("offload_n\n");
+                    return -1;
+                }
+            }
+        }
+        farm.offload((void*)FF_EOS);
+        pipe.offload((void*)FF_EOS);
+        if (farm.wait()<0 || pipe.wait()<0) {
+            error("waiting accelerators\n");
+            return -1;
+        }
+        if (sum_farm != expected || sum_pipe != expected) {
+            std::cerr << "callbacks: wrong result " << sum_farm << " " << sum_pipe << "\n";
+            return -1;
+        }
+        std::cout << "farm and pipeline, completion callback: OK\n";
+    }
+    return 0;
+}
@@ -0,0 +1,130 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as 
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+/*
+ *    first _    _ second
+ *           |  |
+ *    first _| -|- second          (NUMA-aware placement and routing)
+ *           |  |
+ *    first -    - second
+ *
+ * With on-demand scheduling the run-time can prefer the nodes of the second
+ * set running on the same NUMA node. With round-robin scheduling all the nodes
+ * of the second set have to receive messages.
+ */
+
+#include <iostream>
+#include <atomic>
+#include <ff/ff.hpp>
+using namespace ff;
+
+static std::atomic<long> received{0};
+
+struct firstStage: ff_node_t<long> { 
+    firstStage(long ntasks):ntasks(ntasks) {}
+    long *svc(long*) {
+        for(long i=0;i<ntasks;++i) ff_send_out(new long(i));
+        return EOS;
+    }
+    long ntasks;
+};
+struct secondStage: ff_node_t<long> {  
+    long *svc(long *task) {
+        ++received;
+        ++mine;
+        delete task;
+        return GO_ON; 
+    }
+    long mine=0;
+}; 
+
+static int run(size_t nw1, size_t nw2, long ntasks, int ondemand,
+               const std::vector<std::vector<int> >& topo) {
+    received = 0;
+    std::vector<ff_node*> W1;
+    std::vector<secondStage*> W2;
+    for(size_t i=0;i<nw1;++i) W1.push_back(new firstStage(ntasks));
+    for(size_t i=0;i<nw2;++i) W2.push_back(new secondStage);
+    
+    ff_a2a a2a;
+    a2a.add_firstset(W1, ondemand, true);
+    a2a.add_secondset(W2, true);
+    a2a.numa_mapping();
+    
+    if (a2a.run_and_wait_end()<0) {
+        error("running A2A");
+        return -1;
+    }
+    const size_t local  = a2a.get_numa_local_messages();
+    const size_t remote = a2a.get_numa_remote_messages();
+    std::cout << "ondemand= " << ondemand << " local messages= " << local << " remote messages= " << remote << "\n";
+    if (received != (long)nw1*ntasks) {
+        std::cerr << "ERROR: received " << received << " tasks\n";
+        return -1;
+    }
+    if (!ondemand) {
+        for(size_t j=0;j<nw2;++j)
+            if (W2[j]->mine == 0) {
+                std::cerr << "ERROR: round-robin, node " << j << " of the second set starved\n";
+                return -1;
+            }
+    }
+#if !defined(NO_DEFAULT_MAPPING)
+    if ((local+remote) != (size_t)nw1*ntasks) {
+        std::cerr << "ERROR: wrong number of messages counted\n";
+        return -1;
+    }
+    if (topo.size()==1 && remote != 0) {
+        std::cerr << "ERROR: remote messages on a single NUMA node system\n";
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    size_t nw1    = 4;
+    size_t nw2    = 4;
+    long   ntasks = 10000;
+    if (argc>1) {
+        if (argc!=4) {
+            std::cerr << "use: " << argv[0] << " nw1 nw2 ntasks\n";
+            return -1;
+        }
+        nw1    = std::stol(argv[1]);
+        nw2    = std::stol(argv[2]);
+        ntasks = std::stol(argv[3]);
+    }
+    std::vector<std::vector<int> > topo;
+    std::cout << "NUMA nodes: " << ff_numaTopology(topo) << "\n";
+
+    if (run(nw1, nw2, ntasks, 1, topo)<0) return -1;
+    if (run(nw1, nw2, ntasks, 0, topo)<0) return -1;
+    return 0;
+}
@@ -0,0 +1,168 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+/*
+ * Futures returned by an accelerator farm (ff_async_farm):
+ * out of order completion, wait, then, when_all (also over futures with a
+ * continuation) and recycling of the states.
+ *
+ *            |--> Worker --|
+ *  main  --> |--> Worker --|--> (Collector)  the futures are completed by the
+ *            |--> Worker --|                  workers or by the collector
+ */
+
+#include <iostream>
+#include <atomic>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/async.hpp>
+
+using namespace ff;
+
+struct task_t {
+    long  value;
+    long  sleep_us;
+};
+
+struct Worker: ff_node_t<task_t, long> {
+    long* svc(task_t* t) {
+        if (t->sleep_us) usleep(t->sleep_us);
+        long *r = new long(t->value * 2);
+        delete t;
+        return r;
+    }
+};
+
+static int run(bool use_collector, long ntasks) {
+    std::vector<ff_node*> W;
+    for(int i=0;i<3;++i) W.push_back(new Worker);
+    ff_async_farm farm(W, use_collector, true);
+    if (farm.run()<0) {
+        error("running farm\n");
+        return -1;
+    }
+    // a slow task does not block the following ones
+    ff_future slow = farm.async(new task_t{1, 200000});
+    {
+        std::vector<ff_future> F;
+        for(long i=0;i<10;++i) F.push_back(farm.async(new task_t{i, 0}));
+        for(long i=0;i<10;++i) {
+            long *r = (long*)F[i].wait();
+            if (*r != 2*i) {
+                std::cerr << "wrong result\n";
+                return -1;
+            }
+            delete r;
+        }
+        if (!slow.ready()) std::cout << "fast tasks completed before the slow one\n";
+    }
+    long *r = (long*)slow.wait();
+    if (*r != 2) {
+        std::cerr << "wrong result\n";
+        return -1;
+    }
+    delete r;
+
+    // continuations and when_all, several rounds to check the recycling of the states
+    std::atomic<long> sum{0};
+    const int nrounds = 10;
+    for(int k=0;k<nrounds;++k) {
+        std::vector<ff_future> F;
+        for(long i=0;i<ntasks;++i) F.push_back(farm.async(new task_t{i, 0}));
+        ff_future all = ff_when_all(F);
+        // the results are taken from the futures
+        all.wait();
+        for(auto& f: F) {
+            if (!f.ready()) {
+                std::cerr << "when_all completed before its futures\n";
+                return -1;
+            }
+            long *x = (long*)f.get();
+            sum += *x;
+            delete x;
+        }
+    }
+    if (sum != nrounds*ntasks*(ntasks-1)) {
+        std::cerr << "wrong sum " << sum << "\n";
+        return -1;
+    }
+    // when_all over futures that already have a continuation, both are called
+    for(int k=0;k<nrounds;++k) {
+        std::atomic<long> nfirst{0};
+        std::vector<ff_future> F;
+        for(long i=0;i<ntasks;++i) {
+            F.push_back(farm.async(new task_t{i, (i%10)?0:1000}));
+            F.back().then([&nfirst](void*) { ++nfirst; });
+        }
+        ff_future all = ff_when_all(F);
+        all.wait();
+        if (nfirst != ntasks) {
+            std::cerr << "when_all: continuations lost or called after when_all " << nfirst << "\n";
+            return -1;
+        }
+        for(auto& f: F) delete (long*)f.get();
+    }
+    std::atomic<long> sum2{0}, ncont{0};
+    {
+        std::vector<ff_future> F;
+        for(long i=0;i<ntasks;++i) {
+            F.push_back(farm.async(new task_t{i, 0}));
+            F.back().then([&](void* x) {
+                    sum2 += *(long*)x;
+                    delete (long*)x;
+                    ++ncont;
+                });
+        }
+    }
+    farm.offload(FF_EOS);
+    if (farm.wait()<0) {
+        error("waiting farm\n");
+        return -1;
+    }
+    if (ncont != ntasks || sum2 != ntasks*(ntasks-1)) {
+        std::cerr << "wrong continuations " << ncont << " " << sum2 << "\n";
+        return -1;
+    }
+    std::cout << (use_collector ? "collector" : "workers") << ": OK, "
+              << farm.get_num_states() << " shared states allocated for "
+              << (2*nrounds+1)*ntasks+2*nrounds+11 << " futures\n";
+    if (farm.get_num_states() > (size_t)(ntasks+2+DEF_ASYNC_POOL)) {
+        std::cerr << "the shared states have not been recycled\n";
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    long ntasks = 100;
+    if (argc>1) ntasks = std::stol(argv[1]);
+    if (run(false, ntasks)<0) return -1;
+    if (run(true, ntasks)<0)  return -1;
+    return 0;
+}
@@ -0,0 +1,130 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+
+/*  
+ *   Source --> fuse(Filter, Dup, Tail) --> Sink
+ *
+ *   fuse(Source, Filter, Dup, Tail) --> Sink
+ *
+ *   The fused stages are executed by a single node without queues between them.
+ *   Filter drops the odd elements (GO_ON), Dup sends out each element twice 
+ *   (ff_send_out), Tail changes the type and sends out a marker at the end 
+ *   of the stream.
+ */
+
+#include <iostream>
+#include <ff/ff.hpp>
+using namespace ff;
+
+struct res_t { long v; };
+
+struct Source: ff_node_t<long> {
+    Source(long ntasks): ntasks(ntasks) {}
+    long *svc(long *) {
+        for(long i=1;i<=ntasks;++i) ff_send_out(new long(i));
+        return EOS;
+    }
+    long ntasks;
+};
+struct Filter: ff_node_t<long> {
+    long *svc(long *t) {
+        if (*t & 0x1) { delete t; return GO_ON; }
+        return t;
+    }
+};
+struct Dup: ff_node_t<long> {
+    long *svc(long *t) {
+        ff_send_out(new long(*t));
+        ff_send_out(t);
+        return GO_ON;
+    }
+};
+struct Tail: ff_node_t<long, res_t> {
+    res_t *svc(long *t) {
+        res_t *r = new res_t{*t};
+        delete t;
+        return r;
+    }
+    void eosnotify(ssize_t) { ff_send_out(new res_t{-1}); }
+};
+struct Sink: ff_node_t<res_t> {
+    res_t *svc(res_t *r) {
+        if (r->v < 0) ++markers;
+        else { sum += r->v; ++cnt; }
+        delete r;
+        return GO_ON;
+    }
+    long sum=0, cnt=0, markers=0;
+};
+
+static int check(const char* name, const Sink& snk, long ntasks) {
+    const long expected = 2 * (ntasks/2) * (ntasks/2+1);  // 2*(2+4+...)
+    if (snk.cnt != 2*(ntasks/2) || snk.sum != expected || snk.markers != 1) {
+        std::cerr << name << ": wrong result cnt=" << snk.cnt << " sum=" << snk.sum
+                  << " markers=" << snk.markers << "\n";
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    long ntasks = 1000;
+    if (argc>1) ntasks = std::stol(argv[1]);
+    {
+        Source src(ntasks);
+        Filter filter; Dup dup; Tail tail;
+        Sink   snk;
+        auto fused = ff_fuse(filter, dup, tail);
+        ff_Pipe<> pipe(src, fused, snk);
+        if (pipe.run_and_wait_end()<0) {
+            error("running pipe\n");
+            return -1;
+        }
+        if (pipe.cardinality() != 3) {
+            std::cerr << "wrong cardinality " << pipe.cardinality() << "\n";
+            return -1;
+        }
+        if (check("pipe1", snk, ntasks)<0) return -1;
+    }
+    {
+        Source src(ntasks);
+        Filter filter; Dup dup; Tail tail;
+        Sink   snk;
+        auto fused = ff_fuse(src, filter, dup, tail);
+        ff_Pipe<> pipe(fused, snk);
+        if (pipe.run_and_wait_end()<0) {
+            error("running pipe\n");
+            return -1;
+        }
+        if (check("pipe2", snk, ntasks)<0) return -1;
+    }
+    std::cout << "DONE\n";
+    return 0;
+}
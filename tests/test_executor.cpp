@@ -0,0 +1,217 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+
+/*
+ *  Source -> Inc -> Inc -> ... -> Inc -> Sink
+ *
+ *  Source -> Farm(Emitter, Inc, Inc, ..., Inc) -> Sink
+ *
+ *  PacedSource -> Stop, Source -> Inc -> Stop  (Stop terminates after the first tasks)
+ *
+ *  Source -> Inc -> BadInit  (svc_init of BadInit fails)
+ *
+ *  The graphs are executed by the M:N executor on few threads.
+ */
+
+#include <iostream>
+#include <ff/ff.hpp>
+#include <ff/executor.hpp>
+using namespace ff;
+
+struct Source: ff_node_t<long> {
+    Source(long ntasks): ntasks(ntasks) {}
+    long *svc(long *) {
+        // one task each call, the executor calls it again
+        if (i == ntasks) return EOS;
+        return new long(++i);
+    }
+    long ntasks, i=0;
+};
+
+struct Inc: ff_node_t<long> {
+    long *svc(long *t) { ++*t; return t; }
+};
+
+struct Emitter: ff_monode_t<long> {
+    Emitter(size_t nw): nw(nw) {}
+    long *svc(long *t) {
+        ff_send_out_to(t, (int)(next++ % nw));
+        return GO_ON;
+    }
+    size_t nw, next=0;
+};
+
+struct Sink: ff_minode_t<long> {
+    long *svc(long *t) {
+        sum += *t; ++cnt;
+        delete t;
+        return GO_ON;
+    }
+    long sum=0, cnt=0;
+};
+
+// one task each call, the tasks not delivered are deleted
+struct PacedSource: ff_node_t<long> {
+    PacedSource(long ntasks): ntasks(ntasks) {}
+    long *svc(long *) {
+        if (i++ == ntasks) return EOS;
+        long *t = new long(i);
+        if (ff_send_out(t)) ++sent;
+        else { delete t; ++failed; }
+        return GO_ON;
+    }
+    long ntasks, i=0, sent=0, failed=0;
+};
+// it terminates early: the tasks still arriving are not delivered
+struct Stop: ff_node_t<long> {
+    long *svc(long *t) {
+        delete t;
+        return (++cnt == 10) ? EOS : GO_ON;
+    }
+    long cnt=0;
+};
+struct BadInit: ff_node_t<long> {
+    int  svc_init() { return -1; }
+    long *svc(long *t) { delete t; return GO_ON; }
+    void svc_end() { svc_end_called = true; }
+    bool svc_end_called = false;
+};
+
+int main(int argc, char* argv[]) {
+    long   ntasks  = 10000;
+    size_t nstages = 300;
+    size_t nw      = 8;
+    if (argc>1) {
+        if (argc!=4) {
+            std::cerr << "use: " << argv[0] << " ntasks nstages nworkers\n";
+            return -1;
+        }
+        ntasks  = std::stol(argv[1]);
+        nstages = std::stol(argv[2]);
+        nw      = std::stol(argv[3]);
+    }
+    const long expected = ntasks*(ntasks+1)/2;
+    {
+        Source src(ntasks);
+        Sink   snk;
+        std::vector<Inc> S(nstages);
+        ff_pipeline pipe;
+        pipe.add_stage(&src);
+        for(auto& s: S) pipe.add_stage(&s);
+        pipe.add_stage(&snk);
+
+        ff_executor ex(4);
+        if (ex.run_and_wait_end(pipe)<0) {
+            error("running pipeline\n");
+            return -1;
+        }
+        if (snk.cnt != ntasks || snk.sum != expected + (long)nstages*ntasks) {
+            std::cerr << "pipeline: wrong result " << snk.sum << "\n";
+            return -1;
+        }
+        std::cout << "pipeline: " << ex.get_num_nodes() << " nodes on "
+                  << ex.get_num_threads() << " threads, activations= "
+                  << ex.get_num_activations() << "\n";
+    }
+    {
+        Source src(ntasks);
+        Sink   snk;
+        std::vector<ff_node*> W;
+        for(size_t i=0;i<nw;++i) W.push_back(new Inc);
+        ff_farm farm(W);
+        farm.add_emitter(new Emitter(nw));
+        farm.cleanup_all();
+        ff_pipeline pipe;
+        pipe.add_stage(&src);
+        pipe.add_stage(&farm);
+        pipe.add_stage(&snk);
+
+        ff_executor ex(2);
+        if (ex.run_and_wait_end(pipe)<0) {
+            error("running farm\n");
+            return -1;
+        }
+        if (snk.cnt != ntasks || snk.sum != expected + ntasks) {
+            std::cerr << "farm: wrong result " << snk.sum << "\n";
+            return -1;
+        }
+        std::cout << "farm: " << ex.get_num_nodes() << " nodes on "
+                  << ex.get_num_threads() << " threads, activations= "
+                  << ex.get_num_activations() << "\n";
+    }
+    {
+        // ff_send_out fails once Stop has terminated
+        PacedSource src(ntasks);
+        Stop        stop;
+        ff_Pipe<>   pipe(src, stop);
+        ff_executor ex(2);
+        if (ex.run_and_wait_end(pipe)<0) {
+            error("running early termination\n");
+            return -1;
+        }
+        if (src.sent + src.failed != ntasks || stop.cnt != 10 || src.failed == 0) {
+            std::cerr << "early termination: wrong result, sent= " << src.sent
+                      << " failed= " << src.failed << "\n";
+            return -1;
+        }
+        std::cout << "early termination: sent= " << src.sent << " failed= " << src.failed << "\n";
+    }
+    {
+        // the tasks returned by Inc once Stop has terminated are dropped and counted
+        Source      src(ntasks);
+        Inc         inc;
+        Stop        stop;
+        ff_Pipe<>   pipe(src, inc, stop);
+        ff_executor ex(2);
+        if (ex.run_and_wait_end(pipe)<0) {
+            error("running early termination\n");
+            return -1;
+        }
+        if (stop.cnt != 10 || ex.get_num_dropped() == 0) {
+            std::cerr << "early termination: wrong result, dropped= " << ex.get_num_dropped() << "\n";
+            return -1;
+        }
+        std::cout << "early termination: dropped= " << ex.get_num_dropped() << "\n";
+    }
+    {
+        Source  src(ntasks);
+        Inc     inc;
+        BadInit bad;
+        ff_Pipe<> pipe(src, inc, bad);
+        ff_executor ex(2);
+        if (ex.run_and_wait_end(pipe)==0 || bad.svc_end_called) {
+            std::cerr << "svc_init failure: not reported or svc_end called\n";
+            return -1;
+        }
+        std::cout << "svc_init failure: OK\n";
+    }
+    std::cout << "DONE\n";
+    return 0;
+}
@@ -0,0 +1,202 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+
+/*
+ * Many short activations of the same accelerators (run_then_freeze, a few
+ * tasks, EOS, wait_freezing). The threads of the farm are frozen on the
+ * same epoch and are all thawed by a single wake-up.
+ *
+ */
+#include <vector>
+#include <iostream>
+#include <ff/ff.hpp>
+using namespace ff;
+
+struct Worker: ff_node {
+    void * svc(void * task) {
+        ++*(long*)task;
+        return task;
+    }
+};
+
+struct Collector: ff_node {
+    int svc_init() { ntasks=0; sum=0; return 0; }
+    void * svc(void * task) {
+        ++ntasks;
+        sum += *(long*)task;
+        return GO_ON;
+    }
+    long ntasks=0, sum=0;
+};
+
+struct Stage: ff_node {
+    void * svc(void * task) {
+        *(long*)task *= 2;
+        return task;
+    }
+};
+
+// n. of tasks per activation
+static const long streamlen = 8;
+
+int main(int argc, char * argv[]) {
+    int nworkers   = 4;
+    int iterations = 100;
+    if (argc>1) {
+        if (argc<3) {
+            std::cerr << "use: " << argv[0] << " nworkers iterations\n";
+            return -1;
+        }
+        nworkers   = atoi(argv[1]);
+        iterations = atoi(argv[2]);
+    }
+    if (nworkers<=0 || iterations<=0) {
+        std::cerr << "Wrong parameters values\n";
+        return -1;
+    }
+    std::vector<long> V(streamlen);
+
+    // farm with collector
+    {
+        ff_farm farm(true);
+        std::vector<ff_node *> w;
+        for(int i=0;i<nworkers;++i) w.push_back(new Worker);
+        farm.add_workers(w);
+        farm.cleanup_workers();
+        Collector C;
+        farm.add_collector(&C);
+
+        ffTime(START_TIME);
+        for(int k=0;k<iterations;++k) {
+            if (farm.run_then_freeze()<0) {
+                error("running farm\n");
+                return -1;
+            }
+            for(long i=0;i<streamlen;++i) {
+                V[i] = i;
+                farm.offload(&V[i]);
+            }
+            farm.offload(FF_EOS);
+            if (farm.wait_freezing()<0) {
+                error("freezing farm\n");
+                return -1;
+            }
+            if (C.ntasks != streamlen || C.sum != streamlen*(streamlen+1)/2) {
+                std::cerr << "farm: wrong result at iteration " << k << "\n";
+                return -1;
+            }
+        }
+        ffTime(STOP_TIME);
+        if (farm.wait()<0) {
+            error("waiting farm\n");
+            return -1;
+        }
+        std::cout << "farm: " << ffTime(GET_TIME)*1000.0/iterations << " (us) per activation\n";
+    }
+
+    // farm with the default collector, the results are collected by the main thread
+    {
+        ff_farm farm(true);
+        std::vector<ff_node *> w;
+        for(int i=0;i<nworkers;++i) w.push_back(new Worker);
+        farm.add_workers(w);
+        farm.cleanup_workers();
+        farm.add_collector(NULL);
+
+        ffTime(START_TIME);
+        for(int k=0;k<iterations;++k) {
+            if (farm.run_then_freeze()<0) {
+                error("running farm\n");
+                return -1;
+            }
+            for(long i=0;i<streamlen;++i) {
+                V[i] = i;
+                farm.offload(&V[i]);
+            }
+            farm.offload(FF_EOS);
+            long ntasks=0, sum=0;
+            void *r;
+            while(farm.load_result(&r)) {
+                ++ntasks;
+                sum += *(long*)r;
+            }
+            if (farm.wait_freezing()<0) {
+                error("freezing farm\n");
+                return -1;
+            }
+            if (ntasks != streamlen || sum != streamlen*(streamlen+1)/2) {
+                std::cerr << "farm (default collector): wrong result at iteration " << k << "\n";
+                return -1;
+            }
+        }
+        ffTime(STOP_TIME);
+        if (farm.wait()<0) {
+            error("waiting farm\n");
+            return -1;
+        }
+        std::cout << "farm (default collector): " << ffTime(GET_TIME)*1000.0/iterations << " (us) per activation\n";
+    }
+
+    // pipeline
+    {
+        ff_pipeline pipe(true);
+        pipe.add_stage(new Stage, true);
+        pipe.add_stage(new Stage, true);
+
+        for(int k=0;k<iterations;++k) {
+            if (pipe.run_then_freeze()<0) {
+                error("running pipeline\n");
+                return -1;
+            }
+            for(long i=0;i<streamlen;++i) {
+                V[i] = i;
+                pipe.offload(&V[i]);
+            }
+            pipe.offload(FF_EOS);
+            long sum=0;
+            void *r;
+            while(pipe.load_result(&r)) sum += *(long*)r;
+            if (pipe.wait_freezing()<0) {
+                error("freezing pipeline\n");
+                return -1;
+            }
+            if (sum != 4*streamlen*(streamlen-1)/2) {
+                std::cerr << "pipeline: wrong result at iteration " << k << "\n";
+                return -1;
+            }
+        }
+        if (pipe.wait()<0) {
+            error("waiting pipeline\n");
+            return -1;
+        }
+    }
+    std::cout << "DONE\n";
+    return 0;
+}
@@ -0,0 +1,151 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+/*
+ * Parallel windowed join of two streams, the results are compared with the
+ * ones computed by brute force.
+ *
+ *           ______________
+ *   Left  ->|  router   |-->| join worker |--
+ *           |           |-->| join worker |--|--> Checker
+ *   Right ->|  router   |-->| join worker |--
+ *
+ */
+
+#include <iostream>
+#include <set>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/join.hpp>
+
+using namespace ff;
+
+struct event_t {
+    long     key;
+    uint64_t ts;
+    long     id;
+};
+typedef std::pair<long,long> result_t;   // (left id, right id), right id -1 if no match
+
+static std::vector<event_t> make_events(size_t n, long nkeys, unsigned step, unsigned seed) {
+    std::vector<event_t> E;
+    uint64_t ts = 0;
+    for(size_t i=0;i<n;++i) {
+        ts += (i*seed) % step;
+        E.push_back(event_t{(long)((i*seed + i/3) % nkeys), ts, (long)i});
+    }
+    return E;
+}
+
+static std::set<result_t> expected(const std::vector<event_t>& L, const std::vector<event_t>& R,
+                                   uint64_t window, bool outer) {
+    std::set<result_t> S;
+    for(auto& l: L) {
+        bool matched = false;
+        for(auto& r: R)
+            if (l.key == r.key && (l.ts > r.ts ? l.ts - r.ts : r.ts - l.ts) <= window) {
+                S.insert({l.id, r.id});
+                matched = true;
+            }
+        if (!matched && outer) S.insert({l.id, -1});
+    }
+    return S;
+}
+
+struct Source: ff_node_t<event_t> {
+    Source(const std::vector<event_t>& E): E(E) {}
+    event_t* svc(event_t*) {
+        for(auto& e: E) ff_send_out(new event_t(e));
+        return EOS;
+    }
+    const std::vector<event_t>& E;
+};
+
+struct Checker: ff_minode_t<result_t, void> {
+    void* svc(result_t* r) {
+        if (!S.insert(*r).second) duplicates = true;
+        delete r;
+        return GO_ON;
+    }
+    std::set<result_t> S;
+    bool duplicates = false;
+};
+
+static int run(const char* name, const std::vector<event_t>& L, const std::vector<event_t>& R,
+               size_t nworkers, uint64_t window, ff_join_type type, size_t capacity=DEF_JOIN_CAPACITY) {
+    Source left(L), right(R);
+    Checker chk;
+    ff_join<event_t,event_t,long,result_t> join(&left, &right, nworkers, window,
+        [](const event_t& e) { return e.key; }, [](const event_t& e) { return e.key; },
+        [](const event_t& e) { return e.ts; },  [](const event_t& e) { return e.ts; },
+        [](const event_t* l, const event_t* r) { return new result_t(l->id, r ? r->id : -1); },
+        type, capacity);
+    ff_Pipe<> pipe(join, chk);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    const ff_join_stats s = join.get_stats();
+    const std::set<result_t> E = expected(L, R, window, type == FF_LEFT_OUTER_JOIN);
+    std::cout << name << ": " << chk.S.size() << " results (matches=" << s.matches << " outer=" << s.outer
+              << " expired=" << s.expired << " evicted=" << s.evicted << " max_entries=" << s.max_entries << ")\n";
+    if (chk.duplicates) {
+        std::cerr << name << ": duplicated results\n";
+        return -1;
+    }
+    if (s.evicted == 0) {
+        if (chk.S != E) {
+            std::cerr << name << ": wrong results, expected " << E.size() << "\n";
+            return -1;
+        }
+        return 0;
+    }
+    // with evictions, the inner results are a subset of the expected ones
+    for(auto& r: chk.S)
+        if (r.second >= 0 && E.find(r) == E.end()) {
+            std::cerr << name << ": wrong result (" << r.first << "," << r.second << ")\n";
+            return -1;
+        }
+    if (s.max_entries > 2*capacity) {
+        std::cerr << name << ": the capacity has been exceeded\n";
+        return -1;
+    }
+    return 0;
+}
+
+int main() {
+    const long nkeys = 53;
+    std::vector<event_t> L = make_events(4000, nkeys, 5, 7);
+    std::vector<event_t> R = make_events(3000, nkeys, 7, 11);
+
+    if (run("inner join",        L, R, 4, 20, FF_INNER_JOIN) < 0)      return -1;
+    if (run("left-outer join",   L, R, 3, 10, FF_LEFT_OUTER_JOIN) < 0) return -1;
+    if (run("bounded tables",    L, R, 2, 200, FF_INNER_JOIN, 8) < 0)  return -1;
+    return 0;
+}
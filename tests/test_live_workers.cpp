@@ -0,0 +1,243 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+
+/*
+ * Live reconfiguration of the workers of a farm accelerator: while the farm
+ * is running, a worker is replaced with a new version, a worker is added in
+ * a spare slot and a worker is quiesced and then resumed.
+ * The tasks explicitly sent by the emitter to a spare slot are rejected.
+ *
+ */
+#include <vector>
+#include <iostream>
+#include <atomic>
+#include <ff/ff.hpp>
+using namespace ff;
+
+struct task_t {
+    long id;
+    int  version;
+};
+
+// svc_init, svc and svc_end must be called by the same thread
+struct Worker: ff_node_t<task_t> {
+    Worker(int version): version(version) {}
+    int svc_init() { th = pthread_self(); ++ninit; return 0; }
+    task_t* svc(task_t* t) {
+        if (!pthread_equal(th, pthread_self())) onthread = false;
+        t->version = version;
+        ++ntasks;
+        return t;
+    }
+    void svc_end() {
+        if (!pthread_equal(th, pthread_self())) onthread = false;
+        ++nend;
+    }
+    const int version;
+    long ntasks=0, ninit=0, nend=0;
+    pthread_t th;
+    bool onthread=true;
+};
+
+// one task every 10 is sent explicitly to the last slot, to the first one
+// if the last slot has no worker
+struct Emitter: ff_monode_t<task_t> {
+    Emitter(int nslots): nslots(nslots) {}
+    task_t* svc(task_t* t) {
+        if (t->id % 10) return t;
+        if (!ff_send_out_to(t, nslots-1)) {
+            ++rejected;
+            ff_send_out_to(t, 0);
+        }
+        return GO_ON;
+    }
+    const int nslots;
+    long rejected=0;
+};
+
+struct Collector: ff_node_t<task_t> {
+    task_t* svc(task_t* t) {
+        ++ntasks;
+        sum += t->id;
+        ++versions[t->version];
+        delete t;
+        return GO_ON;
+    }
+    std::atomic<long> ntasks{0};
+    long sum=0;
+    long versions[4]={0,0,0,0};
+};
+
+static void offload(ff_farm& farm, long& id, long n) {
+    for(long i=0;i<n;++i) farm.offload(new task_t{id++, 0});
+}
+
+static int test(bool ondemand, long n) {
+    Worker *w1 = new Worker(1), *w2 = new Worker(1);
+    ff_farm farm(true);
+    farm.add_workers({w1, w2});
+    Collector C;
+    farm.add_collector(&C);
+    if (ondemand) farm.set_scheduling_ondemand();
+    if (farm.set_live_workers(1)<0) return -1;
+    if (farm.run()<0) {
+        error("running farm\n");
+        return -1;
+    }
+    long id=0;
+    offload(farm, id, n);
+
+    // hot swap of the first worker
+    Worker *w3 = new Worker(2);
+    ff_node *old = farm.replace_worker(0, w3, true);
+    if (old != w1) {
+        std::cerr << "replace_worker returned a wrong node\n";
+        return -1;
+    }
+    const long n1 = w1->ntasks;
+    // adding capacity
+    if (farm.add_worker(new Worker(3), true) != 2) {
+        std::cerr << "add_worker failed\n";
+        return -1;
+    }
+    Worker w4(3);
+    if (farm.add_worker(&w4) != -1) {
+        std::cerr << "add_worker should fail, no spare slots\n";
+        return -1;
+    }
+    offload(farm, id, n);
+
+    // the second worker does not receive tasks while quiesced
+    if (farm.quiesce_worker(1)<0) return -1;
+    const long n2 = w2->ntasks;
+    offload(farm, id, n);
+    if (farm.quiesce_worker(0)<0 || farm.quiesce_worker(2)<0) return -1;
+    if (w2->ntasks != n2) {
+        std::cerr << "a quiesced worker has received tasks\n";
+        return -1;
+    }
+    if (farm.resume_worker(0)<0 || farm.resume_worker(1)<0 || farm.resume_worker(2)<0) return -1;
+    offload(farm, id, n);
+
+    farm.offload(FF_EOS);
+    if (farm.wait()<0) {
+        error("waiting farm\n");
+        return -1;
+    }
+    // NOTE: the first worker may be replaced before its thread starts
+    if (w1->ntasks != n1 || w1->ninit != w1->nend) {
+        std::cerr << "the replaced worker has not been stopped\n";
+        return -1;
+    }
+    if (w3->ninit != 1 || w3->nend != 1) {
+        std::cerr << "the new worker has not been initialized/finalized once\n";
+        return -1;
+    }
+    if (!w1->onthread || !w2->onthread || !w3->onthread) {
+        std::cerr << "svc_init/svc/svc_end called by different threads\n";
+        return -1;
+    }
+    delete w1;
+    if (C.ntasks != 4*n || C.sum != (4*n)*(4*n-1)/2) {
+        std::cerr << "wrong number of results " << C.ntasks << "\n";
+        return -1;
+    }
+    if (C.versions[0] != 0 || C.versions[1] != w2->ntasks + n1 || C.versions[2] == 0 || C.versions[3] == 0) {
+        std::cerr << "wrong versions " << C.versions[1] << " " << C.versions[2] << " " << C.versions[3] << "\n";
+        return -1;
+    }
+    delete w2;
+    std::cout << "ondemand=" << ondemand << " version 1: " << C.versions[1]
+              << " version 2: " << C.versions[2] << " version 3: " << C.versions[3] << "\n";
+    return 0;
+}
+
+// waits for the results of all the tasks offloaded so far
+static void drain(Collector& C, long id) {
+    while(C.ntasks.load() != id) usleep(1000);
+}
+
+static int test_spare(long n) {
+    Worker w1(1), w2(1), w3(3);
+    ff_farm farm(true);
+    Emitter E(3);
+    farm.add_emitter(&E);
+    farm.add_workers({&w1, &w2});
+    Collector C;
+    farm.add_collector(&C);
+    if (farm.set_live_workers(1)<0) return -1;
+    if (farm.run()<0) {
+        error("running farm\n");
+        return -1;
+    }
+    long id=0;
+    offload(farm, id, n);   // the last slot is spare
+    drain(C, id);
+    if (farm.add_worker(&w3) != 2) {
+        std::cerr << "add_worker failed\n";
+        return -1;
+    }
+    offload(farm, id, n);
+    drain(C, id);
+    if (farm.replace_worker(2, nullptr) != &w3) {
+        std::cerr << "replace_worker returned a wrong node\n";
+        return -1;
+    }
+    offload(farm, id, n);
+    farm.offload(FF_EOS);
+    if (farm.wait()<0) {
+        error("waiting farm\n");
+        return -1;
+    }
+    if (C.ntasks != 3*n || C.versions[0] != 0) {
+        std::cerr << "tasks lost or not executed " << C.ntasks << " " << C.versions[0] << "\n";
+        return -1;
+    }
+    if (E.rejected != 2*((n+9)/10) || w3.ntasks < (n+9)/10) {
+        std::cerr << "wrong explicit sends, rejected= " << E.rejected << " executed by the added worker= " << w3.ntasks << "\n";
+        return -1;
+    }
+    if (w3.ninit != 1 || w3.nend != 1 || !w3.onthread) {
+        std::cerr << "the added worker has not been started/stopped by its thread\n";
+        return -1;
+    }
+    std::cout << "spare slot: rejected= " << E.rejected << "\n";
+    return 0;
+}
+
+int main(int argc, char * argv[]) {
+    long n = 500;
+    if (argc>1) n = atol(argv[1]);
+    if (test(false, n)<0) return -1;
+    if (test(true,  n)<0) return -1;
+    if (test_spare(n)<0)  return -1;
+    std::cout << "DONE\n";
+    return 0;
+}
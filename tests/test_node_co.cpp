@@ -0,0 +1,162 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+
+/*
+ *  Source -> Query -> Sink
+ *
+ *  For each input element the Query stage (a coroutine node) sends a request to
+ *  a slow "server" thread through a pipe, suspends until the reply is readable
+ *  and then produces two output elements. Many requests are in-flight at the
+ *  same time on the single thread of the Query stage.
+ *
+ *  NOTE: it requires -std=c++20
+ */
+
+#include <iostream>
+#include <ff/ff.hpp>
+#include <ff/node_co.hpp>
+
+#if defined(__cpp_impl_coroutine) && (__cplusplus >= 202002L)
+
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <fcntl.h>
+using namespace ff;
+
+// it replies to each request (value, fd) after 'latency' us
+struct Server {
+    Server(unsigned latency): latency(latency), th([this] { loop(); }) {}
+    ~Server() {
+        { std::lock_guard<std::mutex> lck(mtx); stop = true; }
+        th.join();
+    }
+    void request(long v, int fd) {
+        std::lock_guard<std::mutex> lck(mtx);
+        Q.push_back({v, fd, getusec()+latency});
+    }
+    void loop() {
+        for(;;) {
+            entry_t r;
+            {
+                std::lock_guard<std::mutex> lck(mtx);
+                if (Q.empty()) {
+                    if (stop) return;
+                    r.fd = -1;
+                } else {
+                    r = Q.front();
+                    if (r.due <= getusec()) Q.pop_front(); else r.fd = -1;
+                }
+            }
+            if (r.fd < 0) { usleep(100); continue; }
+            long reply = r.v*10;
+            if (write(r.fd, &reply, sizeof(reply)) != sizeof(reply)) abort();
+            close(r.fd);
+        }
+    }
+    struct entry_t { long v; int fd; unsigned long due; };
+    const unsigned      latency;
+    std::mutex          mtx;
+    std::deque<entry_t> Q;
+    bool                stop=false;
+    std::thread         th;
+};
+
+struct Source: ff_node_t<long> {
+    Source(long ntasks): ntasks(ntasks) {}
+    long *svc(long *) {
+        for(long i=1;i<=ntasks;++i) ff_send_out(new long(i));
+        return EOS;
+    }
+    long ntasks;
+};
+
+struct Query: ff_node_co<long> {
+    Query(Server& server): server(server) {}
+    ff_co_task svc_co(long *t) {
+        int fd[2];
+        if (pipe(fd)<0) { error("pipe\n"); co_return; }
+        fcntl(fd[0], F_SETFL, O_NONBLOCK);
+        server.request(*t, fd[1]);
+        if (co_await readable(fd[0]) != 0) { error("waiting for the reply\n"); co_return; }
+        long reply;
+        if (read(fd[0], &reply, sizeof(reply)) != sizeof(reply)) { error("read\n"); co_return; }
+        close(fd[0]);
+        co_yield t;                 // the request
+        co_yield new long(reply);   // and the reply
+    }
+    Server& server;
+};
+
+struct Sink: ff_node_t<long> {
+    long *svc(long *t) {
+        sum += *t; ++cnt;
+        delete t;
+        return GO_ON;
+    }
+    long sum=0, cnt=0;
+};
+
+int main(int argc, char* argv[]) {
+    long     ntasks  = 500;
+    unsigned latency = 5000;
+    if (argc>1) {
+        if (argc!=3) {
+            std::cerr << "use: " << argv[0] << " ntasks latency(us)\n";
+            return -1;
+        }
+        ntasks  = std::stol(argv[1]);
+        latency = std::stol(argv[2]);
+    }
+    Server server(latency);
+    Source src(ntasks);
+    Query  query(server);
+    Sink   snk;
+    ff_Pipe<> pipe(src, query, snk);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    if (snk.cnt != 2*ntasks || snk.sum != 11*(ntasks*(ntasks+1)/2)) {
+        std::cerr << "wrong result " << snk.cnt << " " << snk.sum << "\n";
+        return -1;
+    }
+    std::cout << "Time: " << pipe.ffTime() << " (ms), max in-flight requests= "
+              << query.get_max_inflight() << "\n";
+    std::cout << "DONE\n";
+    return 0;
+}
+
+#else
+int main() {
+    std::cout << "C++20 coroutines not supported, test skipped\n";
+    return 0;
+}
+#endif
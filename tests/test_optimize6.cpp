@@ -0,0 +1,133 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as 
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*  
+ * This test checks the profile-guided fusion of pipeline stages (OptLevel::fuse_stages).
+ *
+ *   pipe(Source, S1, S2, S3, S4, S5, Sink)
+ *
+ * S3 is expensive, all the other stages are cheap. With enough cores the cheap
+ * stages around S3 are fused:  pipe(comb(Source,S1,S2), S3, comb(S4,S5,Sink))
+ * With only 2 cores:            pipe(comb(Source,S1,S2,S3), comb(S4,S5,Sink))
+ * Without a profile the stages are fused only if there are more stages than cores.
+ *
+ */
+
+#include <cstdio>
+#include <ff/ff.hpp>
+using namespace ff;
+
+const long NTASKS = 1000;
+
+struct Source: ff_node_t<long> {
+    long* svc(long*) {
+        for(long i=1;i<=NTASKS;++i) ff_send_out(new long(i));
+        return EOS;
+    }
+};
+struct Stage: ff_node_t<long> {
+    Stage(long work=0):work(work) {}
+    long* svc(long* t) {
+        for(volatile long i=0;i<work;++i);
+        *t += 1;
+        return t;
+    }
+    long work;
+};
+struct Sink: ff_node_t<long> {
+    long* svc(long* t) {
+        sum += *t;
+        delete t;
+        return GO_ON;
+    }
+    long sum=0;
+};
+
+static int run(ssize_t nthreads, const ff_opt_profile* prof, int expected, ff_opt_profile* collected=nullptr) {
+    Source source;
+    Stage  s1, s2, s3(2000), s4, s5;
+    Sink   sink;
+    ff_Pipe<> pipe(source, s1, s2, s3, s4, s5, sink);
+
+    OptLevel3 opt(prof);
+    opt.max_nb_threads = nthreads;
+    opt.verbose_level  = 2;
+    if (optimize_static(pipe, opt)<0) {
+        error("optimizing pipe\n");
+        return -1;
+    }
+    printf("Number of nodes= %d\n", pipe.cardinality());
+    if (expected>0 && pipe.cardinality() != expected) {
+        printf("WRONG NUMBER OF NODES, expected %d\n", expected);
+        return -1;
+    }
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    if (sink.sum != (NTASKS*(NTASKS+1))/2 + 5*NTASKS) {
+        printf("WRONG RESULT %ld\n", sink.sum);
+        return -1;
+    }
+    if (collected) collected->collect(pipe);
+    return 0;
+}
+
+int main() {
+    ff_opt_profile prof;
+    prof.set(0, 1, 1000);
+    prof.set(1, NTASKS, 100*NTASKS);
+    prof.set(2, NTASKS, 100*NTASKS);
+    prof.set(3, NTASKS, 1000000*NTASKS);
+    prof.set(4, NTASKS, 100*NTASKS);
+    prof.set(5, NTASKS, 100*NTASKS);
+    prof.set(6, NTASKS, 100*NTASKS);
+
+    // saving and reloading the profile
+    const std::string filename("/tmp/test_optimize6.prof");
+    if (prof.save(filename)<0) return -1;
+    ff_opt_profile prof2;
+    if (prof2.load(filename)<0) return -1;
+    std::remove(filename.c_str());
+    if (prof2.size() != prof.size() || prof2.get(3).svcticks != prof.get(3).svcticks) {
+        printf("WRONG PROFILE\n");
+        return -1;
+    }
+
+    if (run(MAX_NUM_THREADS, nullptr, 7)<0) return -1;  // no profile, no fusion
+    if (run(3, nullptr, 3)<0) return -1;                // no profile, fused to 3 threads
+    if (run(MAX_NUM_THREADS, &prof2, 3)<0)  return -1;
+    if (run(2, &prof2, 2)<0)                return -1;
+
+#if defined(TRACE_FASTFLOW)
+    // profiling run, the profile is then used to optimize a new instance
+    ff_opt_profile prof3;
+    if (run(MAX_NUM_THREADS, nullptr, 7, &prof3)<0) return -1;
+    if (run(MAX_NUM_THREADS, &prof3, -1)<0) return -1;
+#endif
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,125 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+
+/*
+ * Parallel algorithms over iterator ranges: parallel_for_each,
+ * parallel_transform, parallel_transform_reduce, parallel_count_if and
+ * parallel_copy_if on contiguous (std::vector, pointers) and non contiguous
+ * (std::deque) ranges, on the shared pool and on the Workers of a
+ * ParallelFor. They are called unqualified, next to the STL algorithms.
+ *
+ */
+
+#include <cstdio>
+#include <deque>
+#include <numeric>
+#include <algorithm>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/parallel_algorithms.hpp>
+
+using namespace ff;
+
+int main(int argc, char *argv[]) {
+    long nw = 4;
+    if (argc>1) nw = atol(argv[1]);
+
+    for(long n: {0L, 1L, 1000L, 100001L}) {
+        std::vector<float> A(n), B(n), C(n);
+        std::iota(A.begin(), A.end(), 0.0f);
+
+        parallel_for_each(A.begin(), A.end(), [](float& x) { x = x * 0.5f; }, nw);
+        parallel_transform(A.begin(), A.end(), B.begin(), [](const float x) { return x + 1.0f; }, nw);
+        auto end = parallel_transform(A.data(), A.data()+n, B.data(), C.data(),
+                                 [](const float x, const float y) { return x + y; }, nw);
+        if (end != C.data()+n) {
+            printf("ERROR: wrong end of the output range\n");
+            return -1;
+        }
+        for(long i=0;i<n;++i)
+            if (A[i] != i*0.5f || B[i] != A[i]+1.0f || C[i] != A[i]+B[i]) {
+                printf("ERROR: wrong result at %ld\n", i);
+                return -1;
+            }
+
+        const double s = parallel_transform_reduce(A.begin(), A.end(), 1.0,
+                                              [](const double a, const double b) { return a+b; },
+                                              [](const float x) { return (double)x*2.0; }, nw);
+        const double e = 1.0 + (double)n*(n-1)/2.0;
+        if (s != e) {
+            printf("ERROR: transform_reduce %g expected %g\n", s, e);
+            return -1;
+        }
+
+        // non contiguous range
+        std::deque<long> D(n);
+        std::iota(D.begin(), D.end(), 0L);
+        const long c = parallel_count_if(D.begin(), D.end(), [](const long x) { return x % 3 == 0; }, nw);
+        // the STL count_if (found by ADL) is not ambiguous under using namespace ff
+        if (c != (n+2)/3 || c != count_if(D.begin(), D.end(), [](const long x) { return x % 3 == 0; })) {
+            printf("ERROR: count_if %ld expected %ld\n", c, (n+2)/3);
+            return -1;
+        }
+        std::vector<long> O(n, -1);
+        auto oend = parallel_copy_if(D.begin(), D.end(), O.begin(), [](const long x) { return x % 3 == 0; }, nw);
+        if (oend - O.begin() != c) {
+            printf("ERROR: copy_if copied %ld elements\n", (long)(oend - O.begin()));
+            return -1;
+        }
+        for(long i=0;i<c;++i)
+            if (O[i] != 3*i) {
+                printf("ERROR: copy_if O[%ld]=%ld\n", i, O[i]);
+                return -1;
+            }
+    }
+
+    // on the Workers of a ParallelFor, also used for other loops
+    {
+        const long n = 50000;
+        ParallelFor pf(nw);
+        std::vector<int> A(n);
+        pf.parallel_for(0, n, [&A](const long i) { A[i] = (int)i; });
+        parallel_for_each(pf, A.begin(), A.end(), [](int& x) { x += 1; });
+        std::vector<int> B(n);
+        parallel_transform(pf, A.cbegin(), A.cend(), B.begin(), [](const int x) { return -x; });
+        const long neg = parallel_count_if(pf, B.begin(), B.end(), [](const int x) { return x < -100; });
+        const long sum = parallel_transform_reduce(pf, B.begin(), B.end(), 0L,
+                                              [](const long a, const long b) { return a+b; },
+                                              [](const int x) { return (long)x; });
+        std::vector<int> O(n);
+        auto end = parallel_copy_if(pf, A.begin(), A.end(), O.begin(), [](const int x) { return x > n-10; }, 2);
+        if (neg != n-100 || sum != -n*(n+1)/2 || end-O.begin() != 10 || O[0] != n-9) {
+            printf("ERROR: wrong result with a ParallelFor (%ld %ld %ld)\n", neg, sum, (long)(end-O.begin()));
+            return -1;
+        }
+    }
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,175 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+
+/*
+ * Affinity-preserving parallel loops: the arrays are initialized with 
+ * parallel_first_touch and then processed several times with 
+ * parallel_for_affinity, each index has to be always computed by the same
+ * thread (on the same core).
+ * The same loops nested in a pipeline stage use all the Workers.
+ *
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <set>
+#include <ff/ff.hpp>
+#include <ff/parallel_for.hpp>
+
+using namespace ff;
+
+struct Source: ff_node_t<long> {
+    Source(long ntasks): ntasks(ntasks) {}
+    long* svc(long*) {
+        for(long i=0;i<ntasks;++i) ff_send_out(new long(i));
+        return EOS;
+    }
+    long ntasks;
+};
+
+// the loops started by a FastFlow thread are nested
+struct Stage: ff_node_t<long> {
+    Stage(long size, long nw): size(size), nw(nw), owner(size) {}
+    int svc_init() {
+        pfr = new ParallelForReduce<double>(nw);
+        return 0;
+    }
+    long* svc(long* t) {
+        std::mutex m;
+        std::set<std::thread::id> threads;
+        const bool first = (*t == 0);
+        pfr->parallel_for_affinity(0, size, 1, [&](const long i) {
+                const std::thread::id me = std::this_thread::get_id();
+                if (first) owner[i] = me;
+                else if (owner[i] != me) error = true;
+                if (i % 1000 == 0) {
+                    std::lock_guard<std::mutex> lk(m);
+                    threads.insert(me);
+                }
+            });
+        if ((long)threads.size() != nw) {
+            printf("ERROR: nested parallel_for_affinity used %ld threads instead of %ld\n",
+                   (long)threads.size(), nw);
+            error = true;
+        }
+        delete t;
+        return GO_ON;
+    }
+    void svc_end() { delete pfr; }
+
+    const long size, nw;
+    std::vector<std::thread::id> owner;
+    ParallelForReduce<double> *pfr = nullptr;
+    bool error = false;
+};
+
+int main(int argc, char *argv[]) {
+    long size = 100000;
+    long niter = 10;
+    long nw = 4;
+    if (argc>1) {
+        if (argc<4) {
+            printf("use: %s size niter nworkers\n", argv[0]);
+            return -1;
+        }
+        size  = atol(argv[1]);
+        niter = atol(argv[2]);
+        nw    = atol(argv[3]);
+    }
+
+    double *A = (double*)malloc(size*sizeof(double));
+    double *B = (double*)malloc(size*sizeof(double));
+    ParallelForReduce<double> pfr(nw);
+
+    // the memory is touched first by the threads that will use it
+    pfr.parallel_first_touch(A, size*sizeof(double));
+    pfr.parallel_first_touch(B, size*sizeof(double));
+    for(long i=0;i<size;++i)
+        if (A[i] != 0.0 || B[i] != 0.0) {
+            printf("ERROR: memory not initialized at %ld\n", i);
+            return -1;
+        }
+
+    std::vector<std::thread::id> owner(size);
+    std::vector<ssize_t> core(size);
+    pfr.parallel_for_affinity(0, size, 1, [&](const long i) {
+            A[i] = i;
+            B[i] = 2*i;
+            owner[i] = std::this_thread::get_id();
+            core[i]  = ff_getMyCore();
+        });
+
+    std::atomic<bool> error{false};
+    for(long k=0;k<niter;++k) {
+        pfr.parallel_for_affinity(0, size, 1, [&](const long i) {
+                A[i] += B[i];
+                if (owner[i] != std::this_thread::get_id() || core[i] != ff_getMyCore()) error = true;
+            });
+        // another loop in between, with a different scheduling
+        pfr.parallel_for(0, size, 1, 100, [&](const long i) { B[i] += 1.0; });
+        pfr.parallel_for(0, size, 1, 100, [&](const long i) { B[i] -= 1.0; });
+    }
+    if (error) {
+        printf("ERROR: the affinity of the iterations has not been preserved\n");
+        return -1;
+    }
+
+    double sum = 0.0;
+    pfr.parallel_reduce_affinity(sum, 0.0, 0, size, 1,
+                                 [&](const long i, double& s) {
+                                     s += A[i];
+                                     if (owner[i] != std::this_thread::get_id()) error = true;
+                                 },
+                                 [](double& v, const double e) { v += e; });
+    // A[i] = i + niter*2*i
+    const double expected = (1.0 + 2.0*niter) * (double)size*(size-1)/2.0;
+    if (error || sum != expected) {
+        printf("ERROR: sum=%g expected %g\n", sum, expected);
+        return -1;
+    }
+    free(A); free(B);
+
+    Source source(niter);
+    Stage  stage(size, nw);
+    ff_Pipe<> pipe(source, stage);
+    if (pipe.run_and_wait_end()<0) {
+        printf("ERROR: running pipeline\n");
+        return -1;
+    }
+    if (stage.error) {
+        printf("ERROR: nested affinity loops\n");
+        return -1;
+    }
+    printf("DONE\n");
+    return 0;
+}
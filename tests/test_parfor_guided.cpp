@@ -0,0 +1,136 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+/*
+ * Tests the guided and auto scheduling policies of the ParallelFor and
+ * ParallelForReduce patterns on a loop with irregular iteration costs.
+ *
+ */
+
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/parallel_for.hpp>
+
+using namespace ff;
+
+// the cost of the iteration i grows with i
+static inline double work(long i) {
+    double r = 0.0;
+    for(long k=0;k<(i%1000);++k) r += std::sin((double)k);
+    return r;
+}
+
+static bool check(const std::vector<long>& A, long first, long step, long k) {
+    for(long i=0;i<(long)A.size();++i) {
+        const long expected = (i>=first && (i-first)%step == 0) ? k : 0;
+        if (A[i] != expected) {
+            printf("ERROR: A[%ld]=%ld expected %ld\n", i, A[i], expected);
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename PF>
+static bool run(PF& pf, long size, int nworkers) {
+    std::vector<long> A(size);
+    for(long step=1; step<=3; ++step) {
+        for(long grain: {1L, 7L, 100L}) {
+            std::fill(A.begin(), A.end(), 0);
+            pf.parallel_for_guided(5, size, step, grain, [&A](const long i) {
+                    A[i] += 1 + (work(i) > 1e100);
+                }, nworkers);
+            if (!check(A, 5, step, 1)) return false;
+        }
+        std::fill(A.begin(), A.end(), 0);
+        for(int k=1;k<=3;++k) {
+            pf.parallel_for_auto(5, size, step, [&A](const long i) {
+                    A[i] += 1 + (work(i) > 1e100);
+                }, nworkers);
+            if (!check(A, 5, step, k)) return false;
+        }
+    }
+    // less iterations than workers
+    std::fill(A.begin(), A.end(), 0);
+    pf.parallel_for_auto(0, 2, 1, [&A](const long i) { A[i] = 1; }, nworkers);
+    pf.parallel_for_guided(2, 3, 1, 1, [&A](const long i) { A[i] = 1; }, nworkers);
+    if (A[0]!=1 || A[1]!=1 || A[2]!=1) {
+        printf("ERROR: small loops\n");
+        return false;
+    }
+    // the default policy is used again after a guided/auto loop
+    std::fill(A.begin(), A.end(), 0);
+    pf.parallel_for(0, size, [&A](const long i) { A[i] = 1; }, nworkers);
+    return check(A, 0, 1, 1);
+}
+
+int main(int argc, char *argv[]) {
+    long size     = 5000;
+    int  nworkers = 3;
+    if (argc>1) {
+        if (argc<3) {
+            printf("use: %s size nworkers\n", argv[0]);
+            return -1;
+        }
+        size     = atol(argv[1]);
+        nworkers = atoi(argv[2]);
+    }
+
+    {
+        ParallelFor pf(nworkers);
+        if (!run(pf, size, nworkers)) return -1;
+    }
+    {
+        ParallelForReduce<long> pfr(nworkers, true);   // spin-wait Workers
+        if (!run(pfr, size, nworkers)) return -1;
+        pfr.threadPause();
+
+        const long expected = size*(size-1)/2;
+        long sum = 0;
+        pfr.parallel_reduce_guided(sum, 0L, 0, size, 1, 10, [](const long i, long& s) {
+                s += i + (work(i) > 1e100);
+            }, [](long& v, const long e) { v += e; }, nworkers);
+        if (sum != expected) {
+            printf("ERROR: guided sum=%ld expected %ld\n", sum, expected);
+            return -1;
+        }
+        sum = 0;
+        pfr.parallel_reduce_auto(sum, 0L, 0, size, 1, [](const long i, long& s) {
+                s += i + (work(i) > 1e100);
+            }, [](long& v, const long e) { v += e; }, nworkers);
+        if (sum != expected) {
+            printf("ERROR: auto sum=%ld expected %ld\n", sum, expected);
+            return -1;
+        }
+    }
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,195 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+/*
+ * Parallel loops nested in the Workers of a farm. The farm has as many
+ * Workers as the cores, so while all the Workers are running there are no
+ * idle cores: the nested loops have to be executed by the Workers themselves.
+ *
+ *       |--> W0 (ParallelFor) --|
+ *  E -->|--> ...                |--> C
+ *       |--> Wn (ParallelFor) --|
+ *
+ * Then a ff_Map with spinWait in a pipeline: its Workers keep running between
+ * two loops, they must not be counted as busy cores by its own nested loops.
+ *
+ *   Source --> ff_Map (spinWait) --> Sink
+ */
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/parallel_for.hpp>
+#include <ff/map.hpp>
+
+using namespace ff;
+
+const long SIZE = 1000;
+
+struct Emitter: ff_node_t<long> {
+    Emitter(long ntasks): ntasks(ntasks) {}
+    long* svc(long*) {
+        for(long i=1;i<=ntasks;++i) ff_send_out(new long(i));
+        return EOS;
+    }
+    long ntasks;
+};
+
+struct Worker: ff_node_t<long> {
+    Worker(std::atomic<long>& started, std::atomic<long>& ended, long nworkers):
+        started(started), ended(ended), nworkers(nworkers) {}
+
+    int svc_init() {
+        pf = new ParallelForReduce<long>(4);
+        // all the Workers are running
+        started.fetch_add(1);
+        while(started.load() < nworkers) std::this_thread::yield();
+        return 0;
+    }
+    long* svc(long* t) {
+        const long k = *t;
+        const std::thread::id me = std::this_thread::get_id();
+        std::atomic<long> others{0};
+        std::vector<long> A(SIZE);
+        pf->parallel_for(0, SIZE, 1, 7, [&](const long i) {
+                A[i] = i*k;
+                if (std::this_thread::get_id() != me) others.fetch_add(1);
+            }, 4);
+        long sum = 0;
+        pf->parallel_reduce(sum, 0L, 0, SIZE, [&](const long i, long& s) { s += A[i]; },
+                            [](long& v, const long e) { v += e; }, 4);
+        // the one-shot version
+        parallel_for(0, SIZE, [&](const long) {
+                if (std::this_thread::get_id() != me) others.fetch_add(1);
+            }, 4);
+        if (sum != k*SIZE*(SIZE-1)/2) {
+            printf("ERROR: sum=%ld expected %ld\n", sum, k*SIZE*(SIZE-1)/2);
+            error = true;
+        }
+        // when a Worker terminates its core becomes idle
+        if (others.load() > 0 && ended.load() == 0) {
+            printf("ERROR: the nested loops used other threads, no idle cores\n");
+            error = true;
+        }
+        delete t;
+        return GO_ON;
+    }
+    void svc_end() {
+        ended.fetch_add(1);
+        delete pf;
+    }
+
+    std::atomic<long>&       started;
+    std::atomic<long>&       ended;
+    const long               nworkers;
+    ParallelForReduce<long> *pf = nullptr;
+    bool                     error = false;
+};
+
+struct Source: ff_node_t<long> {
+    Source(long ntasks): ntasks(ntasks) {}
+    long* svc(long*) {
+        for(long i=1;i<=ntasks;++i) ff_send_out(new long(i));
+        return EOS;
+    }
+    long ntasks;
+};
+
+struct MapStage: ff_Map<long,long,long> {
+    MapStage(size_t nw): ff_Map<long,long,long>(nw, true) {}
+    long* svc(long* t) {
+        const std::thread::id me = std::this_thread::get_id();
+        std::atomic<long> others{0};
+        std::vector<long> A(SIZE);
+        parallel_for(0, SIZE, [&](const long i) {
+                A[i] = i;
+                if (std::this_thread::get_id() != me) others.fetch_add(1);
+            });
+        if (others.load() > 0) ++nparallel;
+        return t;
+    }
+    long nparallel = 0;
+};
+
+struct Sink: ff_node_t<long> {
+    long* svc(long* t) { delete t; return GO_ON; }
+};
+
+int main(int argc, char *argv[]) {
+    long ntasks = 200;
+    if (argc>1) ntasks = atol(argv[1]);
+
+    const long nworkers = ff_numCores();
+    std::atomic<long> started{0}, ended{0};
+    std::vector<ff_node*> W;
+    for(long i=0;i<nworkers;++i) W.push_back(new Worker(started, ended, nworkers));
+    ff_farm farm(W, new Emitter(ntasks), nullptr);
+    farm.remove_collector();
+    farm.cleanup_all();
+    if (farm.run_and_wait_end()<0) {
+        error("running farm\n");
+        return -1;
+    }
+    for(auto w: W)
+        if (reinterpret_cast<Worker*>(w)->error) return -1;
+
+    // a loop nested in a loop started by the main thread (not a FastFlow thread)
+    std::vector<long> B(8*SIZE);
+    ParallelFor pf;
+    pf.parallel_for(0, 8, [&B](const long i) {
+            parallel_for(0, SIZE, [&B,i](const long j) { B[i*SIZE+j] = i*SIZE+j; });
+        });
+    for(long i=0;i<8*SIZE;++i)
+        if (B[i] != i) {
+            printf("ERROR: B[%ld]=%ld\n", i, B[i]);
+            return -1;
+        }
+    // the pipeline uses up to 3 cores, the ff_Map's loops use the other ones
+    {
+        Source   src(ntasks);
+        MapStage map(ff_numCores());
+        Sink     snk;
+        ff_Pipe<> pipe(src, map, snk);
+        if (pipe.run_and_wait_end()<0) {
+            error("running pipeline\n");
+            return -1;
+        }
+        if (ff_numCores() > 3 && map.nparallel != ntasks) {
+            printf("ERROR: ff_Map with spinWait, only %ld loops of %ld in parallel\n", map.nparallel, ntasks);
+            return -1;
+        }
+    }
+    if (ff_nested_cores::reserved().load() != 0) {
+        printf("ERROR: %ld cores still reserved\n", ff_nested_cores::reserved().load());
+        return -1;
+    }
+    printf("DONE\n");
+    return 0;
+}
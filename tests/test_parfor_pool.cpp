@@ -0,0 +1,113 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+/*
+ * Tests the shared pool used by the one-shot parallel_for/parallel_reduce
+ * functions: many short loops, a loop called from the body of another loop
+ * and loops called at the same time by two threads.
+ *
+ */
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+#define DEF_PARFOR_POOL_NW 3
+#include <ff/ff.hpp>
+#include <ff/parallel_for.hpp>
+
+using namespace ff;
+
+static bool check(const std::vector<long>& A, long k) {
+    for(size_t i=0;i<A.size();++i)
+        if (A[i] != (long)i+k) {
+            printf("ERROR: A[%ld]=%ld expected %ld\n", (long)i, A[i], (long)i+k);
+            return false;
+        }
+    return true;
+}
+
+// many short loops, the same threads are used by all of them
+static bool loops(std::vector<long>& A, int ntimes, long nw) {
+    const long size = (long)A.size();
+    for(int k=0;k<ntimes;++k) {
+        parallel_for(0, size, [&A,k](const long i) { A[i]=i+k; }, nw);
+        if (!check(A, k)) return false;
+        parallel_for(0, size, 1, 7, [&A](const long i) { A[i]+=1; }, nw);
+        if (!check(A, k+1)) return false;
+        parallel_for_idx(0, size, 1, 16, [&A](const long start, const long stop, const int) {
+                for(long i=start;i<stop;++i) A[i]-=1;
+            }, nw);
+        if (!check(A, k)) return false;
+
+        long sum = 0;
+        parallel_reduce(sum, 0L, 0, size, 1, 5, [&A](const long i, long& s) { s += A[i]; },
+                        [](long& v, const long e) { v += e; }, nw);
+        const long expected = size*(size-1)/2 + size*k;
+        if (sum != expected) {
+            printf("ERROR: sum=%ld expected %ld\n", sum, expected);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    long size   = 10000;
+    int  ntimes = 200;
+    if (argc>1) {
+        if (argc<3) {
+            printf("use: %s size ntimes\n", argv[0]);
+            return -1;
+        }
+        size   = atol(argv[1]);
+        ntimes = atoi(argv[2]);
+    }
+
+    std::vector<long> A(size);
+    if (!loops(A, ntimes, 3)) return -1;
+    if (!loops(A, ntimes, FF_AUTO)) return -1;
+
+    // nested loops: the inner ones do not find the pool free
+    std::vector<long> B(4*100);
+    parallel_for(0, 4, [&B](const long i) {
+            parallel_for(0, 100, [&B,i](const long j) { B[i*100+j] = i*100+j; }, 2);
+        }, 3);
+    if (!check(B, 0)) return -1;
+
+    // two threads calling the one-shot functions at the same time
+    std::vector<long> C(size), D(size);
+    bool r1=false, r2=false;
+    std::thread t1([&] { r1 = loops(C, ntimes/4, 2); });
+    std::thread t2([&] { r2 = loops(D, ntimes/4, 2); });
+    t1.join(); t2.join();
+    if (!r1 || !r2) return -1;
+
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,118 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+
+/*
+ * Tree-combining and deterministic reductions:
+ *  - a vector-valued reduction (histogram) with parallel_reduce_tree;
+ *  - a floating-point sum with parallel_reduce_deterministic, its result
+ *    has to be the same (bit by bit) with any n. of Workers and at each run.
+ *
+ */
+
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/parallel_for.hpp>
+
+using namespace ff;
+
+typedef std::vector<long> hist_t;
+
+int main(int argc, char *argv[]) {
+    long size = 200000;
+    long nw   = 4;
+    if (argc>1) {
+        if (argc<3) {
+            printf("use: %s size nworkers\n", argv[0]);
+            return -1;
+        }
+        size = atol(argv[1]);
+        nw   = atol(argv[2]);
+    }
+    const long nbins = 1000;
+
+    // vector-valued reduction
+    {
+        ParallelForReduce<hist_t> pfr(nw);
+        hist_t H(nbins, 0);
+        auto sumhist = [](hist_t& a, const hist_t& b) {
+            for(size_t i=0;i<a.size();++i) a[i] += b[i];
+        };
+        for(long w=1; w<=nw; ++w) {
+            std::fill(H.begin(), H.end(), 1);
+            pfr.parallel_reduce_tree(H, hist_t(nbins, 0), 0, size, 1, 100,
+                                     [](const long i, hist_t& h) { h[(i*i) % 1000] += 1; },
+                                     sumhist, w);
+            hist_t E(nbins, 1);
+            for(long i=0;i<size;++i) E[(i*i) % 1000] += 1;
+            if (H != E) {
+                printf("ERROR: wrong histogram with %ld Workers\n", w);
+                return -1;
+            }
+        }
+    }
+
+    // deterministic floating-point reduction
+    {
+        std::vector<double> A(size);
+        for(long i=0;i<size;++i) A[i] = std::sin((double)i) * std::pow(10.0, (double)(i % 17) - 8);
+        auto sum = [](double& a, const double b) { a += b; };
+        double first = 0.0;
+        bool   init  = false;
+        for(long w=1; w<=nw; ++w) {
+            ParallelForReduce<double> pfr(w);
+            for(int k=0;k<3;++k) {
+                double r = 0.0;
+                pfr.parallel_reduce_deterministic(r, 0.0, 0, size, 1,
+                                                  [&A](const long i, double& s) { s += A[i]; },
+                                                  sum);
+                if (!init) { first = r; init = true; }
+                if (std::memcmp(&r, &first, sizeof(double)) != 0) {
+                    printf("ERROR: the result is not reproducible (%.17g != %.17g) with %ld Workers\n", 
+                           r, first, w);
+                    return -1;
+                }
+            }
+            // step > 1 and a given n. of blocks
+            double r = 0.0, e = 0.0;
+            pfr.parallel_reduce_deterministic(r, 0.0, 1, size, 3,
+                                              [&A](const long i, double& s) { s += A[i]; },
+                                              sum, w, 7);
+            for(long i=1;i<size;i+=3) e += A[i];
+            if (std::fabs(r - e) > 1e-6 * std::fabs(e) + 1e-12) {
+                printf("ERROR: sum=%.17g expected %.17g\n", r, e);
+                return -1;
+            }
+        }
+    }
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,116 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+
+/*
+ * Inclusive and exclusive parallel prefix scan, in-place and over an index
+ * range, compared with the sequential scan.
+ *
+ */
+
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <ff/ff.hpp>
+#include <ff/parallel_for.hpp>
+
+using namespace ff;
+
+template<typename T>
+static bool check(const std::vector<T>& R, const std::vector<T>& E, const char* msg) {
+    for(size_t i=0;i<R.size();++i)
+        if (R[i] != E[i]) {
+            printf("ERROR (%s): R[%ld]=%s expected %s\n", msg, (long)i,
+                   std::to_string(R[i]).c_str(), std::to_string(E[i]).c_str());
+            return false;
+        }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    long nw = 4;
+    if (argc>1) nw = atol(argv[1]);
+
+    ParallelForReduce<long> pfr(nw);
+    auto sum = [](long& acc, const long e) { acc += e; };
+
+    for(long n: {0L, 1L, 5L, 3000L, 100000L, 100003L}) {
+        std::vector<long> A(n), R(n), Ein(n), Eex(n);
+        long acc = 0;
+        for(long i=0;i<n;++i) {
+            A[i]   = (i*7) % 13 - 6;
+            Eex[i] = acc;
+            acc   += A[i];
+            Ein[i] = acc;
+        }
+        pfr.parallel_scan(A.data(), R.data(), n, 0L, sum);
+        if (!check(R, Ein, "inclusive")) return -1;
+        pfr.parallel_scan(A.data(), R.data(), n, 0L, sum, false);
+        if (!check(R, Eex, "exclusive")) return -1;
+
+        // in-place
+        R = A;
+        pfr.parallel_scan(R.data(), n, 0L, sum, false);
+        if (!check(R, Eex, "exclusive in-place")) return -1;
+        R = A;
+        pfr.parallel_scan(R.data(), n, 0L, sum, true, 2);
+        if (!check(R, Ein, "inclusive in-place")) return -1;
+
+        // index range: scan of i*i
+        std::vector<long> S(n), ES(n);
+        acc = 0;
+        for(long i=0;i<n;++i) { acc += i*i; ES[i] = acc; }
+        pfr.parallel_scan_idx(0, n, 0L, [](const long i) { return i*i; }, sum,
+                              [&S](const long i, const long v) { S[i] = v; });
+        if (!check(S, ES, "index range")) return -1;
+    }
+
+    // a non-commutative operation: composition of the affine maps x -> a*x+b (mod P)
+    {
+        const long n = 50000, P = 1000003;
+        ParallelForReduce<std::pair<long,long> > pfm(nw);
+        std::vector<std::pair<long,long> > M(n), R(n);
+        for(long i=0;i<n;++i) M[i] = std::make_pair((i%5)+1, i%17);
+        auto compose = [P](std::pair<long,long>& f, const std::pair<long,long>& g) {
+            // g after f
+            f = std::make_pair((g.first*f.first) % P, (g.first*f.second + g.second) % P);
+        };
+        pfm.parallel_scan(M.data(), R.data(), n, std::make_pair(1L,0L), compose);
+        std::pair<long,long> acc(1,0);
+        for(long i=0;i<n;++i) {
+            compose(acc, M[i]);
+            if (R[i] != acc) {
+                printf("ERROR (non-commutative): wrong result at %ld\n", i);
+                return -1;
+            }
+        }
+    }
+    printf("DONE\n");
+    return 0;
+}
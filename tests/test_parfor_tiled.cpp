@@ -0,0 +1,125 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+/*
+ * Tests the parallel_for_2d/3d and parallel_reduce_2d/3d methods: each
+ * iteration of the tiled space has to be computed exactly once.
+ *
+ */
+
+#include <cstdio>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/parallel_for.hpp>
+
+using namespace ff;
+
+int main(int argc, char *argv[]) {
+    long N = 203, M = 317, K = 37;
+    int  nworkers = 3;
+    if (argc>1) {
+        if (argc<5) {
+            printf("use: %s N M K nworkers\n", argv[0]);
+            return -1;
+        }
+        N = atol(argv[1]); M = atol(argv[2]); K = atol(argv[3]);
+        nworkers = atoi(argv[4]);
+    }
+
+    ParallelForReduce<long> pfr(nworkers);
+    ParallelFor pf(nworkers);
+
+    // 2D: the tiles are computed exactly once, the last ones are smaller
+    std::vector<long> A(N*M, 0);
+    for(int k=1;k<=3;++k) {
+        pf.parallel_for_2d(0,N,16*k, 0,M,8*k, [&](const long ib, const long ie, const long jb, const long je) {
+                for(long i=ib;i<ie;++i)
+                    for(long j=jb;j<je;++j) A[i*M+j] += 1;
+            }, nworkers);
+        for(long i=0;i<N*M;++i)
+            if (A[i] != k) {
+                printf("ERROR: 2D A[%ld]=%ld expected %d\n", i, A[i], k);
+                return -1;
+            }
+    }
+
+    // sub-space with an offset
+    std::fill(A.begin(), A.end(), 0);
+    pfr.parallel_for_2d(10,N-10,7, 5,M,64, [&](const long ib, const long ie, const long jb, const long je) {
+            for(long i=ib;i<ie;++i)
+                for(long j=jb;j<je;++j) A[i*M+j] = 1;
+        });
+    for(long i=0;i<N;++i)
+        for(long j=0;j<M;++j)
+            if (A[i*M+j] != ((i>=10 && i<N-10 && j>=5)?1:0)) {
+                printf("ERROR: 2D (offset) A[%ld][%ld]=%ld\n", i, j, A[i*M+j]);
+                return -1;
+            }
+
+    // 3D
+    std::vector<long> B(N*M*K, 0);
+    pf.parallel_for_3d(0,N,32, 0,M,32, 0,K,8,
+                       [&](const long ib, const long ie, const long jb, const long je, const long kb, const long ke) {
+            for(long i=ib;i<ie;++i)
+                for(long j=jb;j<je;++j)
+                    for(long k=kb;k<ke;++k) B[(i*M+j)*K+k] += 1;
+        });
+    for(long i=0;i<N*M*K;++i)
+        if (B[i] != 1) {
+            printf("ERROR: 3D B[%ld]=%ld expected 1\n", i, B[i]);
+            return -1;
+        }
+
+    // reductions
+    long sum = 0;
+    pfr.parallel_reduce_2d(sum, 0L, 0,N,16, 0,M,16,
+                           [&](const long ib, const long ie, const long jb, const long je, long& s) {
+            for(long i=ib;i<ie;++i)
+                for(long j=jb;j<je;++j) s += i*M+j;
+        }, [](long& v, const long e) { v += e; }, nworkers);
+    if (sum != (N*M)*(N*M-1)/2) {
+        printf("ERROR: 2D sum=%ld expected %ld\n", sum, (N*M)*(N*M-1)/2);
+        return -1;
+    }
+    sum = 0;
+    pfr.parallel_reduce_3d(sum, 0L, 0,N,50, 0,M,50, 0,K,10,
+                           [&](const long ib, const long ie, const long jb, const long je,
+                               const long kb, const long ke, long& s) {
+            for(long i=ib;i<ie;++i)
+                for(long j=jb;j<je;++j)
+                    for(long k=kb;k<ke;++k) s += B[(i*M+j)*K+k];
+        }, [](long& v, const long e) { v += e; }, nworkers);
+    if (sum != N*M*K) {
+        printf("ERROR: 3D sum=%ld expected %ld\n", sum, N*M*K);
+        return -1;
+    }
+
+    printf("DONE\n");
+    return 0;
+}
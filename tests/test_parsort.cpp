@@ -0,0 +1,138 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+
+/*
+ * parallel_sort and parallel_stable_sort compared with std::sort and
+ * std::stable_sort: integral keys (radix sort), doubles, strings, a stable
+ * sort of pairs by key only, and a sort on the Workers of a ParallelFor.
+ *
+ */
+
+#include <cstdio>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/parallel_sort.hpp>
+
+using namespace ff;
+
+template<typename T>
+static bool check(const std::vector<T>& R, const std::vector<T>& E, const char* msg) {
+    if (R != E) {
+        printf("ERROR: %s\n", msg);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    long nw = 4;
+    if (argc>1) nw = atol(argv[1]);
+
+    std::mt19937_64 gen(42);
+    for(long n: {0L, 1L, 100L, 20000L, 200001L}) {
+        // signed integral keys (radix sort), also with few distinct values
+        for(long range: {1000000000L, 7L}) {
+            std::vector<int64_t> A(n);
+            for(auto& a: A) a = (int64_t)(gen() % (2*range)) - range;
+            std::vector<int64_t> E(A);
+            std::sort(E.begin(), E.end());
+            std::vector<int64_t> R(A);
+            parallel_sort(R.begin(), R.end());
+            if (!check(R, E, "int64_t")) return -1;
+            R = A;
+            parallel_stable_sort(R.begin(), R.end());
+            if (!check(R, E, "int64_t stable")) return -1;
+            // comparison sort in descending order
+            R = A;
+            std::sort(E.begin(), E.end(), std::greater<int64_t>());
+            parallel_sort(R.begin(), R.end(), std::greater<int64_t>(), nw);
+            if (!check(R, E, "int64_t descending")) return -1;
+        }
+        {
+            std::vector<uint16_t> A(n);
+            for(auto& a: A) a = (uint16_t)gen();
+            std::vector<uint16_t> E(A);
+            std::sort(E.begin(), E.end());
+            parallel_sort(A.begin(), A.end(), std::less<uint16_t>(), nw);
+            if (!check(A, E, "uint16_t")) return -1;
+        }
+        {
+            std::uniform_real_distribution<double> dist(-1.0, 1.0);
+            std::vector<double> A(n);
+            for(auto& a: A) a = dist(gen);
+            std::vector<double> E(A);
+            std::sort(E.begin(), E.end());
+            parallel_sort(A.begin(), A.end(), std::less<double>(), nw);
+            if (!check(A, E, "double")) return -1;
+        }
+        {
+            std::vector<std::string> A(n / 10);
+            for(auto& a: A) a = std::to_string(gen() % 100000);
+            std::vector<std::string> E(A);
+            std::sort(E.begin(), E.end());
+            parallel_sort(A.begin(), A.end(), std::less<std::string>(), nw);
+            if (!check(A, E, "string")) return -1;
+        }
+        {
+            // stable sort by key only, the values give the original order
+            std::vector<std::pair<int,long> > A(n);
+            for(long i=0;i<n;++i) A[i] = std::make_pair((int)(gen() % 100), i);
+            auto bykey = [](const std::pair<int,long>& a, const std::pair<int,long>& b) {
+                return a.first < b.first;
+            };
+            std::vector<std::pair<int,long> > E(A);
+            std::stable_sort(E.begin(), E.end(), bykey);
+            parallel_stable_sort(A.begin(), A.end(), bykey, nw);
+            if (!check(A, E, "stable sort")) return -1;
+        }
+    }
+
+    // on the Workers of a ParallelFor, also used for other loops
+    {
+        const long n = 300000;
+        ParallelFor pf(nw);
+        std::vector<long> A(n);
+        pf.parallel_for(0, n, [&A](const long i) { A[i] = (i*7919) % 100003; });
+        std::vector<long> E(A);
+        std::sort(E.begin(), E.end());
+        parallel_sort(pf, A.begin(), A.end());
+        if (!check(A, E, "ParallelFor radix")) return -1;
+        pf.parallel_for(0, n, [&A](const long i) { A[i] = -A[i]; });
+        for(auto& e: E) e = -e;
+        std::sort(E.begin(), E.end(), [](long a, long b) { return a < b; });
+        parallel_stable_sort(pf, A.begin(), A.end(), [](long a, long b) { return a < b; });
+        if (!check(A, E, "ParallelFor merge")) return -1;
+    }
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,155 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+/*
+ * Messages recycled from the last consumer to the producer.
+ *
+ *   pipeline:   Source -> Stage -> Sink
+ *                 ^                 |
+ *                 |__ return chan __|
+ *
+ *   farm:       Emitter -> Workers (each one with its return channel)
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <ff/ff.hpp>
+#include <ff/recycle.hpp>
+
+using namespace ff;
+
+struct task_t {
+    task_t(long id): id(id), payload(std::to_string(id)) {}
+    long        id;
+    std::string payload;   // not trivially destructible
+};
+
+struct Source: ff_node_t<task_t> {
+    Source(ff_recycle_pool<task_t>& pool, long ntasks): pool(pool), ntasks(ntasks) {}
+    task_t* svc(task_t*) {
+        for(long i=0;i<ntasks;++i) ff_send_out(pool.get(i));
+        return EOS;
+    }
+    ff_recycle_pool<task_t>& pool;
+    const long ntasks;
+};
+struct Stage: ff_node_t<task_t> {
+    task_t* svc(task_t* t) { t->id += 1; return t; }
+};
+struct Sink: ff_node_t<task_t> {
+    Sink(ff_recycle_pool<task_t>& pool, size_t id=0): pool(pool), id(id) {}
+    task_t* svc(task_t* t) {
+        if (t->payload != std::to_string(t->id - 1)) error = true;
+        sum += t->id;
+        pool.put(t, id);
+        return GO_ON;
+    }
+    ff_recycle_pool<task_t>& pool;
+    const size_t id;
+    long sum  = 0;
+    bool error = false;
+};
+// farm worker, it gives back the message to the emitter
+struct Worker: ff_node_t<task_t> {
+    Worker(ff_recycle_pool<task_t>& pool): pool(pool) {}
+    task_t* svc(task_t* t) {
+        if (t->payload != std::to_string(t->id)) error = true;
+        sum += t->id + 1;
+        pool.put(t, get_my_id());
+        return GO_ON;
+    }
+    ff_recycle_pool<task_t>& pool;
+    long sum  = 0;
+    bool error = false;
+};
+
+static int check(const char* name, ff_recycle_pool<task_t>& pool, long ntasks, long sum, bool error) {
+    std::cout << name << ": allocated=" << pool.get_num_allocated() << " recycled=" << pool.get_num_recycled()
+              << " dropped=" << pool.get_num_dropped() << "\n";
+    if (error || sum != ntasks*(ntasks+1)/2) {
+        std::cerr << name << ": wrong result\n";
+        return -1;
+    }
+    if (pool.get_num_allocated() + pool.get_num_recycled() != (size_t)ntasks) {
+        std::cerr << name << ": wrong pool counters\n";
+        return -1;
+    }
+    if (ntasks > 2*DEF_RECYCLE_CAPACITY && pool.get_num_recycled() == 0) {
+        std::cerr << name << ": no message has been recycled\n";
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    long ntasks   = 200000;
+    size_t nworkers = 3;
+    if (argc>1) {
+        if (argc!=3) {
+            std::cerr << "use: " << argv[0] << " [ntasks nworkers]\n";
+            return -1;
+        }
+        ntasks   = std::stol(argv[1]);
+        nworkers = std::stol(argv[2]);
+    }
+    {
+        ff_recycle_pool<task_t> pool;
+        Source source(pool, ntasks);
+        Stage  stage;
+        Sink   sink(pool);
+        ff_Pipe<> pipe(source, stage, sink);
+        pipe.setFixedSize(true);   // bounded queues, bounded n. of messages in flight
+        if (pipe.run_and_wait_end()<0) {
+            error("running pipe\n");
+            return -1;
+        }
+        if (check("pipeline", pool, ntasks, sink.sum, sink.error) < 0) return -1;
+    }
+    {
+        ff_recycle_pool<task_t> pool(nworkers);
+        Source source(pool, ntasks);
+        std::vector<std::unique_ptr<ff_node> > W;
+        for(size_t i=0;i<nworkers;++i) W.push_back(make_unique<Worker>(pool));
+        ff_Farm<task_t> farm(std::move(W), source);
+        farm.remove_collector();
+        farm.setFixedSize(true);
+        if (farm.run_and_wait_end()<0) {
+            error("running farm\n");
+            return -1;
+        }
+        long sum = 0; bool err = false;
+        for(size_t i=0;i<nworkers;++i) {
+            Worker* w = reinterpret_cast<Worker*>(farm.getWorkers()[i]);
+            sum += w->sum; err |= w->error;
+        }
+        if (check("farm", pool, ntasks, sum, err) < 0) return -1;
+    }
+    return 0;
+}
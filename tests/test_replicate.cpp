@@ -0,0 +1,123 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+/*
+ *  Source --> ff_replicable_stage<Work> --> Sink
+ *
+ *  In the first part of the stream the Work stage is the bottleneck and it has to
+ *  be replicated, then the Source slows down and the replicas can be removed.
+ *  The Sink checks that all tasks are received (in order if requested).
+ */
+
+#include <iostream>
+#include <ff/ff.hpp>
+#include <ff/replicate.hpp>
+using namespace ff;
+
+struct Source: ff_node_t<long> {
+    Source(long ntasks):ntasks(ntasks) {}
+    long* svc(long*) {
+        for(long i=0;i<ntasks;++i) {
+            if (i >= ntasks/2) usleep(500);     // second part: low load
+            ff_send_out(new long(i));
+        }
+        return EOS;
+    }
+    long ntasks;
+};
+struct Work: ff_node_t<long> {
+    long* svc(long* t) {
+        ticks_wait(500000);
+        return t;
+    }
+};
+struct Sink: ff_node_t<long> {
+    Sink(bool ordered):ordered(ordered) {}
+    long* svc(long* t) {
+        if (ordered && *t != expected) {
+            std::cerr << "WRONG ORDER, received " << *t << " expected " << expected << "\n";
+            error = true;
+        }
+        ++expected; ++received;
+        delete t;
+        return GO_ON;
+    }
+    bool ordered, error=false;
+    long expected=0, received=0;
+};
+
+static int run(long ntasks, size_t nreplicas, bool ordered) {
+    replication_policy policy;
+    policy.period_us = 2000;
+    Source source(ntasks);
+    ff_replicable_stage<Work> stage(Work(), nreplicas, ordered, 1, policy);
+    Sink sink(ordered);
+    ff_Pipe<> pipe(source, stage, sink);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    std::cout << "ordered=" << ordered << " max active replicas= " << stage.get_max_active_replicas()
+              << " scale-up= " << stage.get_num_scaleup()
+              << " scale-down= " << stage.get_num_scaledown() << "\n";
+    if (sink.error || sink.received != ntasks) {
+        std::cerr << "WRONG RESULT, received " << sink.received << " tasks\n";
+        return -1;
+    }
+    // The Work stage saturates only if the spinning threads do not steal its cores:
+    // source, emitter, replicas, sink and, if ordered, the collector.
+#if defined(BLOCKING_MODE)
+    const bool saturated = true;
+#else
+    const bool saturated = ff_numCores() >= (ssize_t)(nreplicas + 3 + ordered);
+#endif
+    if (saturated && nreplicas>1 &&
+        (stage.get_num_scaleup() == 0 || stage.get_num_scaledown() == 0)) {
+        std::cerr << "WRONG REPLICATION, the stage has not been scaled up and down\n";
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    long   ntasks    = 400;
+    size_t nreplicas = 4;
+    if (argc>1) {
+        if (argc!=3) {
+            std::cerr << "use: " << argv[0] << " ntasks nreplicas\n";
+            return -1;
+        }
+        ntasks    = std::stol(argv[1]);
+        nreplicas = std::stol(argv[2]);
+    }
+    if (run(ntasks, nreplicas, false)<0) return -1;
+    if (run(ntasks, nreplicas, true)<0)  return -1;
+    std::cout << "DONE\n";
+    return 0;
+}
@@ -0,0 +1,201 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+/*
+ *    Mapper _    _ Reducer
+ *           |  |
+ *    Mapper _| -|- Reducer      (hash-partitioned shuffle with combiner)
+ *           |  |
+ *    Mapper -    - Reducer
+ *
+ *  Each Mapper generates 'nrecords' (key,1) pairs, the Reducers count
+ *  the occurrences of each key. Each key must be received by one Reducer only.
+ *  The last test checks that the partial batches are flushed by time while
+ *  the input stream is quiet.
+ */
+
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <ff/ff.hpp>
+#include <ff/shuffle.hpp>
+using namespace ff;
+
+typedef std::pair<long,long> record_t;
+typedef ff_shuffle_batch<record_t> batch_t;
+
+static std::mutex mtx;
+static std::map<long, std::pair<long,ssize_t> > result; // key -> (count, reducer id)
+static bool error_found = false;
+
+struct Mapper: ff_shuffle_node<long, record_t, long> {
+    Mapper(long nrecords, long nkeys, bool combine):
+        ff_shuffle_node<long, record_t, long>(
+            [](const record_t& r) { return r.first; }, 64, 1000,
+            combine ? combiner_f([](record_t& acc, const record_t& r) { acc.second += r.second; }) : nullptr),
+        nrecords(nrecords), nkeys(nkeys) {}
+
+    batch_t *svc(long*) {
+        for(long i=0;i<nrecords;++i)
+            shuffle(record_t(i % nkeys, 1));
+        return EOS;
+    }
+    long nrecords, nkeys;
+};
+
+struct Reducer: ff_minode_t<batch_t, void> {
+    void *svc(batch_t *b) {
+        for(auto& r: b->data) counts[r.first] += r.second;
+        delete b;
+        return GO_ON;
+    }
+    void svc_end() {
+        std::lock_guard<std::mutex> lck(mtx);
+        for(auto& c: counts) {
+            auto it = result.find(c.first);
+            if (it != result.end() && it->second.second != get_my_id()) {
+                std::cerr << "key " << c.first << " received by two reducers\n";
+                error_found = true;
+            }
+            result[c.first].first += c.second;
+            result[c.first].second = get_my_id();
+        }
+    }
+    std::map<long,long> counts;
+};
+
+static int run(size_t nmappers, size_t nreducers, long nrecords, long nkeys, bool combine) {
+    result.clear();
+    std::vector<Mapper*>  W1;
+    std::vector<Reducer*> W2;
+    for(size_t i=0;i<nmappers;++i)  W1.push_back(new Mapper(nrecords, nkeys, combine));
+    for(size_t i=0;i<nreducers;++i) W2.push_back(new Reducer);
+
+    ff_a2a a2a;
+    a2a.add_firstset(W1, 0, true);
+    a2a.add_secondset(W2, true);
+    if (a2a.run_and_wait_end()<0) {
+        error("running A2A\n");
+        return -1;
+    }
+    size_t batches=0, combined=0;
+    for(auto m: W1) { batches += m->get_num_batches(); combined += m->get_num_combined(); }
+
+    if ((long)result.size() != nkeys) {
+        std::cerr << "wrong number of keys " << result.size() << "\n";
+        return -1;
+    }
+    for(auto& r: result) {
+        if (r.second.first != (long)nmappers*(nrecords/nkeys)) {
+            std::cerr << "wrong count for key " << r.first << ": " << r.second.first << "\n";
+            return -1;
+        }
+    }
+    std::cout << "combine=" << combine << " batches sent= " << batches
+              << " records combined= " << combined << "\n";
+    return error_found ? -1 : 0;
+}
+
+// the input stalls after a few records: the partial batches have to be
+// delivered after flush_us, not at the end of the stream
+static const unsigned long STALL_US = 300000;
+static std::atomic<unsigned long> last_sent{0}, first_received{0};
+
+struct SlowSource: ff_node_t<long> {
+    long *svc(long*) {
+        for(long i=0;i<10;++i) ff_send_out(new long(i));
+        last_sent = getusec();
+        usleep(STALL_US);
+        return EOS;
+    }
+};
+struct Forwarder: ff_shuffle_node<long, record_t, long> {
+    Forwarder(): ff_shuffle_node<long, record_t, long>([](const record_t& r) { return r.first; }, 64, 1000) {}
+    batch_t *svc(long *t) {
+        shuffle(record_t(*t, 1));
+        delete t;
+        return GO_ON;
+    }
+};
+struct Receiver: ff_minode_t<batch_t, void> {
+    void *svc(batch_t *b) {
+        unsigned long zero = 0;
+        first_received.compare_exchange_strong(zero, getusec());
+        nrecords += b->data.size();
+        delete b;
+        return GO_ON;
+    }
+    size_t nrecords=0;
+};
+
+static int run_flush() {
+    SlowSource source;
+    Forwarder  f;
+    Receiver   r1, r2;
+    ff_a2a a2a;
+    const std::vector<Forwarder*> W1 = {&f};
+    const std::vector<Receiver*>  W2 = {&r1, &r2};
+    a2a.add_firstset(W1);
+    a2a.add_secondset(W2);
+    ff_Pipe<> pipe(source, a2a);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    const unsigned long latency = first_received - last_sent;
+    std::cout << "flush on a quiet stream: first batch after " << latency << " us\n";
+    if (r1.nrecords + r2.nrecords != 10 || first_received == 0 || latency >= STALL_US/3) {
+        std::cerr << "the partial batches have not been flushed in time\n";
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    size_t nmappers  = 3;
+    size_t nreducers = 4;
+    long   nrecords  = 100000;
+    long   nkeys     = 100;
+    if (argc>1) {
+        if (argc!=5) {
+            std::cerr << "use: " << argv[0] << " nmappers nreducers nrecords nkeys\n";
+            return -1;
+        }
+        nmappers  = std::stol(argv[1]);
+        nreducers = std::stol(argv[2]);
+        nrecords  = std::stol(argv[3]);
+        nkeys     = std::stol(argv[4]);
+    }
+    if (run(nmappers, nreducers, nrecords, nkeys, false)<0) return -1;
+    if (run(nmappers, nreducers, nrecords, nkeys, true)<0)  return -1;
+    if (run_flush()<0) return -1;
+    std::cout << "DONE\n";
+    return 0;
+}
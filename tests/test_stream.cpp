@@ -0,0 +1,160 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+
+/*
+ *  Fluent stream operators lowered to FastFlow graphs:
+ *
+ *   1. sequential operators      --> a single node
+ *   2. word count                --> Source --> A2A(flatMap+keyBy, reduce) --> sink
+ *   3. parallel map + keyed sum  --> Source --> farm(map) --> A2A(filter+keyBy, reduce) --> sink
+ *   4. two keyed reductions      --> Source --> A2A --> A2A --> sink
+ *   5. parallel map + sink       --> Source --> farm(map+sink), without collector
+ */
+
+#include <iostream>
+#include <sstream>
+#include <map>
+#include <mutex>
+#include <ff/ff.hpp>
+#include <ff/stream.hpp>
+using namespace ff;
+
+// it generates 1..n
+struct range {
+    range(long n): n(n) {}
+    bool operator()(long& x) {
+        if (i == n) return false;
+        x = ++i;
+        return true;
+    }
+    long n, i=0;
+};
+
+int main(int argc, char* argv[]) {
+    long N = 10000;
+    if (argc>1) N = std::stol(argv[1]);
+
+    {  // 1.
+        long sum = 0;
+        auto g = stream<long>(range(N))
+            .map([](long& x) { return 2*x; })
+            .filter([](long& x) { return x % 3 != 0; })
+            .sink([&](long& x) { sum += x; });
+        if (g.run_and_wait_end()<0) { error("running test 1\n"); return -1; }
+        long expected = 0;
+        for(long i=1;i<=N;++i) if ((2*i)%3) expected += 2*i;
+        if (sum != expected || g.cardinality() != 1) {
+            std::cerr << "test 1: wrong result " << sum << " cardinality " << g.cardinality() << "\n";
+            return -1;
+        }
+    }
+    {  // 2.
+        const char* text[] = { "a b c", "b c d", "c d e", "a a a" };
+        std::map<std::string,long> count;
+        size_t line = 0;
+        auto g = stream<std::string>([&](std::string& s) {
+                if (line == 4*100) return false;
+                s = text[line++ % 4];
+                return true;
+            })
+            .parallel(2)
+            .flatMap([](std::string& s) {
+                std::vector<std::string> words;
+                std::istringstream in(s);
+                for(std::string w; in >> w;) words.push_back(w);
+                return words;
+            })
+            .keyBy([](std::string& w) { return w; }, 3)
+            .reduce(0L, [](long& c, std::string&) { ++c; })
+            .sink([&](std::pair<std::string,long>& r) { count[r.first] += r.second; });
+        if (g.run_and_wait_end()<0) { error("running test 2\n"); return -1; }
+        const std::map<std::string,long> expected = {{"a",400},{"b",200},{"c",300},{"d",200},{"e",100}};
+        if (count != expected) {
+            std::cerr << "test 2: wrong result\n";
+            return -1;
+        }
+    }
+    {  // 3.
+        std::mutex mtx;
+        std::map<long,long> result;
+        auto g = stream<long>(range(N))
+            .parallel(3)
+            .map([](long& x) { return x*x; })
+            .parallel(2)
+            .filter([](long& x) { return x % 2 == 0; })
+            .keyBy([](long& x) { return x % 10; })
+            .reduce(0L, [](long& acc, long& x) { acc += x; })
+            .sink([&](std::pair<long,long>& r) {
+                std::lock_guard<std::mutex> lck(mtx);
+                result[r.first] += r.second;
+            });
+        if (g.run_and_wait_end()<0) { error("running test 3\n"); return -1; }
+        std::map<long,long> expected;
+        for(long i=1;i<=N;++i) if ((i*i)%2 == 0) expected[(i*i)%10] += i*i;
+        if (result != expected) {
+            std::cerr << "test 3: wrong result\n";
+            return -1;
+        }
+    }
+    {  // 4.
+        long total = 0, nkeys = 0;
+        auto g = stream<long>(range(N))
+            .keyBy([](long& x) { return x % 100; }, 4)
+            .reduce(0L, [](long& acc, long& x) { acc += x; })
+            .map([](std::pair<long,long>& r) { return std::make_pair(r.first % 10, r.second); })
+            .keyBy([](std::pair<long,long>& r) { return r.first; }, 2)
+            .reduce(0L, [](long& acc, std::pair<long,long>& r) { acc += r.second; })
+            .sink([&](std::pair<long,long>& r) { total += r.second; ++nkeys; });
+        if (g.run_and_wait_end()<0) { error("running test 4\n"); return -1; }
+        if (total != N*(N+1)/2 || nkeys != 10) {
+            std::cerr << "test 4: wrong result " << total << " " << nkeys << "\n";
+            return -1;
+        }
+    }
+    {  // 5.
+        std::mutex mtx;
+        long sum = 0;
+        auto g = stream<long>(range(N))
+            .parallel(3)
+            .map([](long& x) { return 2*x; })
+            .sink([&](long& x) {
+                std::lock_guard<std::mutex> lck(mtx);
+                sum += x;
+            });
+        if (g.run_and_wait_end()<0) { error("running test 5\n"); return -1; }
+        // source, emitter and 3 workers, the sink is fused in the workers
+        if (sum != N*(N+1) || g.cardinality() != 5) {
+            std::cerr << "test 5: wrong result " << sum << " cardinality " << g.cardinality() << "\n";
+            return -1;
+        }
+    }
+    std::cout << "DONE\n";
+    return 0;
+}
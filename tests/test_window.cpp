@@ -0,0 +1,195 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ *
+ *
+ */
+
+/*
+ * Windowed aggregation: the results of the window operators (sequential and
+ * keyed parallel) are compared with the ones computed by brute force.
+ *
+ *   generator -> window operator -> checker
+ */
+
+#include <iostream>
+#include <map>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/window.hpp>
+
+using namespace ff;
+
+struct event_t {
+    long     key;
+    uint64_t ts;
+    long     value;
+};
+typedef ff_window_result<long, long> result_t;
+typedef std::map<std::pair<long,uint64_t>, std::pair<size_t,long> > table_t; // (key,start) -> (count,sum)
+
+static std::vector<event_t> make_events(size_t n, long nkeys) {
+    std::vector<event_t> E;
+    uint64_t ts = 0;
+    for(size_t i=0;i<n;++i) {
+        ts += (i % 97 == 0) ? 50 : (i % 3);  // some gaps
+        E.push_back(event_t{(long)((i*7) % nkeys), ts, (long)(i % 13)});
+    }
+    return E;
+}
+
+// expected results of tumbling/sliding windows
+static table_t expected(const std::vector<event_t>& E, long nkeys, const ff_window_spec& s) {
+    table_t T;
+    for(long k=0;k<nkeys;++k) {
+        std::vector<std::pair<uint64_t,long> > X; // (position,value)
+        for(auto& e: E)
+            if (e.key == k) X.push_back({s.unit==ff_window_spec::COUNT ? X.size() : e.ts, e.value});
+        if (X.empty()) continue;
+        for(uint64_t start=0; start<=X.back().first; start+=s.slide) {
+            size_t c=0; long sum=0;
+            for(auto& x: X)
+                if (x.first >= start && x.first < start+s.size) { ++c; sum += x.second; }
+            if (c) T[{k,start}] = {c,sum};
+        }
+    }
+    return T;
+}
+
+// expected results of session windows
+static table_t expected_sessions(const std::vector<event_t>& E, long nkeys, uint64_t gap) {
+    table_t T;
+    for(long k=0;k<nkeys;++k) {
+        bool open=false; uint64_t start=0, last=0; size_t c=0; long sum=0;
+        for(auto& e: E) {
+            if (e.key != k) continue;
+            if (open && e.ts > last+gap) { T[{k,start}] = {c,sum}; open=false; }
+            if (!open) { open=true; start=e.ts; c=0; sum=0; }
+            last = e.ts; ++c; sum += e.value;
+        }
+        if (open) T[{k,start}] = {c,sum};
+    }
+    return T;
+}
+
+struct Generator: ff_node_t<event_t> {
+    Generator(const std::vector<event_t>& E): E(E) {}
+    event_t* svc(event_t*) {
+        for(auto& e: E) ff_send_out(new event_t(e));
+        return EOS;
+    }
+    const std::vector<event_t>& E;
+};
+
+struct Checker: ff_minode_t<result_t, void> {
+    void* svc(result_t* r) {
+        if (r->end - r->start != length && length) error = true;
+        T[{r->key, r->start}] = {r->count, r->value};
+        ++n;
+        delete r;
+        return GO_ON;
+    }
+    table_t  T;
+    uint64_t length = 0;   // expected window length (0: not checked)
+    size_t   n = 0;
+    bool     error = false;
+};
+
+static int run(const char* name, const std::vector<event_t>& E, long nkeys, const ff_window_spec& spec,
+               size_t nworkers, bool keyed=true) {
+    auto add     = [](long& a, const event_t& e) { a += e.value; };
+    auto combine = [](const long& a, const long& b) { return a + b; };
+    auto key     = [](const event_t& e) { return e.key; };
+    auto ts      = [](const event_t& e) { return e.ts; };
+
+    Generator gen(E);
+    Checker   chk;
+    if (spec.kind != ff_window_spec::SESSION) chk.length = spec.size;
+    ff_pipeline pipe;
+    pipe.add_stage(&gen);
+    if (nworkers)
+        pipe.add_stage(new ff_window_farm<event_t,long,long>(nworkers, spec, 0, add, combine, key, ts), true);
+    else
+        pipe.add_stage(new ff_window_node<event_t,long,long>(spec, 0, add, combine,
+                                                             keyed ? std::function<long(const event_t&)>(key) : nullptr, ts), true);
+    pipe.add_stage(&chk);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    table_t T;
+    if (spec.kind == ff_window_spec::SESSION) T = expected_sessions(E, nkeys, spec.size);
+    else if (keyed) T = expected(E, nkeys, spec);
+    else {
+        std::vector<event_t> G(E);
+        for(auto& e: G) e.key = 0;
+        T = expected(G, 1, spec);
+    }
+    if (chk.error || chk.n != T.size() || chk.T != T) {
+        std::cerr << name << ": wrong results (" << chk.n << " windows, expected " << T.size() << ")\n";
+        return -1;
+    }
+    std::cout << name << ": " << chk.n << " windows OK\n";
+    return 0;
+}
+
+// time-based windows without a timestamp function: the graph must not start
+static int run_no_ts(const std::vector<event_t>& E) {
+    auto add     = [](long& a, const event_t& e) { a += e.value; };
+    auto combine = [](const long& a, const long& b) { return a + b; };
+    Generator gen(E);
+    ff_pipeline pipe;
+    pipe.add_stage(&gen);
+    pipe.add_stage(new ff_window_node<event_t,long,long>(ff_window_spec::tumbling(64, ff_window_spec::TIME),
+                                                         0, add, combine), true);
+    // the failure of svc_init is reported by wait_freezing
+    if (pipe.run_then_freeze()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    const int r = pipe.wait_freezing();
+    pipe.wait();
+    if (r>=0) {
+        std::cerr << "no timestamp function: the pipe should fail\n";
+        return -1;
+    }
+    std::cout << "no timestamp function: OK\n";
+    return 0;
+}
+
+int main() {
+    const long nkeys = 17;
+    std::vector<event_t> E = make_events(5000, nkeys);
+
+    if (run("tumbling count (global)", E, 1, ff_window_spec::tumbling(100), 0, false) < 0) return -1;
+    if (run("sliding count (keyed)", E, nkeys, ff_window_spec::sliding(10, 4), 3) < 0) return -1;
+    if (run("hopping count (keyed)", E, nkeys, ff_window_spec::sliding(4, 10), 2) < 0) return -1;
+    if (run("tumbling time (keyed)", E, nkeys, ff_window_spec::tumbling(64, ff_window_spec::TIME), 0) < 0) return -1;
+    if (run("sliding time (keyed)", E, nkeys, ff_window_spec::sliding(120, 30, ff_window_spec::TIME), 4) < 0) return -1;
+    if (run("sliding time (global)", E, 1, ff_window_spec::sliding(100, 25, ff_window_spec::TIME), 0, false) < 0) return -1;
+    if (run("session (keyed)", E, nkeys, ff_window_spec::session(20), 3) < 0) return -1;
+    if (run_no_ts(std::vector<event_t>(E.begin(), E.begin()+10)) < 0) return -1;
+    return 0;
+}